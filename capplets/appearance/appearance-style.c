@@ -34,9 +34,12 @@
 #define GSETTINGS_SETTINGS "GSETTINGS_SETTINGS"
 #define GSETTINGS_KEY "GSETTINGS_KEY"
 #define THEME_DATA "THEME_DATA"
+#define THUMBNAIL_REQUESTS "THUMBNAIL_REQUESTS"
+/* rows around the visible ones whose thumbnails are rendered ahead */
+#define THUMBNAIL_PREFETCH 8
 
-typedef void (*ThumbnailGenFunc)(void *type, ThemeThumbnailFunc theme,
-                                 AppearanceData *data, GDestroyNotify *destroy);
+typedef guint (*ThumbnailGenFunc)(void *type, ThemeThumbnailFunc theme,
+                                  AppearanceData *data, GDestroyNotify destroy);
 
 typedef struct {
   AppearanceData *data;
@@ -608,6 +611,62 @@ static void cursor_theme_delete_cb(GtkWidget *button, AppearanceData *data) {
   generic_theme_delete("cursor_themes_list", THEME_TYPE_CURSOR, data);
 }
 
+/* Each list maps a theme name to its outstanding factory request, or to NULL
+ * once the thumbnail has been rendered.  Themes missing from the table still
+ * need one, which is requested when their row scrolls into view. */
+static void thumbnail_request_cancel(GtkWidget *list, const gchar *theme_name) {
+  GHashTable *requests = g_object_get_data(G_OBJECT(list), THUMBNAIL_REQUESTS);
+  gpointer id;
+
+  if (requests == NULL) return;
+
+  id = g_hash_table_lookup(requests, theme_name);
+  if (id != NULL) theme_thumbnail_cancel(GPOINTER_TO_UINT(id));
+
+  g_hash_table_remove(requests, theme_name);
+}
+
+static void thumbnail_request_done(const gchar *tv_name,
+                                   const gchar *theme_name,
+                                   AppearanceData *data) {
+  GHashTable *requests = g_object_get_data(
+      G_OBJECT(appearance_capplet_get_widget(data, tv_name)),
+      THUMBNAIL_REQUESTS);
+
+  if (requests != NULL)
+    g_hash_table_replace(requests, g_strdup(theme_name), NULL);
+}
+
+static void thumbnail_request_queue(GtkWidget *list,
+                                    MateThemeCommonInfo *theme,
+                                    ThumbnailGenFunc generator,
+                                    ThemeThumbnailFunc thumb_cb,
+                                    AppearanceData *data) {
+  GHashTable *requests = g_object_get_data(G_OBJECT(list), THUMBNAIL_REQUESTS);
+  guint id;
+
+  thumbnail_request_cancel(list, theme->name);
+
+  id = generator(theme, thumb_cb, data, NULL);
+  if (requests == NULL) return;
+
+  if (id != 0)
+    g_hash_table_insert(requests, g_strdup(theme->name), GUINT_TO_POINTER(id));
+  else if (!g_hash_table_contains(requests, theme->name))
+    g_hash_table_insert(requests, g_strdup(theme->name), NULL);
+}
+
+/* Forgets the thumbnail of a theme that changed on disk; it is rendered again
+ * if its row is within reach. */
+static void thumbnail_request_refresh(const gchar *tv_name,
+                                      const gchar *theme_name,
+                                      AppearanceData *data) {
+  GtkWidget *list = appearance_capplet_get_widget(data, tv_name);
+
+  thumbnail_request_cancel(list, theme_name);
+  theme_view_visible_range_changed(list);
+}
+
 static void add_to_treeview(const gchar *tv_name, const gchar *theme_name,
                             const gchar *theme_label,
                             GdkPixbuf *theme_thumbnail, AppearanceData *data) {
@@ -633,6 +692,8 @@ static void remove_from_treeview(const gchar *tv_name, const gchar *theme_name,
   model = GTK_LIST_STORE(gtk_tree_model_sort_get_model(
       GTK_TREE_MODEL_SORT(gtk_tree_view_get_model(treeview))));
 
+  thumbnail_request_cancel(GTK_WIDGET(treeview), theme_name);
+
   if (theme_find_in_model(GTK_TREE_MODEL(model), theme_name, &iter))
     gtk_list_store_remove(model, &iter);
 }
@@ -674,16 +735,19 @@ static void update_thumbnail_in_treeview(const gchar *tv_name,
 
 static void gtk_theme_thumbnail_cb(GdkPixbuf *pixbuf, gchar *theme_name,
                                    AppearanceData *data) {
+  thumbnail_request_done("gtk_themes_list", theme_name, data);
   update_thumbnail_in_treeview("gtk_themes_list", theme_name, pixbuf, data);
 }
 
 static void marco_theme_thumbnail_cb(GdkPixbuf *pixbuf, gchar *theme_name,
                                      AppearanceData *data) {
+  thumbnail_request_done("window_themes_list", theme_name, data);
   update_thumbnail_in_treeview("window_themes_list", theme_name, pixbuf, data);
 }
 
 static void icon_theme_thumbnail_cb(GdkPixbuf *pixbuf, gchar *theme_name,
                                     AppearanceData *data) {
+  thumbnail_request_done("icon_themes_list", theme_name, data);
   update_thumbnail_in_treeview("icon_themes_list", theme_name, pixbuf, data);
 }
 
@@ -693,26 +757,71 @@ static void create_thumbnail(const gchar *name, GdkPixbuf *default_thumb,
     MateThemeIconInfo *info;
     info = mate_theme_icon_info_find(name);
     if (info != NULL) {
-      generate_icon_theme_thumbnail_async(
-          info, (ThemeThumbnailFunc)icon_theme_thumbnail_cb, data, NULL);
+      thumbnail_request_queue(
+          appearance_capplet_get_widget(data, "icon_themes_list"),
+          (MateThemeCommonInfo *)info,
+          (ThumbnailGenFunc)generate_icon_theme_thumbnail_async,
+          (ThemeThumbnailFunc)icon_theme_thumbnail_cb, data);
     }
   } else if (default_thumb == data->gtk_theme_icon) {
     MateThemeInfo *info;
     info = mate_theme_info_find(name);
     if (info != NULL && info->has_gtk) {
-      generate_gtk_theme_thumbnail_async(
-          info, (ThemeThumbnailFunc)gtk_theme_thumbnail_cb, data, NULL);
+      thumbnail_request_queue(
+          appearance_capplet_get_widget(data, "gtk_themes_list"),
+          (MateThemeCommonInfo *)info,
+          (ThumbnailGenFunc)generate_gtk_theme_thumbnail_async,
+          (ThemeThumbnailFunc)gtk_theme_thumbnail_cb, data);
     }
   } else if (default_thumb == data->window_theme_icon) {
     MateThemeInfo *info;
     info = mate_theme_info_find(name);
     if (info != NULL && info->has_marco) {
-      generate_marco_theme_thumbnail_async(
-          info, (ThemeThumbnailFunc)marco_theme_thumbnail_cb, data, NULL);
+      thumbnail_request_queue(
+          appearance_capplet_get_widget(data, "window_themes_list"),
+          (MateThemeCommonInfo *)info,
+          (ThumbnailGenFunc)generate_marco_theme_thumbnail_async,
+          (ThemeThumbnailFunc)marco_theme_thumbnail_cb, data);
     }
   }
 }
 
+static gboolean list_thumbnails_update(GtkWidget *list) {
+  ThemeConvData *conv = g_object_get_data(G_OBJECT(list), THEME_DATA);
+  GHashTable *requests = g_object_get_data(G_OBJECT(list), THUMBNAIL_REQUESTS);
+  GHashTable *wanted;
+  GHashTableIter iter;
+  GPtrArray *names;
+  gpointer name, id;
+  guint i;
+
+  names = theme_view_get_visible_names(list, THUMBNAIL_PREFETCH);
+  wanted = g_hash_table_new(g_str_hash, g_str_equal);
+  for (i = 0; i < names->len; i++)
+    g_hash_table_add(wanted, g_ptr_array_index(names, i));
+
+  /* rows scrolled out of reach don't need their thumbnail any more */
+  g_hash_table_iter_init(&iter, requests);
+  while (g_hash_table_iter_next(&iter, &name, &id)) {
+    if (id != NULL && !g_hash_table_contains(wanted, name)) {
+      theme_thumbnail_cancel(GPOINTER_TO_UINT(id));
+      g_hash_table_iter_remove(&iter);
+    }
+  }
+
+  /* names come visible rows first, so those are queued first */
+  for (i = 0; i < names->len; i++) {
+    name = g_ptr_array_index(names, i);
+    if (!g_hash_table_contains(requests, name))
+      create_thumbnail(name, conv->thumbnail, conv->data);
+  }
+
+  g_hash_table_destroy(wanted);
+  g_ptr_array_unref(names);
+
+  return FALSE;
+}
+
 static void changed_on_disk_cb(MateThemeCommonInfo *theme,
                                MateThemeChangeType change_type,
                                MateThemeElement element_type,
@@ -734,8 +843,7 @@ static void changed_on_disk_cb(MateThemeCommonInfo *theme,
         else if (change_type == MATE_THEME_CHANGE_CHANGED)
           update_in_treeview("gtk_themes_list", info->name, info->name, data);
 
-        generate_gtk_theme_thumbnail_async(
-            info, (ThemeThumbnailFunc)gtk_theme_thumbnail_cb, data, NULL);
+        thumbnail_request_refresh("gtk_themes_list", info->name, data);
       }
 
       if (element_type & MATE_THEME_MARCO) {
@@ -746,8 +854,7 @@ static void changed_on_disk_cb(MateThemeCommonInfo *theme,
           update_in_treeview("window_themes_list", info->name, info->name,
                              data);
 
-        generate_marco_theme_thumbnail_async(
-            info, (ThemeThumbnailFunc)marco_theme_thumbnail_cb, data, NULL);
+        thumbnail_request_refresh("window_themes_list", info->name, data);
       }
     }
 
@@ -764,8 +871,7 @@ static void changed_on_disk_cb(MateThemeCommonInfo *theme,
         update_in_treeview("icon_themes_list", info->name, info->readable_name,
                            data);
 
-      generate_icon_theme_thumbnail_async(
-          info, (ThemeThumbnailFunc)icon_theme_thumbnail_cb, data, NULL);
+      thumbnail_request_refresh("icon_themes_list", info->name, data);
     }
 
   } else if (theme->type == MATE_THEME_TYPE_CURSOR) {
@@ -793,8 +899,6 @@ static void prepare_list(AppearanceData *data, GtkWidget *list, ThemeType type,
   GtkTreeModel *sort_model;
   GdkPixbuf *thumbnail;
   const gchar *key;
-  ThumbnailGenFunc generator;
-  ThemeThumbnailFunc thumb_cb;
   ThemeConvData *conv_data;
   GSettings *settings;
 
@@ -804,8 +908,6 @@ static void prepare_list(AppearanceData *data, GtkWidget *list, ThemeType type,
       thumbnail = data->gtk_theme_icon;
       settings = data->interface_settings;
       key = GTK_THEME_KEY;
-      generator = (ThumbnailGenFunc)generate_gtk_theme_thumbnail_async;
-      thumb_cb = (ThemeThumbnailFunc)gtk_theme_thumbnail_cb;
       break;
 
     case THEME_TYPE_WINDOW:
@@ -813,8 +915,6 @@ static void prepare_list(AppearanceData *data, GtkWidget *list, ThemeType type,
       thumbnail = data->window_theme_icon;
       settings = data->marco_settings;
       key = MARCO_THEME_KEY;
-      generator = (ThumbnailGenFunc)generate_marco_theme_thumbnail_async;
-      thumb_cb = (ThemeThumbnailFunc)marco_theme_thumbnail_cb;
       break;
 
     case THEME_TYPE_ICON:
@@ -822,8 +922,6 @@ static void prepare_list(AppearanceData *data, GtkWidget *list, ThemeType type,
       thumbnail = data->icon_theme_icon;
       settings = data->interface_settings;
       key = ICON_THEME_KEY;
-      generator = (ThumbnailGenFunc)generate_icon_theme_thumbnail_async;
-      thumb_cb = (ThemeThumbnailFunc)icon_theme_thumbnail_cb;
       break;
 
     case THEME_TYPE_CURSOR:
@@ -831,8 +929,6 @@ static void prepare_list(AppearanceData *data, GtkWidget *list, ThemeType type,
       thumbnail = NULL;
       settings = data->mouse_settings;
       key = CURSOR_THEME_KEY;
-      generator = NULL;
-      thumb_cb = NULL;
       break;
 
     default:
@@ -843,15 +939,17 @@ static void prepare_list(AppearanceData *data, GtkWidget *list, ThemeType type,
   store = gtk_list_store_new(NUM_COLS, GDK_TYPE_PIXBUF, G_TYPE_STRING,
                              G_TYPE_STRING);
 
+  g_object_set_data_full(
+      G_OBJECT(list), THUMBNAIL_REQUESTS,
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL),
+      (GDestroyNotify)g_hash_table_destroy);
+
   for (l = themes; l; l = g_list_next(l)) {
     MateThemeCommonInfo *theme = (MateThemeCommonInfo *)l->data;
     GtkTreeIter i;
 
-    if (type == THEME_TYPE_CURSOR) {
+    if (type == THEME_TYPE_CURSOR)
       thumbnail = ((MateThemeCursorInfo *)theme)->thumbnail;
-    } else {
-      generator(theme, thumb_cb, data, NULL);
-    }
 
     gtk_list_store_insert_with_values(
         store, &i, 0, COL_LABEL, theme->readable_name, COL_NAME, theme->name,
@@ -899,6 +997,12 @@ static void prepare_list(AppearanceData *data, GtkWidget *list, ThemeType type,
   g_object_set_data(G_OBJECT(list), GSETTINGS_SETTINGS, settings);
   g_object_set_data_full(G_OBJECT(list), GSETTINGS_KEY, g_strdup(key), g_free);
 
+  /* cursor thumbnails come with the theme info, the others are rendered as
+   * their rows scroll into view */
+  if (type != THEME_TYPE_CURSOR)
+    theme_view_watch_visible_range(list, (GSourceFunc)list_thumbnails_update,
+                                   list);
+
   /* select in treeview the theme set in gsettings */
   GtkTreeModel *treemodel;
   treemodel = gtk_tree_view_get_model(GTK_TREE_VIEW(list));
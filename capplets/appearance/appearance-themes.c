@@ -36,6 +36,9 @@
 #include "theme-util.h"
 
 #define CUSTOM_THEME_NAME "__custom__"
+#define THUMBNAIL_REQUESTS "THUMBNAIL_REQUESTS"
+/* items around the visible ones whose thumbnails are rendered ahead */
+#define THUMBNAIL_PREFETCH 12
 
 enum {
   RESPONSE_APPLY_BG,
@@ -129,22 +132,95 @@ static GdkPixbuf *theme_get_thumbnail_from_cache(MateThemeMetaInfo *info,
   return thumb;
 }
 
+/* Maps a theme name to its outstanding factory request, or to NULL once the
+ * thumbnail is shown; themes not in here get one when they scroll into view. */
+static GHashTable *theme_thumbnail_requests(AppearanceData *data) {
+  return g_object_get_data(
+      G_OBJECT(appearance_capplet_get_widget(data, "theme_list")),
+      THUMBNAIL_REQUESTS);
+}
+
+static void theme_thumbnail_cancel_request(const gchar *theme_name,
+                                           AppearanceData *data) {
+  GHashTable *requests = theme_thumbnail_requests(data);
+  gpointer id = g_hash_table_lookup(requests, theme_name);
+
+  if (id != NULL) theme_thumbnail_cancel(GPOINTER_TO_UINT(id));
+
+  g_hash_table_remove(requests, theme_name);
+}
+
 static void theme_thumbnail_done_cb(GdkPixbuf *pixbuf, gchar *theme_name,
                                     AppearanceData *data) {
+  g_hash_table_replace(theme_thumbnail_requests(data), g_strdup(theme_name),
+                       NULL);
   theme_thumbnail_update(pixbuf, theme_name, data, TRUE);
 }
 
 static void theme_thumbnail_generate(MateThemeMetaInfo *info,
                                      AppearanceData *data) {
+  GHashTable *requests = theme_thumbnail_requests(data);
   GdkPixbuf *thumb = theme_get_thumbnail_from_cache(info, data);
 
+  /* whatever is still rendering for this theme is out of date now */
+  theme_thumbnail_cancel_request(info->name, data);
+
   if (thumb != NULL) {
     theme_thumbnail_update(thumb, info->name, data, FALSE);
     g_object_unref(thumb);
+    g_hash_table_insert(requests, g_strdup(info->name), NULL);
   } else {
-    generate_meta_theme_thumbnail_async(
+    guint id = generate_meta_theme_thumbnail_async(
         info, (ThemeThumbnailFunc)theme_thumbnail_done_cb, data, NULL);
+
+    if (id != 0)
+      g_hash_table_insert(requests, g_strdup(info->name), GUINT_TO_POINTER(id));
+    else if (!g_hash_table_contains(requests, info->name))
+      g_hash_table_insert(requests, g_strdup(info->name), NULL);
+  }
+}
+
+static gboolean theme_thumbnails_update(AppearanceData *data) {
+  GtkWidget *icon_view = appearance_capplet_get_widget(data, "theme_list");
+  GHashTable *requests = theme_thumbnail_requests(data);
+  GHashTable *wanted;
+  GHashTableIter iter;
+  GPtrArray *names;
+  gpointer name, id;
+  guint i;
+
+  names = theme_view_get_visible_names(icon_view, THUMBNAIL_PREFETCH);
+  wanted = g_hash_table_new(g_str_hash, g_str_equal);
+  for (i = 0; i < names->len; i++)
+    g_hash_table_add(wanted, g_ptr_array_index(names, i));
+
+  /* items scrolled out of reach don't need their thumbnail any more */
+  g_hash_table_iter_init(&iter, requests);
+  while (g_hash_table_iter_next(&iter, &name, &id)) {
+    if (id != NULL && !g_hash_table_contains(wanted, name)) {
+      theme_thumbnail_cancel(GPOINTER_TO_UINT(id));
+      g_hash_table_iter_remove(&iter);
+    }
+  }
+
+  for (i = 0; i < names->len; i++) {
+    MateThemeMetaInfo *info;
+
+    name = g_ptr_array_index(names, i);
+    if (g_hash_table_contains(requests, name)) continue;
+
+    if (!strcmp(name, CUSTOM_THEME_NAME))
+      info = data->theme_custom;
+    else
+      info = mate_theme_meta_info_find(name);
+
+    if (info != NULL) theme_thumbnail_generate(info, data);
   }
+
+  g_hash_table_destroy(wanted);
+  g_ptr_array_unref(names);
+
+  return FALSE;
 }
 
 static void theme_changed_on_disk_cb(MateThemeCommonInfo *theme,
@@ -158,16 +234,21 @@ static void theme_changed_on_disk_cb(MateThemeCommonInfo *theme,
       gtk_list_store_insert_with_values(
           data->theme_store, NULL, 0, COL_LABEL, meta->readable_name, COL_NAME,
           meta->name, COL_THUMBNAIL, data->theme_icon, -1);
-      theme_thumbnail_generate(meta, data);
+      theme_view_visible_range_changed(
+          appearance_capplet_get_widget(data, "theme_list"));
     } else if (change_type == MATE_THEME_CHANGE_DELETED) {
       GtkTreeIter iter;
 
+      theme_thumbnail_cancel_request(meta->name, data);
+
       if (theme_find_in_model(GTK_TREE_MODEL(data->theme_store), meta->name,
                               &iter)) {
         gtk_list_store_remove(data->theme_store, &iter);
       }
     } else if (change_type == MATE_THEME_CHANGE_CHANGED) {
-      theme_thumbnail_generate(meta, data);
+      theme_thumbnail_cancel_request(meta->name, data);
+      theme_view_visible_range_changed(
+          appearance_capplet_get_widget(data, "theme_list"));
     }
   }
 }
@@ -812,6 +893,8 @@ static void theme_delete_cb(GtkWidget *button, AppearanceData *data) {
       /* remove theme from the model, too */
       GtkTreeIter child;
 
+      theme_thumbnail_cancel_request(name, data);
+
       if (gtk_tree_model_iter_next(model, &iter) ||
           theme_model_iter_last(model, &iter))
         theme_select_iter(icon_view, &iter);
@@ -875,10 +958,6 @@ static void theme_gsettings_changed(GSettings *settings, gchar *key,
   theme_details_changed_cb(data);
 }
 
-static gint theme_list_sort_func(MateThemeMetaInfo *a, MateThemeMetaInfo *b) {
-  return strcmp(a->readable_name, b->readable_name);
-}
-
 static gint theme_store_sort_func(GtkTreeModel *model, GtkTreeIter *a,
                                   GtkTreeIter *b, gpointer user_data) {
   gchar *a_name, *a_label;
@@ -971,6 +1050,12 @@ void themes_init(AppearanceData *data) {
   data->theme_store = theme_store = gtk_list_store_new(
       NUM_COLS, GDK_TYPE_PIXBUF, G_TYPE_STRING, G_TYPE_STRING);
 
+  icon_view = GTK_ICON_VIEW(appearance_capplet_get_widget(data, "theme_list"));
+  g_object_set_data_full(
+      G_OBJECT(icon_view), THUMBNAIL_REQUESTS,
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL),
+      (GDestroyNotify)g_hash_table_destroy);
+
   /* set up theme list */
   theme_list = mate_theme_meta_info_find_all();
   mate_theme_info_register_theme_change(
@@ -998,17 +1083,10 @@ void themes_init(AppearanceData *data) {
     gtk_list_store_insert_with_values(
         theme_store, NULL, 0, COL_LABEL, meta_theme->readable_name, COL_NAME,
         meta_theme->name, COL_THUMBNAIL, data->theme_icon, -1);
-
-    theme_thumbnail_generate(meta_theme, data);
   }
 
-  theme_list = g_list_sort(theme_list, (GCompareFunc)theme_list_sort_func);
-
-  g_list_foreach(theme_list, (GFunc)theme_thumbnail_generate, data);
   g_list_free(theme_list);
 
-  icon_view = GTK_ICON_VIEW(appearance_capplet_get_widget(data, "theme_list"));
-
   renderer = gtk_cell_renderer_pixbuf_new();
   g_object_set(renderer, "xpad", 5, "ypad", 5, "xalign", 0.5, "yalign", 1.0,
                NULL);
@@ -1034,6 +1112,10 @@ void themes_init(AppearanceData *data) {
                                        GTK_SORT_ASCENDING);
   gtk_icon_view_set_model(icon_view, GTK_TREE_MODEL(sort_model));
 
+  /* render thumbnails only for what's on screen, or about to be */
+  theme_view_watch_visible_range(GTK_WIDGET(icon_view),
+                                 (GSourceFunc)theme_thumbnails_update, data);
+
   g_signal_connect(icon_view, "selection-changed",
                    (GCallback)theme_selection_changed_cb, data);
   g_signal_connect_after(icon_view, "realize", (GCallback)theme_select_name,
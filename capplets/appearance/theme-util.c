@@ -213,6 +213,115 @@ gboolean packagekit_available(void) {
   return available;
 }
 
+static gboolean view_get_visible_range(GtkWidget *view, GtkTreePath **start,
+                                       GtkTreePath **end) {
+  if (!gtk_widget_get_mapped(view)) return FALSE;
+
+  if (GTK_IS_ICON_VIEW(view))
+    return gtk_icon_view_get_visible_range(GTK_ICON_VIEW(view), start, end);
+
+  return gtk_tree_view_get_visible_range(GTK_TREE_VIEW(view), start, end);
+}
+
+static GtkTreeModel *view_get_model(GtkWidget *view) {
+  if (GTK_IS_ICON_VIEW(view))
+    return gtk_icon_view_get_model(GTK_ICON_VIEW(view));
+
+  return gtk_tree_view_get_model(GTK_TREE_VIEW(view));
+}
+
+static void append_name_at(GPtrArray *names, GtkTreeModel *model, gint row) {
+  GtkTreeIter iter;
+  gchar *name = NULL;
+
+  if (!gtk_tree_model_iter_nth_child(model, &iter, NULL, row)) return;
+
+  gtk_tree_model_get(model, &iter, COL_NAME, &name, -1);
+  if (name != NULL) g_ptr_array_add(names, name);
+}
+
+GPtrArray *theme_view_get_visible_names(GtkWidget *view, gint margin) {
+  GPtrArray *names = g_ptr_array_new_with_free_func(g_free);
+  GtkTreePath *start_path, *end_path;
+  GtkTreeModel *model;
+  gint start, end, n_rows, i;
+
+  if (!view_get_visible_range(view, &start_path, &end_path)) return names;
+
+  model = view_get_model(view);
+  n_rows = gtk_tree_model_iter_n_children(model, NULL);
+  start = gtk_tree_path_get_indices(start_path)[0];
+  end = gtk_tree_path_get_indices(end_path)[0];
+  gtk_tree_path_free(start_path);
+  gtk_tree_path_free(end_path);
+
+  for (i = start; i <= end; i++) append_name_at(names, model, i);
+
+  /* most people scroll down, so prefetch below first */
+  for (i = end + 1; i <= end + margin && i < n_rows; i++)
+    append_name_at(names, model, i);
+  for (i = start - 1; i >= start - margin && i >= 0; i--)
+    append_name_at(names, model, i);
+
+  return names;
+}
+
+typedef struct {
+  GtkWidget *view;
+  GSourceFunc func;
+  gpointer data;
+  guint idle_id;
+} VisibleRangeWatch;
+
+#define VISIBLE_RANGE_WATCH "VISIBLE_RANGE_WATCH"
+
+static gboolean visible_range_idle(VisibleRangeWatch *watch) {
+  watch->idle_id = 0;
+  watch->func(watch->data);
+
+  return FALSE;
+}
+
+static void visible_range_watch_free(VisibleRangeWatch *watch) {
+  if (watch->idle_id) g_source_remove(watch->idle_id);
+  g_free(watch);
+}
+
+void theme_view_visible_range_changed(GtkWidget *view) {
+  VisibleRangeWatch *watch =
+      g_object_get_data(G_OBJECT(view), VISIBLE_RANGE_WATCH);
+
+  if (watch != NULL && watch->idle_id == 0)
+    watch->idle_id =
+        g_idle_add_full(G_PRIORITY_LOW, (GSourceFunc)visible_range_idle,
+                        watch, NULL);
+}
+
+void theme_view_watch_visible_range(GtkWidget *view, GSourceFunc func,
+                                    gpointer data) {
+  VisibleRangeWatch *watch;
+  GtkAdjustment *adjustment;
+
+  watch = g_new0(VisibleRangeWatch, 1);
+  watch->view = view;
+  watch->func = func;
+  watch->data = data;
+  g_object_set_data_full(G_OBJECT(view), VISIBLE_RANGE_WATCH, watch,
+                         (GDestroyNotify)visible_range_watch_free);
+
+  adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(view));
+  g_signal_connect_object(adjustment, "value-changed",
+                          G_CALLBACK(theme_view_visible_range_changed), view,
+                          G_CONNECT_SWAPPED);
+  g_signal_connect_object(adjustment, "changed",
+                          G_CALLBACK(theme_view_visible_range_changed), view,
+                          G_CONNECT_SWAPPED);
+  g_signal_connect(view, "map", G_CALLBACK(theme_view_visible_range_changed),
+                   NULL);
+
+  theme_view_visible_range_changed(view);
+}
+
 void theme_install_file(GtkWindow *parent, const gchar *path) {
   GDBusConnection *connection;
   GDBusProxy *proxy;
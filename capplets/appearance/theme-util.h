@@ -41,6 +41,15 @@ gboolean theme_model_iter_last(GtkTreeModel* model, GtkTreeIter* iter);
 gboolean theme_find_in_model(GtkTreeModel* model, const gchar* name,
                              GtkTreeIter* iter);
 
+/* Names of the rows currently shown by a GtkTreeView or GtkIconView, followed
+ * by up to @margin rows below and above them. */
+GPtrArray* theme_view_get_visible_names(GtkWidget* view, gint margin);
+/* Calls @func from an idle whenever the visible rows of @view may have
+ * changed; theme_view_visible_range_changed() triggers it by hand. */
+void theme_view_watch_visible_range(GtkWidget* view, GSourceFunc func,
+                                    gpointer data);
+void theme_view_visible_range_changed(GtkWidget* view);
+
 void theme_install_file(GtkWindow* parent, const gchar* path);
 gboolean packagekit_available(void);
 
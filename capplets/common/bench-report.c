@@ -0,0 +1,46 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "bench-report.h"
+
+static gint compare_doubles(gconstpointer a, gconstpointer b) {
+  gdouble x = *(const gdouble *)a, y = *(const gdouble *)b;
+
+  return (x > y) - (x < y);
+}
+
+static gdouble percentile(GArray *sorted, gdouble p) {
+  guint rank;
+
+  if (sorted->len == 0) return 0;
+
+  rank = (guint)(p / 100.0 * sorted->len + 0.5);
+  rank = CLAMP(rank, 1, sorted->len);
+
+  return g_array_index(sorted, gdouble, rank - 1);
+}
+
+void bench_report_begin(GString *out, const gchar *name, const gchar *unit,
+                        GArray *samples) {
+  gdouble sum = 0;
+  guint i;
+
+  g_array_sort(samples, compare_doubles);
+  for (i = 0; i < samples->len; i++)
+    sum += g_array_index(samples, gdouble, i);
+
+  if (out->str[out->len - 1] != '[') g_string_append(out, ",");
+
+  g_string_append_printf(
+      out,
+      "\n    {\"name\": \"%s\", \"unit\": \"%s\", \"samples\": %u, "
+      "\"min\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, "
+      "\"max\": %.3f, \"mean\": %.3f",
+      name, unit, samples->len,
+      samples->len ? g_array_index(samples, gdouble, 0) : 0,
+      percentile(samples, 50), percentile(samples, 90),
+      percentile(samples, 99),
+      samples->len ? g_array_index(samples, gdouble, samples->len - 1) : 0,
+      samples->len ? sum / samples->len : 0);
+}
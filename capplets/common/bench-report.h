@@ -0,0 +1,15 @@
+#ifndef __BENCH_REPORT_H__
+#define __BENCH_REPORT_H__
+
+#include <glib.h>
+
+/* Results of the benchmarks, printed as JSON. */
+
+/* Appends the object of one result to the "results" array being written to
+ * @out: @name, and the spread of @samples, which gets sorted, in @unit.  The
+ * object is left open for the caller to add its own fields and close with
+ * "}". */
+void bench_report_begin(GString *out, const gchar *name, const gchar *unit,
+                        GArray *samples);
+
+#endif /* __BENCH_REPORT_H__ */
@@ -61,6 +61,13 @@ void mate_meta_theme_set(MateThemeMetaInfo *meta_theme_info) {
     notification_settings = g_settings_new(NOTIFICATION_SCHEMA);
   }
 
+  /* Gather all the changes and write them together at the end, so that
+   * the session re-themes once instead of once for every key */
+  g_settings_delay(interface_settings);
+  g_settings_delay(marco_settings);
+  g_settings_delay(mouse_settings);
+  if (notification_settings != NULL) g_settings_delay(notification_settings);
+
   /* Set the gtk+ key */
   old_key = g_settings_get_string(interface_settings, GTK_THEME_KEY);
   if (compare(old_key, meta_theme_info->gtk_theme_name)) {
@@ -128,6 +135,13 @@ void mate_meta_theme_set(MateThemeMetaInfo *meta_theme_info) {
   }
 
   g_free(old_key);
+
+  /* the interface keys last, they make every application re-theme */
+  if (notification_settings != NULL) g_settings_apply(notification_settings);
+  g_settings_apply(mouse_settings);
+  g_settings_apply(marco_settings);
+  g_settings_apply(interface_settings);
+
   g_object_unref(interface_settings);
   g_object_unref(marco_settings);
   g_object_unref(mouse_settings);
@@ -0,0 +1,546 @@
+/* mate-theme-bench.c - Times theme discovery and thumbnailing
+ *
+ * Builds a synthetic tree of gtk, icon and cursor themes in a temporary
+ * directory, points the XDG directories at it and measures
+ *
+ *   discovery-cold     mate_theme_init() without a theme index
+ *   discovery-warm     mate_theme_init() with an up to date theme index
+ *   discovery-touched  mate_theme_init() after one theme changed on disk
+ *   discovery-async    mate_theme_init_async() until its callback runs
+ *   discovery-interrupted
+ *                      mate_theme_init() called while mate_theme_init_async()
+ *                      is still scanning
+ *   thumbnail-latency  one gtk theme thumbnail at a time
+ *   thumbnail-batch    all gtk theme thumbnails queued at once
+ *
+ * Every discovery run happens in a fresh process, since mate_theme_init()
+ * only runs once per process.  Asynchronous runs check that every meta
+ * theme was announced and that the init callback ran exactly once.
+ * Thumbnails need a display and are skipped without one.  The results are
+ * printed as JSON.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench-report.h"
+#include "mate-theme-info.h"
+#include "theme-thumbnail.h"
+
+static gint n_gtk_themes = 100;
+static gint n_icon_themes = 50;
+static gint n_cursor_themes = 20;
+static gint n_iterations = 10;
+static gint n_thumbnails = 20;
+static gboolean keep_tree = FALSE;
+static gchar *output_file = NULL;
+
+static GOptionEntry entries[] = {
+    {"gtk-themes", 0, 0, G_OPTION_ARG_INT, &n_gtk_themes,
+     "Number of gtk/marco/meta themes to create", "N"},
+    {"icon-themes", 0, 0, G_OPTION_ARG_INT, &n_icon_themes,
+     "Number of icon themes to create", "N"},
+    {"cursor-themes", 0, 0, G_OPTION_ARG_INT, &n_cursor_themes,
+     "Number of cursor themes to create", "N"},
+    {"iterations", 'i', 0, G_OPTION_ARG_INT, &n_iterations,
+     "Number of timed discovery runs", "N"},
+    {"thumbnails", 't', 0, G_OPTION_ARG_INT, &n_thumbnails,
+     "Number of thumbnails to time, 0 to skip", "N"},
+    {"keep", 'k', 0, G_OPTION_ARG_NONE, &keep_tree,
+     "Don't remove the theme tree when done", NULL},
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output_file,
+     "Write the results to FILE instead of stdout", "FILE"},
+    {NULL}};
+
+typedef enum {
+  DISCOVERY_SYNC,
+  DISCOVERY_ASYNC,
+  DISCOVERY_INTERRUPTED
+} DiscoveryMode;
+
+typedef struct {
+  gint64 usec;
+  guint n_meta;
+  guint n_icon;
+  guint n_cursor;
+
+  /* asynchronous runs */
+  guint n_announced; /* meta themes announced as created */
+  guint n_callbacks; /* runs of the init callback */
+} DiscoveryResult;
+
+/* Synthetic theme tree */
+
+static void write_file(const gchar *dir, const gchar *name,
+                       const gchar *contents, gssize length) {
+  gchar *path = g_build_filename(dir, name, NULL);
+  gchar *dirname = g_path_get_dirname(path);
+
+  g_mkdir_with_parents(dirname, 0755);
+  if (!g_file_set_contents(path, contents, length, NULL))
+    g_error("Could not write %s", path);
+
+  g_free(dirname);
+  g_free(path);
+}
+
+static void append_uint(GByteArray *data, guint32 value) {
+  guint8 bytes[4] = {value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff,
+                     (value >> 24) & 0xff};
+
+  g_byte_array_append(data, bytes, sizeof(bytes));
+}
+
+/* An Xcursor file holding a square image for each size */
+static GByteArray *build_cursor(void) {
+  static const guint32 sizes[] = {24, 32, 48};
+  GByteArray *data = g_byte_array_new();
+  guint32 position;
+  guint i, p;
+
+  append_uint(data, 0x72756358); /* "Xcur" */
+  append_uint(data, 16);
+  append_uint(data, 0x10000);
+  append_uint(data, G_N_ELEMENTS(sizes));
+
+  position = 16 + 12 * G_N_ELEMENTS(sizes);
+  for (i = 0; i < G_N_ELEMENTS(sizes); i++) {
+    append_uint(data, 0xfffd0002);
+    append_uint(data, sizes[i]);
+    append_uint(data, position);
+    position += 36 + sizes[i] * sizes[i] * 4;
+  }
+
+  for (i = 0; i < G_N_ELEMENTS(sizes); i++) {
+    append_uint(data, 36);
+    append_uint(data, 0xfffd0002);
+    append_uint(data, sizes[i]);
+    append_uint(data, 1);
+    append_uint(data, sizes[i]);
+    append_uint(data, sizes[i]);
+    append_uint(data, 0);
+    append_uint(data, 0);
+    append_uint(data, 0);
+    for (p = 0; p < sizes[i] * sizes[i]; p++) append_uint(data, 0xff000000);
+  }
+
+  return data;
+}
+
+static gchar *gtk_theme_dir(const gchar *root, gint i) {
+  gchar *name = g_strdup_printf("Bench-Gtk-%04d", i);
+  gchar *dir = g_build_filename(root, "data", "themes", name, NULL);
+
+  g_free(name);
+  return dir;
+}
+
+static void build_theme_tree(const gchar *root) {
+  GByteArray *cursor = build_cursor();
+  gint i;
+
+  for (i = 0; i < n_gtk_themes; i++) {
+    gchar *dir = gtk_theme_dir(root, i);
+    gchar *index;
+
+    index = g_strdup_printf(
+        "[Desktop Entry]\n"
+        "Type=X-GNOME-Metatheme\n"
+        "Name=Bench %04d\n"
+        "Encoding=UTF-8\n\n"
+        "[X-GNOME-Metatheme]\n"
+        "Name=Bench %04d\n"
+        "Comment=Synthetic theme\n"
+        "GtkTheme=Bench-Gtk-%04d\n"
+        "MetacityTheme=Bench-Gtk-%04d\n"
+        "IconTheme=Bench-Icon-%04d\n"
+        "CursorTheme=Bench-Cursor-%04d\n",
+        i, i, i, i, n_icon_themes ? i % n_icon_themes : 0,
+        n_cursor_themes ? i % n_cursor_themes : 0);
+    write_file(dir, "index.theme", index, -1);
+    write_file(dir, "gtk-2.0/gtkrc",
+               "gtk-color-scheme = \"fg_color:#000000\\nbg_color:#ededed\"\n"
+               "style \"default\" { bg[NORMAL] = @bg_color }\n"
+               "class \"GtkWidget\" style \"default\"\n",
+               -1);
+    write_file(dir, "metacity-1/metacity-theme-1.xml", "<metacity_theme/>\n",
+               -1);
+
+    g_free(index);
+    g_free(dir);
+  }
+
+  for (i = 0; i < n_icon_themes; i++) {
+    gchar *name = g_strdup_printf("Bench-Icon-%04d", i);
+    gchar *dir = g_build_filename(root, "data", "icons", name, NULL);
+    gchar *index;
+
+    index = g_strdup_printf(
+        "[Icon Theme]\n"
+        "Name=Bench Icons %04d\n"
+        "Directories=48x48/apps\n\n"
+        "[48x48/apps]\n"
+        "Size=48\n",
+        i);
+    write_file(dir, "index.theme", index, -1);
+
+    g_free(index);
+    g_free(dir);
+    g_free(name);
+  }
+
+  for (i = 0; i < n_cursor_themes; i++) {
+    gchar *name = g_strdup_printf("Bench-Cursor-%04d", i);
+    gchar *dir = g_build_filename(root, "data", "icons", name, NULL);
+    gchar *index;
+
+    index = g_strdup_printf("[Icon Theme]\nName=Bench Cursors %04d\n", i);
+    write_file(dir, "index.theme", index, -1);
+    write_file(dir, "cursors/left_ptr", (const gchar *)cursor->data,
+               cursor->len);
+
+    g_free(index);
+    g_free(dir);
+    g_free(name);
+  }
+
+  g_byte_array_unref(cursor);
+}
+
+static void remove_tree(const gchar *path) {
+  GDir *dir = g_dir_open(path, 0, NULL);
+
+  if (dir != NULL) {
+    const gchar *name;
+
+    while ((name = g_dir_read_name(dir)) != NULL) {
+      gchar *child = g_build_filename(path, name, NULL);
+
+      if (g_file_test(child, G_FILE_TEST_IS_DIR) &&
+          !g_file_test(child, G_FILE_TEST_IS_SYMLINK))
+        remove_tree(child);
+      else
+        g_unlink(child);
+
+      g_free(child);
+    }
+    g_dir_close(dir);
+  }
+
+  g_rmdir(path);
+}
+
+/* Discovery */
+
+static void theme_changed(MateThemeCommonInfo *theme,
+                          MateThemeChangeType change_type,
+                          MateThemeElement element_type,
+                          DiscoveryResult *result) {
+  if (theme->type == MATE_THEME_TYPE_METATHEME &&
+      change_type == MATE_THEME_CHANGE_CREATED)
+    result->n_announced++;
+}
+
+static void init_done(DiscoveryResult *result) { result->n_callbacks++; }
+
+static void discover_async(DiscoveryMode mode, DiscoveryResult *result) {
+  mate_theme_info_register_theme_change((ThemeChangedCallback)theme_changed,
+                                        result);
+  mate_theme_init_async((MateThemeInitCallback)init_done, result);
+
+  /* let the idles add some of the themes before taking over */
+  while (result->n_callbacks == 0 &&
+         (mode == DISCOVERY_ASYNC || result->n_announced == 0))
+    g_main_context_iteration(NULL, TRUE);
+
+  if (mode == DISCOVERY_INTERRUPTED) {
+    mate_theme_init();
+
+    /* idles left behind by the scan must not run the callback again */
+    while (g_main_context_iteration(NULL, FALSE))
+      ;
+  }
+}
+
+static gboolean run_discovery(DiscoveryMode mode, DiscoveryResult *result) {
+  int fds[2];
+  pid_t pid;
+  gssize n;
+  int status;
+
+  if (pipe(fds) != 0) return FALSE;
+
+  pid = fork();
+  if (pid < 0) return FALSE;
+
+  if (pid == 0) {
+    DiscoveryResult child = {0};
+    GList *list;
+    gint64 start;
+
+    close(fds[0]);
+
+    start = g_get_monotonic_time();
+    if (mode == DISCOVERY_SYNC)
+      mate_theme_init();
+    else
+      discover_async(mode, &child);
+    child.usec = g_get_monotonic_time() - start;
+
+    list = mate_theme_meta_info_find_all();
+    child.n_meta = g_list_length(list);
+    g_list_free(list);
+    list = mate_theme_icon_info_find_all();
+    child.n_icon = g_list_length(list);
+    g_list_free(list);
+    list = mate_theme_cursor_info_find_all();
+    child.n_cursor = g_list_length(list);
+    g_list_free(list);
+
+    n = write(fds[1], &child, sizeof(child));
+    _exit(n == sizeof(child) ? 0 : 1);
+  }
+
+  close(fds[1]);
+  n = read(fds[0], result, sizeof(*result));
+  close(fds[0]);
+  waitpid(pid, &status, 0);
+
+  return n == sizeof(*result) && WIFEXITED(status) &&
+         WEXITSTATUS(status) == 0;
+}
+
+static void touch_theme(const gchar *root, gint i) {
+  gchar *dir = gtk_theme_dir(root, i);
+  gchar *index = g_build_filename(dir, "index.theme", NULL);
+  gchar *contents;
+
+  /* a changed size is noticed even within the mtime granularity */
+  if (g_file_get_contents(index, &contents, NULL, NULL)) {
+    gchar *touched = g_strconcat(contents, "\n", NULL);
+
+    g_file_set_contents(index, touched, -1, NULL);
+    g_free(touched);
+    g_free(contents);
+  }
+
+  g_free(index);
+  g_free(dir);
+}
+
+/* Results */
+
+/* Appends the statistics of @samples, in milliseconds */
+static void report(GString *out, const gchar *name, GArray *samples,
+                   gdouble wall_ms) {
+  bench_report_begin(out, name, "ms", samples);
+
+  if (wall_ms > 0)
+    g_string_append_printf(out, ", \"per_second\": %.3f",
+                           samples->len * 1000.0 / wall_ms);
+
+  g_string_append(out, "}");
+}
+
+static void bench_discovery(GString *out, const gchar *name,
+                            const gchar *index_path, const gchar *root) {
+  GArray *samples = g_array_new(FALSE, FALSE, sizeof(gdouble));
+  gboolean cold = g_str_equal(name, "discovery-cold");
+  gboolean touch = g_str_equal(name, "discovery-touched");
+  DiscoveryMode mode = DISCOVERY_SYNC;
+  DiscoveryResult result = {0};
+  gint i;
+
+  if (g_str_equal(name, "discovery-async"))
+    mode = DISCOVERY_ASYNC;
+  else if (g_str_equal(name, "discovery-interrupted"))
+    mode = DISCOVERY_INTERRUPTED;
+
+  /* warm the index up for the other runs */
+  if (!cold && !run_discovery(DISCOVERY_SYNC, &result))
+    g_error("Theme discovery failed");
+
+  for (i = 0; i < n_iterations; i++) {
+    gdouble ms;
+
+    if (cold) g_unlink(index_path);
+    if (touch && n_gtk_themes > 0) touch_theme(root, i % n_gtk_themes);
+
+    if (!run_discovery(mode, &result)) g_error("Theme discovery failed");
+
+    ms = result.usec / 1000.0;
+    g_array_append_val(samples, ms);
+
+    if (mode != DISCOVERY_SYNC &&
+        (result.n_callbacks != 1 || result.n_announced != result.n_meta))
+      g_warning("%s: %u of %u meta themes announced, callback ran %u times",
+                name, result.n_announced, result.n_meta, result.n_callbacks);
+  }
+
+  if (result.n_meta != (guint)n_gtk_themes)
+    g_warning("%s: found %u meta themes, expected %d", name, result.n_meta,
+              n_gtk_themes);
+
+  report(out, name, samples, 0);
+  g_array_unref(samples);
+}
+
+/* Thumbnails */
+
+typedef struct {
+  GMainLoop *loop;
+  gint64 start;
+  GArray *samples;
+  gint pending;
+} ThumbnailRun;
+
+static void thumbnail_done(GdkPixbuf *pixbuf, gchar *theme_name,
+                           ThumbnailRun *run) {
+  gdouble ms = (g_get_monotonic_time() - run->start) / 1000.0;
+
+  if (pixbuf == NULL) g_warning("No thumbnail for %s", theme_name);
+
+  g_array_append_val(run->samples, ms);
+
+  if (--run->pending == 0) g_main_loop_quit(run->loop);
+}
+
+static MateThemeInfo *bench_gtk_theme(gint i) {
+  gchar *name = g_strdup_printf("Bench-Gtk-%04d", i);
+  MateThemeInfo *info = mate_theme_info_find(name);
+
+  if (info == NULL) g_error("Theme %s was not found", name);
+
+  g_free(name);
+  return info;
+}
+
+static void bench_thumbnails(GString *out) {
+  ThumbnailRun run;
+  gint64 start;
+  gint i;
+
+  run.loop = g_main_loop_new(NULL, FALSE);
+
+  /* one at a time, for the latency of a single request */
+  run.samples = g_array_new(FALSE, FALSE, sizeof(gdouble));
+  for (i = 0; i < n_thumbnails; i++) {
+    run.pending = 1;
+    run.start = g_get_monotonic_time();
+    if (generate_gtk_theme_thumbnail_async(
+            bench_gtk_theme(i), (ThemeThumbnailFunc)thumbnail_done, &run,
+            NULL) != 0)
+      g_main_loop_run(run.loop);
+  }
+  report(out, "thumbnail-latency", run.samples, 0);
+  g_array_unref(run.samples);
+
+  /* all at once, for the throughput of the worker pool; these are other
+   * themes, so nothing comes from the thumbnail cache */
+  run.samples = g_array_new(FALSE, FALSE, sizeof(gdouble));
+  run.pending = 0;
+  run.start = start = g_get_monotonic_time();
+  for (i = n_thumbnails; i < 2 * n_thumbnails; i++) {
+    run.pending++;
+    generate_gtk_theme_thumbnail_async(bench_gtk_theme(i),
+                                       (ThemeThumbnailFunc)thumbnail_done,
+                                       &run, NULL);
+  }
+  if (run.pending > 0) g_main_loop_run(run.loop);
+  report(out, "thumbnail-batch", run.samples,
+         (g_get_monotonic_time() - start) / 1000.0);
+  g_array_unref(run.samples);
+
+  g_main_loop_unref(run.loop);
+}
+
+int main(int argc, char *argv[]) {
+  GOptionContext *context;
+  GError *error = NULL;
+  gchar *root, *path, *index_path;
+  gboolean thumbnails;
+  GString *out;
+
+  context = g_option_context_new("- time theme discovery and thumbnailing");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free(context);
+
+  n_gtk_themes = MAX(n_gtk_themes, 0);
+  n_thumbnails = CLAMP(n_thumbnails, 0, n_gtk_themes / 2);
+  thumbnails = n_thumbnails > 0 &&
+               (g_getenv("DISPLAY") != NULL || g_getenv("WAYLAND_DISPLAY"));
+
+  root = g_dir_make_tmp("mate-theme-bench-XXXXXX", &error);
+  if (root == NULL) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  /* GLib caches these on first use, so set them up before anything else */
+  path = g_build_filename(root, "home", NULL);
+  g_setenv("HOME", path, TRUE);
+  g_free(path);
+  path = g_build_filename(root, "data", NULL);
+  g_setenv("XDG_DATA_DIRS", path, TRUE);
+  g_free(path);
+  path = g_build_filename(root, "cache", NULL);
+  g_setenv("XDG_CACHE_HOME", path, TRUE);
+  index_path = g_build_filename(path, "mate-control-center", "theme-index",
+                                NULL);
+  g_free(path);
+
+  build_theme_tree(root);
+
+  /* the factory forks its workers, which must happen before gtk_init() */
+  if (thumbnails) theme_thumbnail_factory_init(argc, argv);
+
+  out = g_string_new(NULL);
+  g_string_append_printf(out,
+                         "{\n  \"gtk_themes\": %d,\n  \"icon_themes\": %d,\n"
+                         "  \"cursor_themes\": %d,\n  \"results\": [",
+                         n_gtk_themes, n_icon_themes, n_cursor_themes);
+
+  bench_discovery(out, "discovery-cold", index_path, root);
+  bench_discovery(out, "discovery-warm", index_path, root);
+  bench_discovery(out, "discovery-touched", index_path, root);
+  bench_discovery(out, "discovery-async", index_path, root);
+  bench_discovery(out, "discovery-interrupted", index_path, root);
+
+  if (thumbnails) {
+    gtk_init(&argc, &argv);
+    mate_theme_init();
+    bench_thumbnails(out);
+  }
+
+  g_string_append_printf(out, "\n  ],\n  \"thumbnails_skipped\": %s\n}\n",
+                         thumbnails ? "false" : "true");
+
+  if (output_file != NULL) {
+    if (!g_file_set_contents(output_file, out->str, out->len, &error)) {
+      g_printerr("%s\n", error->message);
+      g_clear_error(&error);
+    }
+  } else {
+    fputs(out->str, stdout);
+  }
+
+  if (!keep_tree) remove_tree(root);
+
+  g_string_free(out, TRUE);
+  g_free(index_path);
+  g_free(root);
+
+  return 0;
+}
@@ -31,13 +31,16 @@
 #include <gio/gio.h>
 #include <glib.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <gmodule.h>
 #include <gtk/gtk.h>
 #include <libmate-desktop/mate-desktop-item.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "gtkrc-utils.h"
 #include "mate-theme-info.h"
+#include "theme-index.h"
 
 #define THEME_NAME "X-GNOME-Metatheme/Name"
 #define THEME_COMMENT "X-GNOME-Metatheme/Comment"
@@ -56,6 +59,11 @@
 #define BACKGROUND_IMAGE_KEY "X-GNOME-Metatheme/BackgroundImage"
 #define HIDDEN_KEY "X-GNOME-Metatheme/Hidden"
 
+/* The marco theme formats, oldest first */
+static const gchar *const marco_theme_files[] = {
+    "metacity-theme-1.xml", "metacity-theme-2.xml", "metacity-theme-3.xml",
+    NULL};
+
 /* Terminology used in this lib:
  *
  * /usr/share/themes, ~/.themes   -- top_theme_dir
@@ -88,6 +96,43 @@ typedef struct {
   gint priority;
 } CallbackTuple;
 
+typedef struct {
+  MateThemeInitCallback func;
+  gpointer data;
+} InitCallbackData;
+
+typedef enum {
+  SCAN_TOP_DIR,
+  SCAN_THEME_DIR,
+  SCAN_ICON_THEME_DIR
+} ThemeScanKind;
+
+/* A directory to be read by theme discovery, and what was found in it */
+typedef struct {
+  ThemeScanKind kind;
+  GFile *uri;
+  CallbackTuple *tuple;
+  gboolean icon_theme;
+
+  /* where a serial scan would have read it: the index of its top dir, and
+   * 0 for the top dir itself or 1 + the index of the common_theme_dir */
+  guint top;
+  guint child;
+
+  /* top dirs */
+  GPtrArray *children;
+
+  /* common_theme_dirs */
+  MateThemeCommonInfo *meta_info;
+  gboolean has_gtk;
+  gboolean has_keybinding;
+  GFile *marco_uri; /* the newest metacity-theme-N.xml, if any */
+
+  /* common_icon_theme_dirs */
+  MateThemeCommonInfo *icon_info;
+  MateThemeCommonInfo *cursor_info;
+} ThemeDirScan;
+
 /* Hash tables */
 
 /* The hashes_by_dir are indexed by an escaped uri of the common_theme_dir that
@@ -113,6 +158,26 @@ static GHashTable *cursor_theme_hash_by_name;
 static GHashTable *theme_hash_by_uri;
 static GHashTable *theme_hash_by_name;
 static gboolean initting = FALSE;
+static gboolean initted = FALSE;
+static GList *init_callbacks = NULL;
+
+/* Theme discovery state, see theme_discovery_thread() */
+static GThreadPool *discovery_pool = NULL;
+static GAsyncQueue *discovery_results = NULL;
+static gboolean discovery_async = FALSE;
+static gint discovery_pending = 0;
+static gint discovery_wakeup = FALSE;
+
+/* Results are applied in the order a serial scan would have read them, so
+ * that the same copy of a theme found in dirs of equal priority wins every
+ * time.  The ones that come back early wait in discovery_held. */
+static GSequence *discovery_held = NULL;
+static guint discovery_n_tops = 0;
+static guint discovery_next_top = 0;
+static guint discovery_next_child = 0;
+static guint discovery_n_children = 0; /* of the top dir being applied */
+
+static gboolean theme_discovery_idle(gpointer data);
 
 /* private functions */
 static gint safe_strcmp(const gchar *a_str, const gchar *b_str) {
@@ -476,41 +541,205 @@ static GdkPixbuf *gdk_pixbuf_from_xcursor_image(XcursorImage *cursor) {
   return pixbuf;
 }
 
+static GMutex xcursor_lock;
+
+/* The sizes offered in the cursor size slider */
+static const gint cursor_filter_sizes[] = {12, 16, 18, 24, 32, 36,
+                                           40, 48, 64, 96, 128};
+
+typedef struct {
+  guint32 size;
+  guint32 position;
+} XcursorTocEntry;
+
+static gboolean xcursor_read_uint(FILE *file, guint32 *value) {
+  guchar bytes[4];
+
+  if (fread(bytes, 1, sizeof(bytes), file) != sizeof(bytes)) return FALSE;
+
+  /* Xcursor files are little endian */
+  *value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+           ((guint32)bytes[3] << 24);
+
+  return TRUE;
+}
+
+/* Reads the table of contents of an Xcursor file, that is the nominal size
+ * and position of every image in it, without decoding any of them. */
+static GArray *xcursor_file_read_toc(FILE *file) {
+  guint32 magic, header, version, ntoc, i;
+  GArray *toc;
+
+  if (!xcursor_read_uint(file, &magic) || magic != XCURSOR_MAGIC ||
+      !xcursor_read_uint(file, &header) ||
+      !xcursor_read_uint(file, &version) || !xcursor_read_uint(file, &ntoc) ||
+      header < XCURSOR_FILE_HEADER_LEN || ntoc > 0x10000 ||
+      fseek(file, header, SEEK_SET) != 0)
+    return NULL;
+
+  toc = g_array_sized_new(FALSE, FALSE, sizeof(XcursorTocEntry), ntoc);
+
+  for (i = 0; i < ntoc; i++) {
+    guint32 type;
+    XcursorTocEntry entry;
+
+    if (!xcursor_read_uint(file, &type) ||
+        !xcursor_read_uint(file, &entry.size) ||
+        !xcursor_read_uint(file, &entry.position)) {
+      g_array_free(toc, TRUE);
+      return NULL;
+    }
+
+    if (type == XCURSOR_IMAGE_TYPE) g_array_append_val(toc, entry);
+  }
+
+  return toc;
+}
+
+static GdkPixbuf *xcursor_file_read_image(FILE *file, guint32 position) {
+  guint32 header, type, size, version, width, height;
+  guchar *pixels, *it;
+  gsize length;
+
+  if (fseek(file, position, SEEK_SET) != 0 ||
+      !xcursor_read_uint(file, &header) || !xcursor_read_uint(file, &type) ||
+      !xcursor_read_uint(file, &size) || !xcursor_read_uint(file, &version) ||
+      !xcursor_read_uint(file, &width) || !xcursor_read_uint(file, &height) ||
+      type != XCURSOR_IMAGE_TYPE || header < XCURSOR_IMAGE_HEADER_LEN ||
+      width == 0 || width > XCURSOR_IMAGE_MAX_SIZE || height == 0 ||
+      height > XCURSOR_IMAGE_MAX_SIZE ||
+      fseek(file, position + header, SEEK_SET) != 0)
+    return NULL;
+
+  length = (gsize)width * height * 4;
+  pixels = g_malloc(length);
+
+  if (fread(pixels, 1, length, file) != length) {
+    g_free(pixels);
+    return NULL;
+  }
+
+  /* little endian ARGB to RGBA */
+  for (it = pixels; it < pixels + length; it += 4) {
+    guchar b = it[0];
+
+    it[0] = it[2];
+    it[2] = b;
+  }
+
+  return gdk_pixbuf_new_from_data(pixels, GDK_COLORSPACE_RGB, TRUE, 8, width,
+                                  height, width * 4,
+                                  (GdkPixbufDestroyNotify)g_free, NULL);
+}
+
+/* Finds the sizes of a theme's left_ptr cursor from the table of contents of
+ * its file, and decodes just the image used as thumbnail.  Returns FALSE if
+ * the theme has no such file of its own, or one this can't parse. */
+static gboolean read_cursor_file(GFile *cursors_uri, GArray *sizes,
+                                 GdkPixbuf **thumbnail) {
+  guint32 positions[G_N_ELEMENTS(cursor_filter_sizes)];
+  GFile *cursor_uri;
+  gchar *path;
+  FILE *file;
+  GArray *toc;
+  gint thumbnail_size = -1;
+  guint i, j;
+
+  cursor_uri = g_file_get_child(cursors_uri, "left_ptr");
+  path = g_file_get_path(cursor_uri);
+  g_object_unref(cursor_uri);
+
+  file = path ? g_fopen(path, "rb") : NULL;
+  g_free(path);
+  if (file == NULL) return FALSE;
+
+  toc = xcursor_file_read_toc(file);
+  if (toc == NULL) {
+    fclose(file);
+    return FALSE;
+  }
+
+  for (i = 0; i < G_N_ELEMENTS(cursor_filter_sizes); i++) {
+    for (j = 0; j < toc->len; j++) {
+      XcursorTocEntry *entry = &g_array_index(toc, XcursorTocEntry, j);
+
+      if (entry->size == (guint32)cursor_filter_sizes[i]) {
+        g_array_append_val(sizes, cursor_filter_sizes[i]);
+        positions[sizes->len - 1] = entry->position;
+
+        /* prefer anything but the tiniest size for the thumbnail */
+        if (thumbnail_size == -1 && i >= 1) thumbnail_size = sizes->len - 1;
+        break;
+      }
+    }
+  }
+
+  if (sizes->len > 0) {
+    if (thumbnail_size == -1) thumbnail_size = 0;
+    *thumbnail = xcursor_file_read_image(file, positions[thumbnail_size]);
+  }
+
+  g_array_free(toc, TRUE);
+  fclose(file);
+
+  return TRUE;
+}
+
+/* Asks libXcursor, which also follows the themes a theme inherits from */
+static void probe_cursor_library(const gchar *name, GArray *sizes,
+                                 GdkPixbuf **thumbnail) {
+  XcursorImage *cursor;
+  guint i;
+
+  /* libXcursor isn't meant to be used from several threads at once */
+  g_mutex_lock(&xcursor_lock);
+
+  for (i = 0; i < G_N_ELEMENTS(cursor_filter_sizes); ++i) {
+    cursor = XcursorLibraryLoadImage("left_ptr", name, cursor_filter_sizes[i]);
+
+    if (cursor) {
+      if (cursor->size == cursor_filter_sizes[i]) {
+        g_array_append_val(sizes, cursor_filter_sizes[i]);
+
+        if (*thumbnail == NULL && i >= 1)
+          *thumbnail = gdk_pixbuf_from_xcursor_image(cursor);
+      }
+
+      XcursorImageDestroy(cursor);
+    }
+  }
+
+  if (sizes->len > 0 && *thumbnail == NULL) {
+    cursor = XcursorLibraryLoadImage("left_ptr", name,
+                                     g_array_index(sizes, gint, 0));
+    if (cursor) {
+      *thumbnail = gdk_pixbuf_from_xcursor_image(cursor);
+      XcursorImageDestroy(cursor);
+    }
+  }
+
+  g_mutex_unlock(&xcursor_lock);
+}
+
 static MateThemeCursorInfo *read_cursor_theme(GFile *cursor_theme_uri) {
   MateThemeCursorInfo *cursor_theme_info = NULL;
   GFile *parent_uri, *cursors_uri;
 
-  const gint filter_sizes[] = {12, 16, 18, 24, 32, 36, 40, 48, 64, 96, 128};
-  const gint num_sizes = G_N_ELEMENTS(filter_sizes);
-
   parent_uri = g_file_get_parent(cursor_theme_uri);
   cursors_uri = g_file_get_child(parent_uri, "cursors");
 
   if (get_file_type(cursors_uri) == G_FILE_TYPE_DIRECTORY) {
     GArray *sizes;
-    XcursorImage *cursor;
     GdkPixbuf *thumbnail = NULL;
     gchar *name;
-    gint i;
 
     name = g_file_get_basename(parent_uri);
 
-    sizes = g_array_sized_new(FALSE, FALSE, sizeof(gint), num_sizes);
-
-    for (i = 0; i < num_sizes; ++i) {
-      cursor = XcursorLibraryLoadImage("left_ptr", name, filter_sizes[i]);
-
-      if (cursor) {
-        if (cursor->size == filter_sizes[i]) {
-          g_array_append_val(sizes, filter_sizes[i]);
-
-          if (thumbnail == NULL && i >= 1)
-            thumbnail = gdk_pixbuf_from_xcursor_image(cursor);
-        }
+    sizes = g_array_sized_new(FALSE, FALSE, sizeof(gint),
+                              G_N_ELEMENTS(cursor_filter_sizes));
 
-        XcursorImageDestroy(cursor);
-      }
-    }
+    if (!read_cursor_file(cursors_uri, sizes, &thumbnail))
+      probe_cursor_library(name, sizes, &thumbnail);
 
     if (sizes->len == 0) {
       g_array_free(sizes, TRUE);
@@ -519,15 +748,6 @@ static MateThemeCursorInfo *read_cursor_theme(GFile *cursor_theme_uri) {
       MateDesktopItem *cursor_theme_ditem;
       gchar *cursor_theme_file;
 
-      if (!thumbnail) {
-        cursor = XcursorLibraryLoadImage("left_ptr", name,
-                                         g_array_index(sizes, gint, 0));
-        if (cursor) {
-          thumbnail = gdk_pixbuf_from_xcursor_image(cursor);
-          XcursorImageDestroy(cursor);
-        }
-      }
-
       cursor_theme_info = mate_theme_cursor_info_new();
       cursor_theme_info->path = g_file_get_path(parent_uri);
       cursor_theme_info->name = name;
@@ -565,6 +785,42 @@ static MateThemeCursorInfo *read_cursor_theme(GFile *cursor_theme_uri) {
   return cursor_theme_info;
 }
 
+/* Reads the theme behind an index file, unless the persistent index still has
+ * an up to date record of it. */
+static MateThemeCommonInfo *read_indexed_theme(GFile *theme_index_uri,
+                                               MateThemeType type) {
+  MateThemeCommonInfo *theme_info;
+  gchar *index_path;
+
+  /* cursor themes don't necessarily have an index file, so try those in any
+   * case */
+  if (type != MATE_THEME_TYPE_CURSOR &&
+      get_file_type(theme_index_uri) != G_FILE_TYPE_REGULAR)
+    return NULL;
+
+  index_path = g_file_get_path(theme_index_uri);
+  if (index_path != NULL &&
+      theme_index_lookup(type, index_path, &theme_info)) {
+    g_free(index_path);
+    return theme_info;
+  }
+
+  if (type == MATE_THEME_TYPE_ICON)
+    theme_info = (MateThemeCommonInfo *)read_icon_theme(theme_index_uri);
+  else if (type == MATE_THEME_TYPE_CURSOR)
+    theme_info = (MateThemeCommonInfo *)read_cursor_theme(theme_index_uri);
+  else
+    theme_info =
+        (MateThemeCommonInfo *)mate_theme_read_meta_theme(theme_index_uri);
+
+  if (index_path != NULL) {
+    theme_index_store(type, index_path, theme_info);
+    g_free(index_path);
+  }
+
+  return theme_info;
+}
+
 static void handle_change_signal(gpointer data, MateThemeChangeType change_type,
                                  MateThemeElement element_type) {
 #ifdef DEBUG
@@ -616,20 +872,14 @@ static void handle_change_signal(gpointer data, MateThemeChangeType change_type,
 #endif
 }
 
-/* index_uri should point to the gtkrc file that was modified */
-static void update_theme_index(GFile *index_uri, MateThemeElement key_element,
-                               gint priority) {
-  gboolean theme_exists;
+static void apply_theme_index(GFile *index_uri, MateThemeElement key_element,
+                              gint priority, gboolean theme_exists) {
   MateThemeInfo *theme_info;
   GFile *parent;
   GFile *common_theme_dir_uri;
   gchar *common_theme_dir;
 
-  /* First, we determine the new state of the file.  We do no more
-   * sophisticated a test than "files exists and is a file" */
-  theme_exists = (get_file_type(index_uri) == G_FILE_TYPE_REGULAR);
-
-  /* Next, we see what currently exists */
+  /* See what currently exists */
   parent = g_file_get_parent(index_uri);
   common_theme_dir_uri = g_file_get_parent(parent);
   common_theme_dir = g_file_get_path(common_theme_dir_uri);
@@ -693,6 +943,14 @@ static void update_theme_index(GFile *index_uri, MateThemeElement key_element,
   g_object_unref(common_theme_dir_uri);
 }
 
+/* index_uri should point to the gtkrc file that was modified */
+static void update_theme_index(GFile *index_uri, MateThemeElement key_element,
+                               gint priority) {
+  /* We do no more sophisticated a test than "files exists and is a file" */
+  apply_theme_index(index_uri, key_element, priority,
+                    get_file_type(index_uri) == G_FILE_TYPE_REGULAR);
+}
+
 static void update_gtk2_index(GFile *gtk2_index_uri, gint priority) {
   update_theme_index(gtk2_index_uri, MATE_THEME_GTK_2, priority);
 }
@@ -707,10 +965,10 @@ static void update_marco_index(GFile *marco_index_uri, gint priority) {
   update_theme_index(marco_index_uri, MATE_THEME_MARCO, priority);
 }
 
-static void update_common_theme_dir_index(GFile *theme_index_uri,
-                                          MateThemeType type, gint priority) {
+static void apply_common_theme_dir_index(GFile *theme_index_uri,
+                                         MateThemeType type, gint priority,
+                                         MateThemeCommonInfo *theme_info) {
   gboolean theme_exists;
-  MateThemeCommonInfo *theme_info = NULL;
   MateThemeCommonInfo *old_theme_info;
   GFile *common_theme_dir_uri;
   gchar *common_theme_dir;
@@ -728,26 +986,6 @@ static void update_common_theme_dir_index(GFile *theme_index_uri,
     hash_by_name = meta_theme_hash_by_name;
   }
 
-  if (type != MATE_THEME_TYPE_CURSOR) {
-    /* First, we determine the new state of the file. */
-    if (get_file_type(theme_index_uri) == G_FILE_TYPE_REGULAR) {
-      /* It's an interesting file. Let's try to load it. */
-      if (type == MATE_THEME_TYPE_ICON)
-        theme_info = (MateThemeCommonInfo *)read_icon_theme(theme_index_uri);
-      else
-        theme_info =
-            (MateThemeCommonInfo *)mate_theme_read_meta_theme(theme_index_uri);
-    } else {
-      theme_info = NULL;
-    }
-
-  }
-  /* cursor themes don't necessarily have an index file, so try those in any
-     case */
-  else {
-    theme_info = (MateThemeCommonInfo *)read_cursor_theme(theme_index_uri);
-  }
-
   if (theme_info) {
     theme_info->priority = priority;
     theme_exists = TRUE;
@@ -793,6 +1031,15 @@ static void update_common_theme_dir_index(GFile *theme_index_uri,
   }
 
   g_free(common_theme_dir);
+
+  /* keep the persistent index in step with changes seen by the monitors */
+  if (initted) theme_index_save_later();
+}
+
+static void update_common_theme_dir_index(GFile *theme_index_uri,
+                                          MateThemeType type, gint priority) {
+  apply_common_theme_dir_index(theme_index_uri, type, priority,
+                               read_indexed_theme(theme_index_uri, type));
 }
 
 static void update_meta_theme_index(GFile *meta_theme_index_uri,
@@ -851,9 +1098,8 @@ static void marco_dir_changed(GFileMonitor *monitor, GFile *file,
 
   affected_file = g_file_get_basename(file);
 
-  /* The only file we care about is metacity-theme-(1|2).xml */
-  if (!strcmp(affected_file, "metacity-theme-1.xml") ||
-      !strcmp(affected_file, "metacity-theme-2.xml")) {
+  /* The only file we care about is metacity-theme-(1|2|3).xml */
+  if (g_strv_contains(marco_theme_files, affected_file)) {
     update_marco_index(file, monitor_data->priority);
   }
 
@@ -905,96 +1151,128 @@ static void common_icon_theme_dir_changed(
   g_free(affected_file);
 }
 
-/* Add a monitor to a common_theme_dir. */
-static gboolean add_common_theme_dir_monitor(
-    GFile *theme_dir_uri, CommonThemeDirMonitorData *monitor_data,
-    GError **error) {
+/* Reads everything there is to know about a common_theme_dir.  This only
+ * touches the disk, so it may run in a discovery thread. */
+static void scan_common_theme_dir(ThemeDirScan *scan) {
   GFile *uri, *subdir;
-  GFileMonitor *monitor;
+  guint i;
 
-  uri = g_file_get_child(theme_dir_uri, "index.theme");
-  update_meta_theme_index(uri, monitor_data->priority);
+  uri = g_file_get_child(scan->uri, "index.theme");
+  scan->meta_info = read_indexed_theme(uri, MATE_THEME_TYPE_METATHEME);
   g_object_unref(uri);
 
-  /* Add the handle for this directory */
-  monitor = g_file_monitor_file(theme_dir_uri, G_FILE_MONITOR_NONE, NULL, NULL);
-  if (monitor == NULL) return FALSE;
-
-  g_signal_connect(monitor, "changed", (GCallback)common_theme_dir_changed,
-                   monitor_data);
-
-  monitor_data->common_theme_dir_handle = monitor;
-
   /* gtk-2 theme subdir */
-  subdir = g_file_get_child(theme_dir_uri, "gtk-2.0");
-  uri = g_file_get_child(subdir, "gtkrc");
-  if (g_file_query_exists(uri, NULL)) {
-    update_gtk2_index(uri, monitor_data->priority);
-  }
+  uri = g_file_resolve_relative_path(scan->uri, "gtk-2.0/gtkrc");
+  scan->has_gtk = g_file_query_exists(uri, NULL);
   g_object_unref(uri);
 
-  monitor = g_file_monitor_directory(subdir, G_FILE_MONITOR_NONE, NULL, NULL);
-  if (monitor != NULL) {
-    g_signal_connect(monitor, "changed", (GCallback)gtk2_dir_changed,
-                     monitor_data);
+  /* keybinding theme subdir */
+  uri = g_file_resolve_relative_path(scan->uri, "gtk-2.0-key/gtkrc");
+  scan->has_keybinding = g_file_query_exists(uri, NULL);
+  g_object_unref(uri);
+
+  /* marco theme subdir */
+  subdir = g_file_get_child(scan->uri, "metacity-1");
+  for (i = G_N_ELEMENTS(marco_theme_files) - 1;
+       i-- > 0 && scan->marco_uri == NULL;) {
+    uri = g_file_get_child(subdir, marco_theme_files[i]);
+    if (g_file_query_exists(uri, NULL))
+      scan->marco_uri = uri;
+    else
+      g_object_unref(uri);
   }
-  monitor_data->gtk2_dir_handle = monitor;
   g_object_unref(subdir);
+}
 
-  /* keybinding theme subdir */
-  subdir = g_file_get_child(theme_dir_uri, "gtk-2.0-key");
-  uri = g_file_get_child(subdir, "gtkrc");
-  if (g_file_query_exists(uri, NULL)) {
-    update_keybinding_index(uri, monitor_data->priority);
-  }
-  g_object_unref(uri);
+static void scan_common_icon_theme_dir(ThemeDirScan *scan) {
+  GFile *index_uri;
 
+  index_uri = g_file_get_child(scan->uri, "index.theme");
+  scan->icon_info = read_indexed_theme(index_uri, MATE_THEME_TYPE_ICON);
+  scan->cursor_info = read_indexed_theme(index_uri, MATE_THEME_TYPE_CURSOR);
+  g_object_unref(index_uri);
+}
+
+static GFileMonitor *monitor_theme_subdir(GFile *theme_dir_uri,
+                                          const gchar *name,
+                                          GCallback callback,
+                                          CommonThemeDirMonitorData *data) {
+  GFile *subdir;
+  GFileMonitor *monitor;
+
+  subdir = g_file_get_child(theme_dir_uri, name);
   monitor = g_file_monitor_directory(subdir, G_FILE_MONITOR_NONE, NULL, NULL);
-  if (monitor != NULL) {
-    g_signal_connect(monitor, "changed", (GCallback)keybinding_dir_changed,
-                     monitor_data);
-  }
-  monitor_data->keybinding_dir_handle = monitor;
+  if (monitor != NULL) g_signal_connect(monitor, "changed", callback, data);
   g_object_unref(subdir);
 
-  /* marco theme subdir */
-  subdir = g_file_get_child(theme_dir_uri, "metacity-1");
-  uri = g_file_get_child(subdir, "metacity-theme-2.xml");
-  if (g_file_query_exists(uri, NULL)) {
-    update_marco_index(uri, monitor_data->priority);
-  } else {
+  return monitor;
+}
+
+/* Add the themes found by scan_common_theme_dir() and a monitor to a
+ * common_theme_dir. */
+static gboolean add_scanned_common_theme_dir(
+    ThemeDirScan *scan, CommonThemeDirMonitorData *monitor_data) {
+  GFile *uri;
+  GFileMonitor *monitor;
+
+  uri = g_file_get_child(scan->uri, "index.theme");
+  apply_common_theme_dir_index(uri, MATE_THEME_TYPE_METATHEME,
+                               monitor_data->priority, scan->meta_info);
+  scan->meta_info = NULL;
+  g_object_unref(uri);
+
+  /* Add the handle for this directory */
+  monitor = g_file_monitor_file(scan->uri, G_FILE_MONITOR_NONE, NULL, NULL);
+  if (monitor == NULL) return FALSE;
+
+  g_signal_connect(monitor, "changed", (GCallback)common_theme_dir_changed,
+                   monitor_data);
+
+  monitor_data->common_theme_dir_handle = monitor;
+
+  if (scan->has_gtk) {
+    uri = g_file_resolve_relative_path(scan->uri, "gtk-2.0/gtkrc");
+    apply_theme_index(uri, MATE_THEME_GTK_2, monitor_data->priority, TRUE);
     g_object_unref(uri);
-    uri = g_file_get_child(subdir, "metacity-theme-1.xml");
-    if (g_file_query_exists(uri, NULL)) {
-      update_marco_index(uri, monitor_data->priority);
-    }
   }
-  g_object_unref(uri);
+  monitor_data->gtk2_dir_handle = monitor_theme_subdir(
+      scan->uri, "gtk-2.0", (GCallback)gtk2_dir_changed, monitor_data);
 
-  monitor = g_file_monitor_directory(subdir, G_FILE_MONITOR_NONE, NULL, NULL);
-  if (monitor != NULL) {
-    g_signal_connect(monitor, "changed", (GCallback)marco_dir_changed,
-                     monitor_data);
+  if (scan->has_keybinding) {
+    uri = g_file_resolve_relative_path(scan->uri, "gtk-2.0-key/gtkrc");
+    apply_theme_index(uri, MATE_THEME_GTK_2_KEYBINDING, monitor_data->priority,
+                      TRUE);
+    g_object_unref(uri);
   }
-  monitor_data->marco_dir_handle = monitor;
-  g_object_unref(subdir);
+  monitor_data->keybinding_dir_handle =
+      monitor_theme_subdir(scan->uri, "gtk-2.0-key",
+                           (GCallback)keybinding_dir_changed, monitor_data);
+
+  if (scan->marco_uri != NULL)
+    apply_theme_index(scan->marco_uri, MATE_THEME_MARCO,
+                      monitor_data->priority, TRUE);
+  monitor_data->marco_dir_handle = monitor_theme_subdir(
+      scan->uri, "metacity-1", (GCallback)marco_dir_changed, monitor_data);
 
   return TRUE;
 }
 
-static gboolean add_common_icon_theme_dir_monitor(
-    GFile *theme_dir_uri, CommonIconThemeDirMonitorData *monitor_data,
-    GError **error) {
+static gboolean add_scanned_common_icon_theme_dir(
+    ThemeDirScan *scan, CommonIconThemeDirMonitorData *monitor_data) {
   GFile *index_uri;
   GFileMonitor *monitor;
 
-  /* Add the handle for this directory */
-  index_uri = g_file_get_child(theme_dir_uri, "index.theme");
-  update_icon_theme_index(index_uri, monitor_data->priority);
-  update_cursor_theme_index(index_uri, monitor_data->priority);
+  index_uri = g_file_get_child(scan->uri, "index.theme");
+  apply_common_theme_dir_index(index_uri, MATE_THEME_TYPE_ICON,
+                               monitor_data->priority, scan->icon_info);
+  apply_common_theme_dir_index(index_uri, MATE_THEME_TYPE_CURSOR,
+                               monitor_data->priority, scan->cursor_info);
+  scan->icon_info = NULL;
+  scan->cursor_info = NULL;
   g_object_unref(index_uri);
 
-  monitor = g_file_monitor_file(theme_dir_uri, G_FILE_MONITOR_NONE, NULL, NULL);
+  /* Add the handle for this directory */
+  monitor = g_file_monitor_file(scan->uri, G_FILE_MONITOR_NONE, NULL, NULL);
   if (monitor == NULL) return FALSE;
 
   g_signal_connect(monitor, "changed", (GCallback)common_icon_theme_dir_changed,
@@ -1004,6 +1282,56 @@ static gboolean add_common_icon_theme_dir_monitor(
   return TRUE;
 }
 
+static ThemeDirScan *theme_dir_scan_new(ThemeScanKind kind, GFile *uri,
+                                        CallbackTuple *tuple) {
+  ThemeDirScan *scan = g_new0(ThemeDirScan, 1);
+
+  scan->kind = kind;
+  scan->uri = g_object_ref(uri);
+  scan->tuple = tuple;
+
+  return scan;
+}
+
+static void theme_dir_scan_free(ThemeDirScan *scan) {
+  if (scan->meta_info) theme_free(scan->meta_info);
+  if (scan->icon_info) theme_free(scan->icon_info);
+  if (scan->cursor_info) theme_free(scan->cursor_info);
+  if (scan->children) g_ptr_array_unref(scan->children);
+  if (scan->marco_uri) g_object_unref(scan->marco_uri);
+  g_object_unref(scan->uri);
+  g_free(scan);
+}
+
+/* Add a monitor to a common_theme_dir. */
+static gboolean add_common_theme_dir_monitor(
+    GFile *theme_dir_uri, CommonThemeDirMonitorData *monitor_data,
+    GError **error) {
+  ThemeDirScan *scan;
+  gboolean ret;
+
+  scan = theme_dir_scan_new(SCAN_THEME_DIR, theme_dir_uri, NULL);
+  scan_common_theme_dir(scan);
+  ret = add_scanned_common_theme_dir(scan, monitor_data);
+  theme_dir_scan_free(scan);
+
+  return ret;
+}
+
+static gboolean add_common_icon_theme_dir_monitor(
+    GFile *theme_dir_uri, CommonIconThemeDirMonitorData *monitor_data,
+    GError **error) {
+  ThemeDirScan *scan;
+  gboolean ret;
+
+  scan = theme_dir_scan_new(SCAN_ICON_THEME_DIR, theme_dir_uri, NULL);
+  scan_common_icon_theme_dir(scan);
+  ret = add_scanned_common_icon_theme_dir(scan, monitor_data);
+  theme_dir_scan_free(scan);
+
+  return ret;
+}
+
 static void remove_common_theme_dir_monitor(
     CommonThemeDirMonitorData *monitor_data) {
   g_file_monitor_cancel(monitor_data->common_theme_dir_handle);
@@ -1082,18 +1410,16 @@ static void top_icon_theme_dir_changed(GFileMonitor *monitor, GFile *file,
 }
 
 /* Add a monitor to a top dir.  These monitors persist for the duration of the
- * lib.
+ * lib.  The common_theme_dirs inside it are added as theme discovery gets to
+ * them.
  */
-static gboolean real_add_top_theme_dir_monitor(GFile *uri, gint priority,
-                                               gboolean icon_theme,
-                                               GError **error) {
-  GFileInfo *file_info;
+static CallbackTuple *add_top_theme_dir_monitor(GFile *uri, gint priority,
+                                                gboolean icon_theme) {
   GFileMonitor *monitor;
-  GFileEnumerator *enumerator;
   CallbackTuple *tuple;
 
   /* Check the URI */
-  if (get_file_type(uri) != G_FILE_TYPE_DIRECTORY) return FALSE;
+  if (get_file_type(uri) != G_FILE_TYPE_DIRECTORY) return NULL;
 
   /* handle_hash is a hash of common_theme_dir names to their monitor_data.  We
    * use it to remove the monitor handles when a dir is removed.
@@ -1113,59 +1439,311 @@ static gboolean real_add_top_theme_dir_monitor(GFile *uri, gint priority,
   } else {
     g_hash_table_destroy(tuple->handle_hash);
     g_free(tuple);
-    return FALSE;
+    return NULL;
   }
 
-  /* Go through the directory to add monitoring */
+  return tuple;
+}
+
+/* Lists the common_theme_dirs of a top dir */
+static void scan_top_theme_dir(ThemeDirScan *scan) {
+  GFileEnumerator *enumerator;
+  GFileInfo *file_info;
+
+  scan->children = g_ptr_array_new_with_free_func(g_object_unref);
+
   enumerator = g_file_enumerate_children(
-      uri, G_FILE_ATTRIBUTE_STANDARD_TYPE "," G_FILE_ATTRIBUTE_STANDARD_NAME,
+      scan->uri,
+      G_FILE_ATTRIBUTE_STANDARD_TYPE "," G_FILE_ATTRIBUTE_STANDARD_NAME,
       G_FILE_QUERY_INFO_NONE, NULL, NULL);
-  if (enumerator == NULL) return FALSE;
+  if (enumerator == NULL) return;
 
   while ((file_info = g_file_enumerator_next_file(enumerator, NULL, NULL))) {
     GFileType type = g_file_info_get_file_type(file_info);
 
-    if (type == G_FILE_TYPE_DIRECTORY || type == G_FILE_TYPE_SYMBOLIC_LINK) {
-      GFile *child;
-      const gchar *name;
-      gpointer data;
-
-      /* Add the directory */
-      name = g_file_info_get_name(file_info);
-      child = g_file_get_child(uri, name);
-
-      if (icon_theme) {
-        CommonIconThemeDirMonitorData *monitor_data;
-        monitor_data = g_new0(CommonIconThemeDirMonitorData, 1);
-        monitor_data->priority = priority;
-        add_common_icon_theme_dir_monitor(child, monitor_data, error);
-        data = monitor_data;
-      } else {
-        CommonThemeDirMonitorData *monitor_data;
-        monitor_data = g_new0(CommonThemeDirMonitorData, 1);
-        monitor_data->priority = priority;
-        add_common_theme_dir_monitor(child, monitor_data, error);
-        data = monitor_data;
-      }
-      g_object_unref(child);
+    if (type == G_FILE_TYPE_DIRECTORY || type == G_FILE_TYPE_SYMBOLIC_LINK)
+      g_ptr_array_add(scan->children,
+                      g_file_get_child(scan->uri,
+                                       g_file_info_get_name(file_info)));
 
-      g_hash_table_insert(tuple->handle_hash, g_strdup(name), data);
-    }
     g_object_unref(file_info);
   }
   g_file_enumerator_close(enumerator, NULL, NULL);
+  g_object_unref(enumerator);
+}
 
-  return TRUE;
+/* Theme discovery
+ *
+ * Top dirs and the common_theme_dirs they contain are scanned on a pool of
+ * threads, which only read from the disk.  Their results are handed back to
+ * the main thread, which adds the themes to the hashes and sets up the
+ * monitors.  mate_theme_init() waits for all of them in place, while
+ * mate_theme_init_async() picks them up from idles, announcing every theme
+ * as it is found.
+ */
+static void theme_discovery_thread(ThemeDirScan *scan, gpointer user_data) {
+  switch (scan->kind) {
+    case SCAN_TOP_DIR:
+      scan_top_theme_dir(scan);
+      break;
+    case SCAN_THEME_DIR:
+      scan_common_theme_dir(scan);
+      break;
+    case SCAN_ICON_THEME_DIR:
+      scan_common_icon_theme_dir(scan);
+      break;
+  }
+
+  g_async_queue_push(discovery_results, scan);
+
+  if (discovery_async &&
+      g_atomic_int_compare_and_exchange(&discovery_wakeup, FALSE, TRUE))
+    g_idle_add(theme_discovery_idle, NULL);
+}
+
+static void theme_discovery_push(ThemeDirScan *scan) {
+  discovery_pending++;
+  g_thread_pool_push(discovery_pool, scan, NULL);
+}
+
+static void theme_discovery_add_top_dir(GFile *uri, gint priority,
+                                        gboolean icon_theme) {
+  CallbackTuple *tuple;
+  ThemeDirScan *scan;
+
+  tuple = add_top_theme_dir_monitor(uri, priority, icon_theme);
+  if (tuple == NULL) return;
+
+  scan = theme_dir_scan_new(SCAN_TOP_DIR, uri, tuple);
+  scan->icon_theme = icon_theme;
+  scan->top = discovery_n_tops++;
+  theme_discovery_push(scan);
+}
+
+static void theme_discovery_apply(ThemeDirScan *scan) {
+  CallbackTuple *tuple = scan->tuple;
+  guint i;
+
+  if (scan->kind == SCAN_TOP_DIR) {
+    for (i = 0; i < scan->children->len; i++) {
+      ThemeDirScan *child;
+
+      child = theme_dir_scan_new(
+          scan->icon_theme ? SCAN_ICON_THEME_DIR : SCAN_THEME_DIR,
+          g_ptr_array_index(scan->children, i), tuple);
+      child->top = scan->top;
+      child->child = i + 1;
+      theme_discovery_push(child);
+    }
+    discovery_n_children = scan->children->len;
+  } else if (scan->kind == SCAN_ICON_THEME_DIR) {
+    CommonIconThemeDirMonitorData *monitor_data;
+
+    monitor_data = g_new0(CommonIconThemeDirMonitorData, 1);
+    monitor_data->priority = tuple->priority;
+    add_scanned_common_icon_theme_dir(scan, monitor_data);
+    g_hash_table_insert(tuple->handle_hash, g_file_get_basename(scan->uri),
+                        monitor_data);
+  } else {
+    CommonThemeDirMonitorData *monitor_data;
+
+    monitor_data = g_new0(CommonThemeDirMonitorData, 1);
+    monitor_data->priority = tuple->priority;
+    add_scanned_common_theme_dir(scan, monitor_data);
+    g_hash_table_insert(tuple->handle_hash, g_file_get_basename(scan->uri),
+                        monitor_data);
+  }
+
+  theme_dir_scan_free(scan);
+  discovery_pending--;
+
+  if (discovery_next_child < discovery_n_children) {
+    discovery_next_child++;
+  } else {
+    discovery_next_top++;
+    discovery_next_child = 0;
+  }
+}
+
+static gint compare_scans(gconstpointer a, gconstpointer b,
+                          gpointer user_data) {
+  const ThemeDirScan *scan_a = a, *scan_b = b;
+
+  if (scan_a->top != scan_b->top) return scan_a->top < scan_b->top ? -1 : 1;
+
+  return (scan_a->child > scan_b->child) - (scan_a->child < scan_b->child);
+}
+
+/* Applies @scan once all the scans before it are, along with the held ones
+ * that were waiting for it */
+static void theme_discovery_receive(ThemeDirScan *scan) {
+  g_sequence_insert_sorted(discovery_held, scan, compare_scans, NULL);
+
+  while (!g_sequence_is_empty(discovery_held)) {
+    GSequenceIter *first = g_sequence_get_begin_iter(discovery_held);
+
+    scan = g_sequence_get(first);
+    if (scan->top != discovery_next_top || scan->child != discovery_next_child)
+      break;
+
+    g_sequence_remove(first);
+    theme_discovery_apply(scan);
+  }
+}
+
+static gboolean theme_init_callbacks_idle(gpointer data) {
+  GList *list, *l;
+
+  list = g_list_reverse(init_callbacks);
+  init_callbacks = NULL;
+
+  for (l = list; l; l = l->next) {
+    InitCallbackData *callback_data = l->data;
+
+    callback_data->func(callback_data->data);
+    g_free(callback_data);
+  }
+  g_list_free(list);
+
+  return FALSE;
 }
 
-static gboolean add_top_theme_dir_monitor(GFile *uri, gint priority,
-                                          GError **error) {
-  return real_add_top_theme_dir_monitor(uri, priority, FALSE, error);
+static void theme_discovery_finish(void) {
+  g_thread_pool_free(discovery_pool, FALSE, TRUE);
+  discovery_pool = NULL;
+  g_async_queue_unref(discovery_results);
+  discovery_results = NULL;
+  g_sequence_free(discovery_held);
+  discovery_held = NULL;
+
+  /* make sure we have the default theme */
+  if (!mate_theme_cursor_info_find("default")) add_default_cursor_theme();
+
+  theme_index_save();
+
+  /* done */
+  initted = TRUE;
+  initting = FALSE;
+
+  if (init_callbacks != NULL) theme_init_callbacks_idle(NULL);
 }
 
-static gboolean add_top_icon_theme_dir_monitor(GFile *uri, gint priority,
-                                               GError **error) {
-  return real_add_top_theme_dir_monitor(uri, priority, TRUE, error);
+static gboolean theme_discovery_idle(gpointer data) {
+  ThemeDirScan *scan;
+
+  g_atomic_int_set(&discovery_wakeup, FALSE);
+
+  /* mate_theme_init() may have collected everything in the meantime */
+  if (discovery_results == NULL) return FALSE;
+
+  while (discovery_pending > 0 &&
+         (scan = g_async_queue_try_pop(discovery_results)) != NULL)
+    theme_discovery_receive(scan);
+
+  if (discovery_pending == 0) theme_discovery_finish();
+
+  return FALSE;
+}
+
+static void theme_discovery_start(gboolean async) {
+  const gchar *const *dirs;
+  GFile *top_theme_dir;
+  gchar *top_theme_dir_string;
+  gchar **search_path;
+  gint i, n;
+
+  /* themes found by a synchronous init aren't announced one by one */
+  initting = !async;
+  discovery_async = async;
+
+  meta_theme_hash_by_uri =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  meta_theme_hash_by_name =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  icon_theme_hash_by_uri =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  icon_theme_hash_by_name =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  cursor_theme_hash_by_uri =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  cursor_theme_hash_by_name =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  theme_hash_by_uri =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  theme_hash_by_name =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  discovery_results = g_async_queue_new();
+  discovery_held = g_sequence_new(NULL);
+  discovery_n_tops = discovery_next_top = discovery_next_child = 0;
+  discovery_n_children = 0;
+  discovery_pool =
+      g_thread_pool_new((GFunc)theme_discovery_thread, NULL,
+                        g_get_num_processors(), FALSE, NULL);
+
+  /* Add all the toplevel theme dirs following the XDG Base Directory
+   * Specification */
+  dirs = g_get_system_data_dirs();
+  if (dirs != NULL)
+    for (; *dirs != NULL; ++dirs) {
+      top_theme_dir_string = g_build_filename(*dirs, "themes", NULL);
+      top_theme_dir = g_file_new_for_path(top_theme_dir_string);
+      g_free(top_theme_dir_string);
+      theme_discovery_add_top_dir(top_theme_dir, 1, FALSE);
+      g_object_unref(top_theme_dir);
+    }
+
+  /* ~/.themes */
+  top_theme_dir_string = g_build_filename(g_get_home_dir(), ".themes", NULL);
+  top_theme_dir = g_file_new_for_path(top_theme_dir_string);
+  g_free(top_theme_dir_string);
+  if (!g_file_query_exists(top_theme_dir, NULL))
+    g_file_make_directory(top_theme_dir, NULL, NULL);
+  theme_discovery_add_top_dir(top_theme_dir, 0, FALSE);
+  g_object_unref(top_theme_dir);
+
+  /* ~/.icons */
+  top_theme_dir_string = g_build_filename(g_get_home_dir(), ".icons", NULL);
+  top_theme_dir = g_file_new_for_path(top_theme_dir_string);
+  g_free(top_theme_dir_string);
+  if (!g_file_query_exists(top_theme_dir, NULL))
+    g_file_make_directory(top_theme_dir, NULL, NULL);
+  g_object_unref(top_theme_dir);
+
+  /* icon theme search path */
+  if (gdk_screen_get_default() != NULL) {
+    gtk_icon_theme_get_search_path(gtk_icon_theme_get_default(), &search_path,
+                                   &n);
+  } else {
+    /* without a display there is no default icon theme to ask, use the same
+     * path GtkIconTheme would */
+    GPtrArray *path = g_ptr_array_new();
+
+    g_ptr_array_add(path, g_build_filename(g_get_home_dir(), ".icons", NULL));
+    for (dirs = g_get_system_data_dirs(); dirs && *dirs; ++dirs)
+      g_ptr_array_add(path, g_build_filename(*dirs, "icons", NULL));
+    g_ptr_array_add(path, g_strdup("/usr/share/pixmaps"));
+
+    n = path->len;
+    g_ptr_array_add(path, NULL);
+    search_path = (gchar **)g_ptr_array_free(path, FALSE);
+  }
+  for (i = 0; i < n; ++i) {
+    top_theme_dir = g_file_new_for_path(search_path[i]);
+    theme_discovery_add_top_dir(top_theme_dir, i, TRUE);
+    g_object_unref(top_theme_dir);
+  }
+  g_strfreev(search_path);
+
+  /* if there's a separate xcursors dir, add that as well */
+  if (strcmp(XCURSOR_ICONDIR, "/usr/share/icons")) {
+    top_theme_dir = g_file_new_for_path(XCURSOR_ICONDIR);
+    theme_discovery_add_top_dir(top_theme_dir, 1, TRUE);
+    g_object_unref(top_theme_dir);
+  }
+
+  /* nothing to wait for */
+  if (async && discovery_pending == 0) g_idle_add(theme_discovery_idle, NULL);
 }
 
 /* Public functions */
@@ -1587,85 +2165,30 @@ gboolean mate_theme_color_scheme_equal(const gchar *s1, const gchar *s2) {
   return TRUE;
 }
 
-void mate_theme_init() {
-  const gchar *const *dirs;
-  GFile *top_theme_dir;
-  gchar *top_theme_dir_string;
-  static gboolean initted = FALSE;
-  gchar **search_path;
-  gint i, n;
-
+void mate_theme_init(void) {
   if (initted) return;
 
-  initting = TRUE;
+  if (discovery_pool == NULL) theme_discovery_start(FALSE);
 
-  meta_theme_hash_by_uri =
-      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-  meta_theme_hash_by_name =
-      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-  icon_theme_hash_by_uri =
-      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-  icon_theme_hash_by_name =
-      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-  cursor_theme_hash_by_uri =
-      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-  cursor_theme_hash_by_name =
-      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-  theme_hash_by_uri =
-      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-  theme_hash_by_name =
-      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  while (discovery_pending > 0)
+    theme_discovery_receive(g_async_queue_pop(discovery_results));
 
-  /* Add all the toplevel theme dirs following the XDG Base Directory
-   * Specification */
-  dirs = g_get_system_data_dirs();
-  if (dirs != NULL)
-    for (; *dirs != NULL; ++dirs) {
-      top_theme_dir_string = g_build_filename(*dirs, "themes", NULL);
-      top_theme_dir = g_file_new_for_path(top_theme_dir_string);
-      g_free(top_theme_dir_string);
-      add_top_theme_dir_monitor(top_theme_dir, 1, NULL);
-      g_object_unref(top_theme_dir);
-    }
-
-  /* ~/.themes */
-  top_theme_dir_string = g_build_filename(g_get_home_dir(), ".themes", NULL);
-  top_theme_dir = g_file_new_for_path(top_theme_dir_string);
-  g_free(top_theme_dir_string);
-  if (!g_file_query_exists(top_theme_dir, NULL))
-    g_file_make_directory(top_theme_dir, NULL, NULL);
-  add_top_theme_dir_monitor(top_theme_dir, 0, NULL);
-  g_object_unref(top_theme_dir);
+  theme_discovery_finish();
+}
 
-  /* ~/.icons */
-  top_theme_dir_string = g_build_filename(g_get_home_dir(), ".icons", NULL);
-  top_theme_dir = g_file_new_for_path(top_theme_dir_string);
-  g_free(top_theme_dir_string);
-  if (!g_file_query_exists(top_theme_dir, NULL))
-    g_file_make_directory(top_theme_dir, NULL, NULL);
-  g_object_unref(top_theme_dir);
+void mate_theme_init_async(MateThemeInitCallback callback, gpointer user_data) {
+  if (callback != NULL) {
+    InitCallbackData *callback_data;
 
-  /* icon theme search path */
-  gtk_icon_theme_get_search_path(gtk_icon_theme_get_default(), &search_path,
-                                 &n);
-  for (i = 0; i < n; ++i) {
-    top_theme_dir = g_file_new_for_path(search_path[i]);
-    add_top_icon_theme_dir_monitor(top_theme_dir, i, NULL);
-    g_object_unref(top_theme_dir);
-  }
-  g_strfreev(search_path);
+    callback_data = g_new(InitCallbackData, 1);
+    callback_data->func = callback;
+    callback_data->data = user_data;
 
-  /* if there's a separate xcursors dir, add that as well */
-  if (strcmp(XCURSOR_ICONDIR, "/usr/share/icons")) {
-    top_theme_dir = g_file_new_for_path(XCURSOR_ICONDIR);
-    add_top_icon_theme_dir_monitor(top_theme_dir, 1, NULL);
-    g_object_unref(top_theme_dir);
+    init_callbacks = g_list_prepend(init_callbacks, callback_data);
   }
 
-  /* make sure we have the default theme */
-  if (!mate_theme_cursor_info_find("default")) add_default_cursor_theme();
-
-  /* done */
-  initted = TRUE;
-  initting = FALSE;
+  if (initted)
+    g_idle_add(theme_init_callbacks_idle, NULL);
+  else if (discovery_pool == NULL)
+    theme_discovery_start(TRUE);
 }
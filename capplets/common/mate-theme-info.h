@@ -132,6 +132,8 @@ typedef void (*ThemeChangedCallback)(MateThemeCommonInfo *theme,
                                      MateThemeElement element_type,
                                      gpointer user_data);
 
+typedef void (*MateThemeInitCallback)(gpointer user_data);
+
 #define MATE_THEME_ERROR mate_theme_info_error_quark()
 
 enum {
@@ -177,6 +179,11 @@ MateThemeMetaInfo *mate_theme_read_meta_theme(GFile *meta_theme_uri);
 
 /* Other */
 void mate_theme_init(void);
+/* Finds the installed themes on a pool of threads.  Each theme is announced to
+ * the theme change callbacks as it is found, and @callback runs once all of
+ * them are.  mate_theme_init() can still be called meanwhile; it then waits
+ * for the rest. */
+void mate_theme_init_async(MateThemeInitCallback callback, gpointer user_data);
 void mate_theme_info_register_theme_change(ThemeChangedCallback func,
                                            gpointer data);
 
@@ -0,0 +1,437 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "theme-index.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "gtkrc-utils.h"
+
+/* Bump this whenever the records or the way themes are read change */
+#define INDEX_VERSION 2
+
+#define INDEX_GROUP "Index"
+
+/* seconds to wait after a theme changed on disk before writing the index */
+#define SAVE_DELAY 5
+
+/* theme discovery looks records up from several threads */
+static GMutex index_lock;
+static GKeyFile *index_file = NULL;
+static GHashTable *seen_groups = NULL;
+static gboolean index_dirty = FALSE;
+static guint save_id = 0;
+
+static gchar *index_filename(void) {
+  return g_build_filename(g_get_user_cache_dir(), "mate-control-center",
+                          "theme-index", NULL);
+}
+
+/* readable names and comments are localized, so is the index */
+static gchar *index_languages(void) {
+  return g_strjoinv(":", (gchar **)g_get_language_names());
+}
+
+static void index_ensure(void) {
+  gchar *filename, *languages, *stored;
+  gboolean valid = FALSE;
+
+  if (index_file != NULL) return;
+
+  index_file = g_key_file_new();
+  seen_groups = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  filename = index_filename();
+  languages = index_languages();
+
+  if (g_key_file_load_from_file(index_file, filename, G_KEY_FILE_NONE, NULL) &&
+      g_key_file_get_integer(index_file, INDEX_GROUP, "Version", NULL) ==
+          INDEX_VERSION) {
+    stored = g_key_file_get_string(index_file, INDEX_GROUP, "Languages", NULL);
+    valid = (g_strcmp0(stored, languages) == 0);
+    g_free(stored);
+  }
+
+  if (!valid) {
+    g_key_file_free(index_file);
+    index_file = g_key_file_new();
+    g_key_file_set_integer(index_file, INDEX_GROUP, "Version", INDEX_VERSION);
+    g_key_file_set_string(index_file, INDEX_GROUP, "Languages", languages);
+    index_dirty = TRUE;
+  }
+
+  g_hash_table_add(seen_groups, g_strdup(INDEX_GROUP));
+
+  g_free(languages);
+  g_free(filename);
+}
+
+static gchar *index_group(MateThemeType type, const gchar *index_path) {
+  const gchar *prefix;
+
+  switch (type) {
+    case MATE_THEME_TYPE_METATHEME:
+      prefix = "meta";
+      break;
+    case MATE_THEME_TYPE_ICON:
+      prefix = "icon";
+      break;
+    case MATE_THEME_TYPE_CURSOR:
+      prefix = "cursor";
+      break;
+    default:
+      return NULL;
+  }
+
+  /* group names can't hold brackets */
+  if (strpbrk(index_path, "[]\n") != NULL) return NULL;
+
+  return g_strconcat(prefix, ":", index_path, NULL);
+}
+
+static gchar *file_stamp(const gchar *path) {
+  GStatBuf st;
+
+  if (g_stat(path, &st) != 0) return g_strdup("-");
+
+  return g_strdup_printf("%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT,
+                         (gint64)st.st_mtime, (gint64)st.st_size);
+}
+
+/* The files a record depends on: the index file itself, the gtkrc a meta
+ * theme may take its color scheme from and the cursors a cursor theme is
+ * probed from, its sizes and thumbnail coming from the left_ptr one. */
+static GPtrArray *record_files(MateThemeType type, const gchar *index_path,
+                               const MateThemeCommonInfo *info) {
+  GPtrArray *files = g_ptr_array_new_with_free_func(g_free);
+
+  g_ptr_array_add(files, g_strdup(index_path));
+
+  if (type == MATE_THEME_TYPE_CURSOR) {
+    gchar *dir = g_path_get_dirname(index_path);
+
+    g_ptr_array_add(files, g_build_filename(dir, "cursors", NULL));
+    g_ptr_array_add(files, g_build_filename(dir, "cursors", "left_ptr", NULL));
+    g_free(dir);
+  } else if (type == MATE_THEME_TYPE_METATHEME && info != NULL) {
+    const MateThemeMetaInfo *meta = (const MateThemeMetaInfo *)info;
+    gchar *gtkrc = gtkrc_find_named(meta->gtk_theme_name);
+
+    if (gtkrc != NULL) g_ptr_array_add(files, gtkrc);
+  }
+
+  return files;
+}
+
+static gboolean record_is_valid(const gchar *group) {
+  gchar **files, **stamps;
+  gboolean valid;
+  gsize n_files, n_stamps, i;
+
+  files = g_key_file_get_string_list(index_file, group, "Files", &n_files,
+                                     NULL);
+  stamps = g_key_file_get_string_list(index_file, group, "Stamps", &n_stamps,
+                                      NULL);
+
+  valid = (files != NULL && stamps != NULL && n_files == n_stamps);
+
+  for (i = 0; valid && i < n_files; i++) {
+    gchar *stamp = file_stamp(files[i]);
+
+    valid = (strcmp(stamp, stamps[i]) == 0);
+    g_free(stamp);
+  }
+
+  g_strfreev(files);
+  g_strfreev(stamps);
+
+  return valid;
+}
+
+static gchar *get_string(const gchar *group, const gchar *key) {
+  return g_key_file_get_string(index_file, group, key, NULL);
+}
+
+static void set_string(const gchar *group, const gchar *key,
+                       const gchar *value) {
+  if (value != NULL) g_key_file_set_string(index_file, group, key, value);
+}
+
+static GdkPixbuf *get_pixbuf(const gchar *group, const gchar *key) {
+  GInputStream *stream;
+  GdkPixbuf *pixbuf;
+  gchar *encoded;
+  guchar *png;
+  gsize length;
+
+  encoded = get_string(group, key);
+  if (encoded == NULL) return NULL;
+
+  png = g_base64_decode(encoded, &length);
+  g_free(encoded);
+
+  stream = g_memory_input_stream_new_from_data(png, length, g_free);
+  pixbuf = gdk_pixbuf_new_from_stream(stream, NULL, NULL);
+  g_object_unref(stream);
+
+  return pixbuf;
+}
+
+static void set_pixbuf(const gchar *group, const gchar *key,
+                       GdkPixbuf *pixbuf) {
+  gchar *png, *encoded;
+  gsize length;
+
+  if (pixbuf == NULL ||
+      !gdk_pixbuf_save_to_buffer(pixbuf, &png, &length, "png", NULL, NULL))
+    return;
+
+  encoded = g_base64_encode((const guchar *)png, length);
+  g_key_file_set_string(index_file, group, key, encoded);
+  g_free(encoded);
+  g_free(png);
+}
+
+static MateThemeCommonInfo *read_meta_record(const gchar *group,
+                                             const gchar *index_path) {
+  MateThemeMetaInfo *info = mate_theme_meta_info_new();
+  gchar *dir;
+
+  info->path = g_strdup(index_path);
+  dir = g_path_get_dirname(index_path);
+  info->name = g_path_get_basename(dir);
+  g_free(dir);
+
+  info->readable_name = get_string(group, "ReadableName");
+  info->comment = get_string(group, "Comment");
+  info->icon_file = get_string(group, "IconFile");
+  info->gtk_theme_name = get_string(group, "GtkTheme");
+  info->gtk_color_scheme = get_string(group, "GtkColorScheme");
+  info->marco_theme_name = get_string(group, "MarcoTheme");
+  info->icon_theme_name = get_string(group, "IconTheme");
+  info->notification_theme_name = get_string(group, "NotificationTheme");
+  info->cursor_theme_name = get_string(group, "CursorTheme");
+  info->cursor_size = g_key_file_get_integer(index_file, group, "CursorSize",
+                                             NULL);
+  info->application_font = get_string(group, "ApplicationFont");
+  info->documents_font = get_string(group, "DocumentsFont");
+  info->desktop_font = get_string(group, "DesktopFont");
+  info->windowtitle_font = get_string(group, "WindowTitleFont");
+  info->monospace_font = get_string(group, "MonospaceFont");
+  info->background_image = get_string(group, "BackgroundImage");
+  info->hidden = g_key_file_get_boolean(index_file, group, "Hidden", NULL);
+
+  return (MateThemeCommonInfo *)info;
+}
+
+static void write_meta_record(const gchar *group,
+                              const MateThemeMetaInfo *info) {
+  set_string(group, "ReadableName", info->readable_name);
+  set_string(group, "Comment", info->comment);
+  set_string(group, "IconFile", info->icon_file);
+  set_string(group, "GtkTheme", info->gtk_theme_name);
+  set_string(group, "GtkColorScheme", info->gtk_color_scheme);
+  set_string(group, "MarcoTheme", info->marco_theme_name);
+  set_string(group, "IconTheme", info->icon_theme_name);
+  set_string(group, "NotificationTheme", info->notification_theme_name);
+  set_string(group, "CursorTheme", info->cursor_theme_name);
+  g_key_file_set_integer(index_file, group, "CursorSize", info->cursor_size);
+  set_string(group, "ApplicationFont", info->application_font);
+  set_string(group, "DocumentsFont", info->documents_font);
+  set_string(group, "DesktopFont", info->desktop_font);
+  set_string(group, "WindowTitleFont", info->windowtitle_font);
+  set_string(group, "MonospaceFont", info->monospace_font);
+  set_string(group, "BackgroundImage", info->background_image);
+  g_key_file_set_boolean(index_file, group, "Hidden", info->hidden);
+}
+
+static MateThemeCommonInfo *read_icon_record(const gchar *group,
+                                             const gchar *index_path) {
+  MateThemeIconInfo *info = mate_theme_icon_info_new();
+  gchar *dir;
+
+  info->path = g_strdup(index_path);
+  dir = g_path_get_dirname(index_path);
+  info->name = g_path_get_basename(dir);
+  g_free(dir);
+
+  info->readable_name = get_string(group, "ReadableName");
+  info->hidden = g_key_file_get_boolean(index_file, group, "Hidden", NULL);
+
+  return info;
+}
+
+static void write_icon_record(const gchar *group,
+                              const MateThemeIconInfo *info) {
+  set_string(group, "ReadableName", info->readable_name);
+  g_key_file_set_boolean(index_file, group, "Hidden", info->hidden);
+}
+
+static MateThemeCommonInfo *read_cursor_record(const gchar *group,
+                                               const gchar *index_path) {
+  MateThemeCursorInfo *info = mate_theme_cursor_info_new();
+  gint *sizes;
+  gsize n_sizes;
+
+  info->path = g_path_get_dirname(index_path);
+  info->name = g_path_get_basename(info->path);
+  info->readable_name = get_string(group, "ReadableName");
+  info->hidden = g_key_file_get_boolean(index_file, group, "Hidden", NULL);
+
+  sizes = g_key_file_get_integer_list(index_file, group, "Sizes", &n_sizes,
+                                      NULL);
+  info->sizes = g_array_sized_new(FALSE, FALSE, sizeof(gint), n_sizes);
+  if (sizes != NULL) g_array_append_vals(info->sizes, sizes, n_sizes);
+  g_free(sizes);
+
+  info->thumbnail = get_pixbuf(group, "Thumbnail");
+
+  return (MateThemeCommonInfo *)info;
+}
+
+static void write_cursor_record(const gchar *group,
+                                const MateThemeCursorInfo *info) {
+  set_string(group, "ReadableName", info->readable_name);
+  g_key_file_set_boolean(index_file, group, "Hidden", info->hidden);
+  g_key_file_set_integer_list(index_file, group, "Sizes",
+                              (gint *)info->sizes->data, info->sizes->len);
+  set_pixbuf(group, "Thumbnail", info->thumbnail);
+}
+
+gboolean theme_index_lookup(MateThemeType type, const gchar *index_path,
+                            MateThemeCommonInfo **info) {
+  gchar *group;
+
+  group = index_group(type, index_path);
+  if (group == NULL) return FALSE;
+
+  g_mutex_lock(&index_lock);
+  index_ensure();
+
+  if (!g_key_file_has_group(index_file, group) || !record_is_valid(group)) {
+    g_mutex_unlock(&index_lock);
+    g_free(group);
+    return FALSE;
+  }
+
+  if (!g_key_file_get_boolean(index_file, group, "Valid", NULL))
+    *info = NULL;
+  else if (type == MATE_THEME_TYPE_METATHEME)
+    *info = read_meta_record(group, index_path);
+  else if (type == MATE_THEME_TYPE_ICON)
+    *info = read_icon_record(group, index_path);
+  else
+    *info = read_cursor_record(group, index_path);
+
+  g_hash_table_add(seen_groups, group);
+  g_mutex_unlock(&index_lock);
+
+  return TRUE;
+}
+
+void theme_index_store(MateThemeType type, const gchar *index_path,
+                       const MateThemeCommonInfo *info) {
+  GPtrArray *files, *stamps;
+  gchar *group;
+  guint i;
+
+  group = index_group(type, index_path);
+  if (group == NULL) return;
+
+  files = record_files(type, index_path, info);
+  stamps = g_ptr_array_new_with_free_func(g_free);
+  for (i = 0; i < files->len; i++)
+    g_ptr_array_add(stamps, file_stamp(g_ptr_array_index(files, i)));
+
+  g_mutex_lock(&index_lock);
+  index_ensure();
+
+  g_key_file_remove_group(index_file, group, NULL);
+
+  g_key_file_set_string_list(index_file, group, "Files",
+                             (const gchar *const *)files->pdata, files->len);
+  g_key_file_set_string_list(index_file, group, "Stamps",
+                             (const gchar *const *)stamps->pdata, stamps->len);
+  g_key_file_set_boolean(index_file, group, "Valid", info != NULL);
+
+  if (info != NULL) {
+    if (type == MATE_THEME_TYPE_METATHEME)
+      write_meta_record(group, (const MateThemeMetaInfo *)info);
+    else if (type == MATE_THEME_TYPE_ICON)
+      write_icon_record(group, info);
+    else
+      write_cursor_record(group, (const MateThemeCursorInfo *)info);
+  }
+
+  g_ptr_array_unref(stamps);
+  g_ptr_array_unref(files);
+
+  g_hash_table_add(seen_groups, group);
+  index_dirty = TRUE;
+  g_mutex_unlock(&index_lock);
+}
+
+void theme_index_save(void) {
+  gchar **groups, *filename, *dirname, *contents;
+  gsize n_groups, length, i;
+  GError *error = NULL;
+
+  if (save_id != 0) {
+    g_source_remove(save_id);
+    save_id = 0;
+  }
+
+  g_mutex_lock(&index_lock);
+
+  if (index_file == NULL) {
+    g_mutex_unlock(&index_lock);
+    return;
+  }
+
+  groups = g_key_file_get_groups(index_file, &n_groups);
+  for (i = 0; i < n_groups; i++) {
+    if (!g_hash_table_contains(seen_groups, groups[i])) {
+      g_key_file_remove_group(index_file, groups[i], NULL);
+      index_dirty = TRUE;
+    }
+  }
+  g_strfreev(groups);
+
+  if (!index_dirty) {
+    g_mutex_unlock(&index_lock);
+    return;
+  }
+
+  filename = index_filename();
+  dirname = g_path_get_dirname(filename);
+  contents = g_key_file_to_data(index_file, &length, NULL);
+  index_dirty = FALSE;
+
+  g_mutex_unlock(&index_lock);
+
+  if (g_mkdir_with_parents(dirname, 0700) != 0 ||
+      !g_file_set_contents(filename, contents, length, &error)) {
+    g_warning("Could not write the theme index %s: %s", filename,
+              error ? error->message : g_strerror(errno));
+    g_clear_error(&error);
+  }
+
+  g_free(contents);
+  g_free(dirname);
+  g_free(filename);
+}
+
+static gboolean save_timeout(gpointer data) {
+  save_id = 0;
+  theme_index_save();
+
+  return FALSE;
+}
+
+void theme_index_save_later(void) {
+  if (save_id == 0)
+    save_id = g_timeout_add_seconds(SAVE_DELAY, save_timeout, NULL);
+}
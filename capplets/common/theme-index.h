@@ -0,0 +1,24 @@
+#ifndef __THEME_INDEX_H__
+#define __THEME_INDEX_H__
+
+#include "mate-theme-info.h"
+
+/* Persistent index of parsed meta, icon and cursor themes.  Every record
+ * remembers the modification time and size of the files it was read from, so
+ * checking whether it is still valid only takes a stat() of each of them. */
+
+/* Returns TRUE if @index_path has an up to date record, with *info set to a
+ * new copy of it, or to NULL if the directory holds no theme of that type. */
+gboolean theme_index_lookup(MateThemeType type, const gchar *index_path,
+                            MateThemeCommonInfo **info);
+/* Records what was read from @index_path; @info may be NULL. */
+void theme_index_store(MateThemeType type, const gchar *index_path,
+                       const MateThemeCommonInfo *info);
+
+/* Writes the index out if it changed.  Records that were neither looked up
+ * nor stored since startup belong to directories that are gone and are
+ * dropped. */
+void theme_index_save(void);
+void theme_index_save_later(void);
+
+#endif /* __THEME_INDEX_H__ */
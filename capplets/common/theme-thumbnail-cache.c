@@ -0,0 +1,286 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "theme-thumbnail-cache.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "mate-theme-info.h"
+
+/* Bump this whenever the way thumbnails are rendered changes */
+#define CACHE_VERSION "1"
+
+#define CACHE_MAX_SIZE (64 * 1024 * 1024)
+
+/* seconds to wait after the last store before trimming the cache */
+#define EVICTION_DELAY 30
+
+typedef struct {
+  gchar *filename;
+  GdkPixbuf *pixbuf;
+} StoreData;
+
+typedef struct {
+  gchar *filename;
+  time_t mtime;
+  goffset size;
+} CacheEntry;
+
+static guint eviction_id = 0;
+
+static const gchar *cache_dir(void) {
+  static gchar *dir = NULL;
+
+  if (g_once_init_enter(&dir)) {
+    gchar *path = g_build_filename(g_get_user_cache_dir(),
+                                   "mate-control-center", "theme-thumbnails",
+                                   NULL);
+
+    g_once_init_leave(&dir, path);
+  }
+
+  return dir;
+}
+
+static gchar *cache_filename(const gchar *key) {
+  gchar *basename, *filename;
+
+  basename = g_strconcat(key, ".png", NULL);
+  filename = g_build_filename(cache_dir(), basename, NULL);
+  g_free(basename);
+
+  return filename;
+}
+
+static void checksum_add_string(GChecksum *checksum, const gchar *str) {
+  if (str == NULL) str = "";
+
+  /* include the NUL so that ("ab", "c") and ("a", "bc") differ */
+  g_checksum_update(checksum, (const guchar *)str, strlen(str) + 1);
+}
+
+static void checksum_add_mtime(GChecksum *checksum, const gchar *path,
+                               const gchar *child) {
+  gchar *filename;
+  GStatBuf st;
+  gint64 mtime = 0;
+
+  filename = g_build_filename(path, child, NULL);
+  if (g_stat(filename, &st) == 0) mtime = st.st_mtime;
+  g_free(filename);
+
+  g_checksum_update(checksum, (const guchar *)&mtime, sizeof(mtime));
+}
+
+gchar *theme_thumbnail_cache_key(const gchar *thumbnail_type,
+                                 const gchar *gtk_theme_name,
+                                 const gchar *gtk_color_scheme,
+                                 const gchar *marco_theme_name,
+                                 const gchar *icon_theme_name,
+                                 const gchar *application_font) {
+  GChecksum *checksum;
+  MateThemeInfo *theme_info;
+  MateThemeIconInfo *icon_info;
+  gchar *key;
+
+  checksum = g_checksum_new(G_CHECKSUM_SHA256);
+
+  checksum_add_string(checksum, CACHE_VERSION);
+  checksum_add_string(checksum, thumbnail_type);
+  checksum_add_string(checksum, gtk_theme_name);
+  checksum_add_string(checksum, gtk_color_scheme);
+  checksum_add_string(checksum, marco_theme_name);
+  checksum_add_string(checksum, icon_theme_name);
+  checksum_add_string(checksum, application_font);
+
+  if (gtk_theme_name != NULL &&
+      (theme_info = mate_theme_info_find(gtk_theme_name)) != NULL) {
+    checksum_add_mtime(checksum, theme_info->path, NULL);
+    checksum_add_mtime(checksum, theme_info->path, "gtk-3.0");
+  }
+
+  if (marco_theme_name != NULL &&
+      (theme_info = mate_theme_info_find(marco_theme_name)) != NULL) {
+    checksum_add_mtime(checksum, theme_info->path, NULL);
+    checksum_add_mtime(checksum, theme_info->path, "metacity-1");
+  }
+
+  if (icon_theme_name != NULL &&
+      (icon_info = mate_theme_icon_info_find(icon_theme_name)) != NULL) {
+    gchar *dir = g_path_get_dirname(icon_info->path);
+
+    /* path is the index.theme file */
+    checksum_add_mtime(checksum, icon_info->path, NULL);
+    checksum_add_mtime(checksum, dir, NULL);
+    g_free(dir);
+  }
+
+  key = g_strdup(g_checksum_get_string(checksum));
+  g_checksum_free(checksum);
+
+  return key;
+}
+
+static void lookup_thread(GTask *task, gpointer source_object,
+                          gpointer task_data, GCancellable *cancellable) {
+  const gchar *filename = task_data;
+  GdkPixbuf *pixbuf;
+  GError *error = NULL;
+
+  if (g_task_return_error_if_cancelled(task)) return;
+
+  pixbuf = gdk_pixbuf_new_from_file(filename, &error);
+  if (pixbuf == NULL) {
+    g_task_return_error(task, error);
+    return;
+  }
+
+  /* the modification time doubles as the LRU timestamp */
+  g_utime(filename, NULL);
+
+  g_task_return_pointer(task, pixbuf, g_object_unref);
+}
+
+void theme_thumbnail_cache_lookup_async(const gchar *key,
+                                        GCancellable *cancellable,
+                                        GAsyncReadyCallback callback,
+                                        gpointer user_data) {
+  GTask *task;
+
+  task = g_task_new(NULL, cancellable, callback, user_data);
+  g_task_set_task_data(task, cache_filename(key), g_free);
+  g_task_run_in_thread(task, lookup_thread);
+  g_object_unref(task);
+}
+
+GdkPixbuf *theme_thumbnail_cache_lookup_finish(GAsyncResult *result,
+                                               GError **error) {
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+static gint cache_entry_compare(const CacheEntry *a, const CacheEntry *b) {
+  if (a->mtime < b->mtime) return -1;
+  if (a->mtime > b->mtime) return 1;
+  return 0;
+}
+
+static void cache_entry_clear(CacheEntry *entry) { g_free(entry->filename); }
+
+static void evict_thread(GTask *task, gpointer source_object,
+                         gpointer task_data, GCancellable *cancellable) {
+  GArray *entries;
+  GDir *dir;
+  const gchar *name;
+  goffset total = 0;
+  guint i;
+
+  dir = g_dir_open(cache_dir(), 0, NULL);
+  if (dir == NULL) return;
+
+  entries = g_array_new(FALSE, FALSE, sizeof(CacheEntry));
+  g_array_set_clear_func(entries, (GDestroyNotify)cache_entry_clear);
+
+  while ((name = g_dir_read_name(dir)) != NULL) {
+    CacheEntry entry;
+    GStatBuf st;
+
+    entry.filename = g_build_filename(cache_dir(), name, NULL);
+    if (g_stat(entry.filename, &st) != 0) {
+      g_free(entry.filename);
+      continue;
+    }
+
+    if (!g_str_has_suffix(name, ".png")) {
+      /* left behind by a store that never finished */
+      if (g_str_has_suffix(name, ".tmp") && st.st_mtime < time(NULL) - 86400)
+        g_unlink(entry.filename);
+
+      g_free(entry.filename);
+      continue;
+    }
+
+    entry.mtime = st.st_mtime;
+    entry.size = st.st_size;
+    total += entry.size;
+    g_array_append_val(entries, entry);
+  }
+  g_dir_close(dir);
+
+  if (total > CACHE_MAX_SIZE) {
+    /* least recently used first */
+    g_array_sort(entries, (GCompareFunc)cache_entry_compare);
+
+    for (i = 0; i < entries->len && total > CACHE_MAX_SIZE; i++) {
+      CacheEntry *entry = &g_array_index(entries, CacheEntry, i);
+
+      if (g_unlink(entry->filename) == 0) total -= entry->size;
+    }
+  }
+
+  g_array_free(entries, TRUE);
+}
+
+static gboolean evict_timeout(gpointer user_data) {
+  GTask *task;
+
+  eviction_id = 0;
+
+  task = g_task_new(NULL, NULL, NULL, NULL);
+  g_task_run_in_thread(task, evict_thread);
+  g_object_unref(task);
+
+  return FALSE;
+}
+
+static void store_data_free(StoreData *store) {
+  g_free(store->filename);
+  g_object_unref(store->pixbuf);
+  g_free(store);
+}
+
+static void store_thread(GTask *task, gpointer source_object,
+                         gpointer task_data, GCancellable *cancellable) {
+  StoreData *store = task_data;
+  GError *error = NULL;
+  gchar *tmp_filename;
+
+  if (g_mkdir_with_parents(cache_dir(), 0700) != 0) return;
+
+  /* write to a temporary file first, so that readers never see a partial
+   * thumbnail */
+  tmp_filename =
+      g_strdup_printf("%s.%08x.tmp", store->filename, g_random_int());
+
+  if (gdk_pixbuf_save(store->pixbuf, tmp_filename, "png", &error, NULL)) {
+    if (g_rename(tmp_filename, store->filename) != 0) g_unlink(tmp_filename);
+  } else {
+    g_warning("Could not cache theme thumbnail: %s", error->message);
+    g_error_free(error);
+    g_unlink(tmp_filename);
+  }
+
+  g_free(tmp_filename);
+}
+
+void theme_thumbnail_cache_store(const gchar *key, GdkPixbuf *pixbuf) {
+  StoreData *store;
+  GTask *task;
+
+  g_return_if_fail(key != NULL);
+  g_return_if_fail(GDK_IS_PIXBUF(pixbuf));
+
+  store = g_new(StoreData, 1);
+  store->filename = cache_filename(key);
+  store->pixbuf = g_object_ref(pixbuf);
+
+  task = g_task_new(NULL, NULL, NULL, NULL);
+  g_task_set_task_data(task, store, (GDestroyNotify)store_data_free);
+  g_task_run_in_thread(task, store_thread);
+  g_object_unref(task);
+
+  /* start waiting again, so that a burst of stores is trimmed once */
+  if (eviction_id != 0) g_source_remove(eviction_id);
+  eviction_id = g_timeout_add_seconds(EVICTION_DELAY, evict_timeout, NULL);
+}
@@ -0,0 +1,30 @@
+#ifndef __THEME_THUMBNAIL_CACHE_H__
+#define __THEME_THUMBNAIL_CACHE_H__
+
+#include <gio/gio.h>
+#include <gtk/gtk.h>
+
+/* On-disk cache of rendered theme thumbnails.  An entry is keyed by the whole
+ * set of settings the thumbnail was rendered with plus the modification times
+ * of the theme directories involved, so changing a theme on disk just yields
+ * a new key and the stale entry ages out of the cache. */
+
+gchar *theme_thumbnail_cache_key(const gchar *thumbnail_type,
+                                 const gchar *gtk_theme_name,
+                                 const gchar *gtk_color_scheme,
+                                 const gchar *marco_theme_name,
+                                 const gchar *icon_theme_name,
+                                 const gchar *application_font);
+
+void theme_thumbnail_cache_lookup_async(const gchar *key,
+                                        GCancellable *cancellable,
+                                        GAsyncReadyCallback callback,
+                                        gpointer user_data);
+GdkPixbuf *theme_thumbnail_cache_lookup_finish(GAsyncResult *result,
+                                               GError **error);
+
+/* Writes the thumbnail out in the background and keeps the cache within its
+ * size limit. */
+void theme_thumbnail_cache_store(const gchar *key, GdkPixbuf *pixbuf);
+
+#endif /* __THEME_THUMBNAIL_CACHE_H__ */
@@ -1,3 +1,7 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* memfd_create() */
+#endif
+
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
@@ -10,75 +14,95 @@
 #include <math.h>
 #include <signal.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 #include <unistd.h>
 
 /* We have to #undef this as marco #defines these. */
 #undef _
 #undef N_
 
+#include <glib-unix.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 
 #include "capplet-util.h"
 #include "gtkrc-utils.h"
+#include "theme-thumbnail-cache.h"
 #include "theme-thumbnail.h"
 
-typedef struct {
-  gboolean set;
-  gint thumbnail_width;
-  gint thumbnail_height;
-  GByteArray *data;
-  gchar *theme_name;
-  ThemeThumbnailFunc func;
-  gpointer user_data;
-  GDestroyNotify destroy;
-  GIOChannel *channel;
-  guint watch_id;
-} ThemeThumbnailAsyncData;
-
-static ThemeThumbnailAsyncData async_data;
-
 /* Protocol */
 
-/* Our protocol is pretty simple.  The parent process will write several strings
- * (separated by a '\000'). They are the widget theme, the wm theme, the icon
- * theme, etc.  Then, it will wait for the child to write back the data.  The
- * parent expects ICON_SIZE_WIDTH * ICON_SIZE_HEIGHT * 4 bytes of information.
- * After that, the child is ready for the next theme to render.
+/* The parent talks to each factory worker over a SOCK_SEQPACKET socket pair,
+ * so every frame arrives in one piece.
+ *
+ * A request is a ThumbnailRequestHeader followed by `length` bytes holding
+ * six NUL-terminated strings: the thumbnail type, the widget theme, the color
+ * scheme, the wm theme, the icon theme and the application font.
+ *
+ * The reply is a single ThumbnailResponseHeader.  If the worker managed to
+ * render something, the pixels travel in a shared memory file whose
+ * descriptor is attached to the reply (SCM_RIGHTS); the parent maps it and
+ * wraps it as a GdkPixbuf without copying.
+ *
+ * Both headers carry the request id, so the parent can tell which request a
+ * reply belongs to.  The parent keeps a pool of workers and hands queued
+ * requests to whichever one is idle, so results come back in whatever order
+ * the workers finish them.
+ *
+ * Requests only get that far if the on-disk thumbnail cache doesn't already
+ * have a rendering for the same settings.
  */
 
-enum {
-  READY_FOR_THEME,
-  READING_TYPE,
-  READING_CONTROL_THEME_NAME,
-  READING_GTK_COLOR_SCHEME,
-  READING_WM_THEME_NAME,
-  READING_ICON_THEME_NAME,
-  READING_APPLICATION_FONT,
-  WRITING_PIXBUF_DATA
-};
+typedef struct {
+  guint32 id;
+  guint32 length;
+} ThumbnailRequestHeader;
 
 typedef struct {
-  gint status;
-  GByteArray *type;
-  GByteArray *control_theme_name;
-  GByteArray *gtk_color_scheme;
-  GByteArray *wm_theme_name;
-  GByteArray *icon_theme_name;
-  GByteArray *application_font;
+  guint32 id;
+  gint32 width;
+  gint32 height;
+  gint32 rowstride;
+  gint32 has_alpha;
+} ThumbnailResponseHeader;
+
+#define MAX_REQUEST_SIZE 4096
+
+typedef struct {
+  const gchar *type;
+  const gchar *control_theme_name;
+  const gchar *gtk_color_scheme;
+  const gchar *wm_theme_name;
+  const gchar *icon_theme_name;
+  const gchar *application_font;
 } ThemeThumbnailData;
 
 typedef struct {
-  gchar *thumbnail_type;
-  gpointer theme_info;
+  guint id;
+  gboolean cancelled;
+  gchar *theme_name;
+  gchar *cache_key;
+  GCancellable *cancellable;
+  GByteArray *frame;
   ThemeThumbnailFunc func;
   gpointer user_data;
   GDestroyNotify destroy;
-} ThemeQueueItem;
+} ThemeThumbnailRequest;
 
-static GList *theme_queue = NULL;
+typedef struct {
+  pid_t pid;
+  int fd;
+  guint watch_id;
+  ThemeThumbnailRequest *request;
+} ThemeThumbnailWorker;
 
-static int pipe_to_factory_fd[2];
-static int pipe_from_factory_fd[2];
+static GPtrArray *workers = NULL;
+static GQueue cache_lookups = G_QUEUE_INIT;
+static GQueue pending_requests = G_QUEUE_INIT;
+static guint next_request_id = 1;
 
 #define THUMBNAIL_TYPE_META "meta"
 #define THUMBNAIL_TYPE_GTK "gtk"
@@ -90,6 +114,9 @@ static int pipe_from_factory_fd[2];
 #define MARCO_THUMBNAIL_WIDTH 120
 #define MARCO_THUMBNAIL_HEIGHT 60
 
+#define FACTORY_WORKERS_ENV "MATE_THEME_THUMBNAIL_WORKERS"
+#define MAX_FACTORY_WORKERS 64
+
 static void pixbuf_apply_mask_region(GdkPixbuf *pixbuf,
                                      cairo_region_t *region) {
   gint nchannels, rowstride, w, h;
@@ -117,7 +144,7 @@ static void pixbuf_apply_mask_region(GdkPixbuf *pixbuf,
     }
 }
 
-static GdkPixbuf *create_folder_icon(char *icon_theme_name) {
+static GdkPixbuf *create_folder_icon(const gchar *icon_theme_name) {
   GtkIconTheme *icon_theme;
   GdkPixbuf *folder_icon = NULL;
   GtkIconInfo *folder_icon_info;
@@ -174,21 +201,17 @@ static GdkPixbuf *create_meta_theme_pixbuf(
   int icon_width, icon_height;
   cairo_region_t *region;
 
-  g_object_set(
-      gtk_settings_get_default(), "gtk-theme-name",
-      (char *)theme_thumbnail_data->control_theme_name->data, "gtk-font-name",
-      (char *)theme_thumbnail_data->application_font->data,
-      "gtk-icon-theme-name",
-      (char *)theme_thumbnail_data->icon_theme_name->data, "gtk-color-scheme",
-      (char *)theme_thumbnail_data->gtk_color_scheme->data, NULL);
+  g_object_set(gtk_settings_get_default(), "gtk-theme-name",
+               theme_thumbnail_data->control_theme_name, "gtk-font-name",
+               theme_thumbnail_data->application_font, "gtk-icon-theme-name",
+               theme_thumbnail_data->icon_theme_name, "gtk-color-scheme",
+               theme_thumbnail_data->gtk_color_scheme, NULL);
 
-  theme =
-      meta_theme_load((char *)theme_thumbnail_data->wm_theme_name->data, NULL);
+  theme = meta_theme_load(theme_thumbnail_data->wm_theme_name, NULL);
   if (theme == NULL) return NULL;
 
   /* Represent the icon theme */
-  icon =
-      create_folder_icon((char *)theme_thumbnail_data->icon_theme_name->data);
+  icon = create_folder_icon(theme_thumbnail_data->icon_theme_name);
   icon_width = gdk_pixbuf_get_width(icon);
   icon_height = gdk_pixbuf_get_height(icon);
 
@@ -279,9 +302,8 @@ static GdkPixbuf *create_gtk_theme_pixbuf(
 
   settings = gtk_settings_get_default();
   g_object_set(settings, "gtk-theme-name",
-               (char *)theme_thumbnail_data->control_theme_name->data,
-               "gtk-color-scheme",
-               (char *)theme_thumbnail_data->gtk_color_scheme->data, NULL);
+               theme_thumbnail_data->control_theme_name, "gtk-color-scheme",
+               theme_thumbnail_data->gtk_color_scheme, NULL);
 
   window = gtk_offscreen_window_new();
 
@@ -349,8 +371,7 @@ static GdkPixbuf *create_marco_theme_pixbuf(
   GdkPixbuf *pixbuf, *retval;
   cairo_region_t *region;
 
-  theme =
-      meta_theme_load((char *)theme_thumbnail_data->wm_theme_name->data, NULL);
+  theme = meta_theme_load(theme_thumbnail_data->wm_theme_name, NULL);
   if (theme == NULL) return NULL;
 
   flags = META_FRAME_ALLOWS_DELETE | META_FRAME_ALLOWS_MENU |
@@ -406,417 +427,422 @@ static GdkPixbuf *create_marco_theme_pixbuf(
 
 static GdkPixbuf *create_icon_theme_pixbuf(
     ThemeThumbnailData *theme_thumbnail_data) {
-  return create_folder_icon(
-      (char *)theme_thumbnail_data->icon_theme_name->data);
-}
-
-static void handle_bytes(const guint8 *buffer, gint bytes_read,
-                         ThemeThumbnailData *theme_thumbnail_data) {
-  const guint8 *ptr;
-  ptr = buffer;
-
-  while (bytes_read > 0) {
-    guint8 *nil;
-
-    switch (theme_thumbnail_data->status) {
-      case READY_FOR_THEME:
-        theme_thumbnail_data->status = READING_TYPE;
-        /* fall through */
-      case READING_TYPE:
-        nil = memchr(ptr, '\000', bytes_read);
-        if (nil == NULL) {
-          g_byte_array_append(theme_thumbnail_data->type, ptr, bytes_read);
-          bytes_read = 0;
-        } else {
-          g_byte_array_append(theme_thumbnail_data->type, ptr, nil - ptr + 1);
-          bytes_read -= (nil - ptr + 1);
-          ptr = nil + 1;
-          theme_thumbnail_data->status = READING_CONTROL_THEME_NAME;
-        }
-        break;
-
-      case READING_CONTROL_THEME_NAME:
-        nil = memchr(ptr, '\000', bytes_read);
-        if (nil == NULL) {
-          g_byte_array_append(theme_thumbnail_data->control_theme_name, ptr,
-                              bytes_read);
-          bytes_read = 0;
-        } else {
-          g_byte_array_append(theme_thumbnail_data->control_theme_name, ptr,
-                              nil - ptr + 1);
-          bytes_read -= (nil - ptr + 1);
-          ptr = nil + 1;
-          theme_thumbnail_data->status = READING_GTK_COLOR_SCHEME;
-        }
-        break;
-
-      case READING_GTK_COLOR_SCHEME:
-        nil = memchr(ptr, '\000', bytes_read);
-        if (nil == NULL) {
-          g_byte_array_append(theme_thumbnail_data->gtk_color_scheme, ptr,
-                              bytes_read);
-          bytes_read = 0;
-        } else {
-          g_byte_array_append(theme_thumbnail_data->gtk_color_scheme, ptr,
-                              nil - ptr + 1);
-          bytes_read -= (nil - ptr + 1);
-          ptr = nil + 1;
-          theme_thumbnail_data->status = READING_WM_THEME_NAME;
-        }
-        break;
-
-      case READING_WM_THEME_NAME:
-        nil = memchr(ptr, '\000', bytes_read);
-        if (nil == NULL) {
-          g_byte_array_append(theme_thumbnail_data->wm_theme_name, ptr,
-                              bytes_read);
-          bytes_read = 0;
-        } else {
-          g_byte_array_append(theme_thumbnail_data->wm_theme_name, ptr,
-                              nil - ptr + 1);
-          bytes_read -= (nil - ptr + 1);
-          ptr = nil + 1;
-          theme_thumbnail_data->status = READING_ICON_THEME_NAME;
-        }
-        break;
-
-      case READING_ICON_THEME_NAME:
-        nil = memchr(ptr, '\000', bytes_read);
-        if (nil == NULL) {
-          g_byte_array_append(theme_thumbnail_data->icon_theme_name, ptr,
-                              bytes_read);
-          bytes_read = 0;
-        } else {
-          g_byte_array_append(theme_thumbnail_data->icon_theme_name, ptr,
-                              nil - ptr + 1);
-          bytes_read -= (nil - ptr + 1);
-          ptr = nil + 1;
-          theme_thumbnail_data->status = READING_APPLICATION_FONT;
-        }
-        break;
-
-      case READING_APPLICATION_FONT:
-        nil = memchr(ptr, '\000', bytes_read);
-        if (nil == NULL) {
-          g_byte_array_append(theme_thumbnail_data->application_font, ptr,
-                              bytes_read);
-          bytes_read = 0;
-        } else {
-          g_byte_array_append(theme_thumbnail_data->application_font, ptr,
-                              nil - ptr + 1);
-          bytes_read -= (nil - ptr + 1);
-          ptr = nil + 1;
-          theme_thumbnail_data->status = WRITING_PIXBUF_DATA;
-        }
-        break;
-
-      default:
-        g_assert_not_reached();
-    }
+  return create_folder_icon(theme_thumbnail_data->icon_theme_name);
+}
+
+
+/* An anonymous file to hand the pixels over in */
+static int create_pixel_buffer(gsize size) {
+  int fd;
+
+#ifdef HAVE_MEMFD_CREATE
+  fd = memfd_create("theme-thumbnail", MFD_CLOEXEC);
+#else
+  gchar *path = NULL;
+
+  fd = g_file_open_tmp("theme-thumbnail-XXXXXX", &path, NULL);
+  if (fd != -1) g_unlink(path);
+  g_free(path);
+#endif
+
+  if (fd == -1) return -1;
+
+  if (ftruncate(fd, size) == -1) {
+    close(fd);
+    return -1;
   }
+
+  return fd;
 }
 
-static gboolean message_from_capplet(GIOChannel *source, GIOCondition condition,
-                                     gpointer data) {
-  gchar buffer[1024];
-  GIOStatus status;
-  gsize bytes_read;
-  ThemeThumbnailData *theme_thumbnail_data;
-
-  theme_thumbnail_data = (ThemeThumbnailData *)data;
-  status = g_io_channel_read_chars(source, buffer, 1024, &bytes_read, NULL);
-
-  switch (status) {
-    case G_IO_STATUS_NORMAL:
-      handle_bytes((guint8 *)buffer, bytes_read, theme_thumbnail_data);
-
-      if (theme_thumbnail_data->status == WRITING_PIXBUF_DATA) {
-        GdkPixbuf *pixbuf = NULL;
-        gint i, rowstride;
-        guchar *pixels;
-        gint width, height;
-        const gchar *type = (const gchar *)theme_thumbnail_data->type->data;
-
-        if (!strcmp(type, THUMBNAIL_TYPE_META))
-          pixbuf = create_meta_theme_pixbuf(theme_thumbnail_data);
-        else if (!strcmp(type, THUMBNAIL_TYPE_GTK))
-          pixbuf = create_gtk_theme_pixbuf(theme_thumbnail_data);
-        else if (!strcmp(type, THUMBNAIL_TYPE_MARCO))
-          pixbuf = create_marco_theme_pixbuf(theme_thumbnail_data);
-        else if (!strcmp(type, THUMBNAIL_TYPE_ICON))
-          pixbuf = create_icon_theme_pixbuf(theme_thumbnail_data);
-        else
-          g_assert_not_reached();
-
-        if (pixbuf == NULL) {
-          width = height = rowstride = 0;
-          pixels = NULL;
-        } else {
-          width = gdk_pixbuf_get_width(pixbuf);
-          height = gdk_pixbuf_get_height(pixbuf);
-          rowstride = gdk_pixbuf_get_rowstride(pixbuf);
-          pixels = gdk_pixbuf_get_pixels(pixbuf);
-        }
-
-        /* Write the pixbuf's size */
-
-        if (write(pipe_from_factory_fd[1], &width, sizeof(width)) == -1)
-          perror("write error");
-
-        if (write(pipe_from_factory_fd[1], &height, sizeof(height)) == -1)
-          perror("write error");
-
-        for (i = 0; i < height; i++) {
-          if (write(pipe_from_factory_fd[1], pixels + rowstride * i,
-                    width * gdk_pixbuf_get_n_channels(pixbuf)) == -1)
-            perror("write error");
-        }
-
-        if (pixbuf) g_object_unref(pixbuf);
-        g_byte_array_set_size(theme_thumbnail_data->type, 0);
-        g_byte_array_set_size(theme_thumbnail_data->control_theme_name, 0);
-        g_byte_array_set_size(theme_thumbnail_data->gtk_color_scheme, 0);
-        g_byte_array_set_size(theme_thumbnail_data->wm_theme_name, 0);
-        g_byte_array_set_size(theme_thumbnail_data->icon_theme_name, 0);
-        g_byte_array_set_size(theme_thumbnail_data->application_font, 0);
-        theme_thumbnail_data->status = READY_FOR_THEME;
-      }
-      return TRUE;
+static void send_thumbnail_response(int fd, guint32 id, GdkPixbuf *pixbuf) {
+  ThumbnailResponseHeader header = {id, 0, 0, 0, 0};
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  struct iovec iov = {&header, sizeof(header)};
+  struct msghdr msg = {0};
+  struct cmsghdr *cmsg;
+  int buffer_fd = -1;
+
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  if (pixbuf != NULL) {
+    gsize size = (gsize)gdk_pixbuf_get_rowstride(pixbuf) *
+                 gdk_pixbuf_get_height(pixbuf);
+    guchar *pixels = MAP_FAILED;
+
+    buffer_fd = create_pixel_buffer(size);
+    if (buffer_fd != -1)
+      pixels = mmap(NULL, size, PROT_WRITE, MAP_SHARED, buffer_fd, 0);
+
+    if (pixels != MAP_FAILED) {
+      memcpy(pixels, gdk_pixbuf_read_pixels(pixbuf),
+             gdk_pixbuf_get_byte_length(pixbuf));
+      munmap(pixels, size);
+
+      header.width = gdk_pixbuf_get_width(pixbuf);
+      header.height = gdk_pixbuf_get_height(pixbuf);
+      header.rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+      header.has_alpha = gdk_pixbuf_get_has_alpha(pixbuf);
+
+      msg.msg_control = control.buf;
+      msg.msg_controllen = sizeof(control.buf);
+      cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+      memcpy(CMSG_DATA(cmsg), &buffer_fd, sizeof(int));
+    } else {
+      perror("thumbnail buffer error");
+    }
+  }
 
-    case G_IO_STATUS_AGAIN:
-      return TRUE;
+  if (sendmsg(fd, &msg, MSG_NOSIGNAL) == -1) perror("write error");
 
-    case G_IO_STATUS_EOF:
-    case G_IO_STATUS_ERROR:
-      _exit(0);
+  if (buffer_fd != -1) close(buffer_fd);
+}
 
-    default:
-      g_assert_not_reached();
+/* Splits the request payload into its strings; they keep pointing into the
+ * receive buffer. */
+static gboolean parse_thumbnail_request(const gchar *payload, gsize length,
+                                        ThemeThumbnailData *data) {
+  const gchar **fields[] = {&data->type,
+                            &data->control_theme_name,
+                            &data->gtk_color_scheme,
+                            &data->wm_theme_name,
+                            &data->icon_theme_name,
+                            &data->application_font};
+  const gchar *end = payload + length;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(fields); i++) {
+    const gchar *nil = memchr(payload, '\000', end - payload);
+
+    if (nil == NULL) return FALSE;
+
+    *fields[i] = payload;
+    payload = nil + 1;
   }
 
   return TRUE;
 }
 
-static void generate_next_in_queue(void) {
-  ThemeQueueItem *item;
+static gboolean message_from_capplet(gint fd, GIOCondition condition,
+                                     gpointer user_data) {
+  gchar buffer[MAX_REQUEST_SIZE];
+  ThumbnailRequestHeader header;
+  ThemeThumbnailData data;
+  GdkPixbuf *pixbuf = NULL;
+  ssize_t bytes_read;
+
+  bytes_read = recv(fd, buffer, sizeof(buffer), 0);
 
-  if (theme_queue == NULL) return;
+  if (bytes_read == -1 && (errno == EAGAIN || errno == EINTR)) return TRUE;
 
-  item = theme_queue->data;
-  theme_queue = g_list_delete_link(theme_queue, g_list_first(theme_queue));
+  /* The capplet went away */
+  if (bytes_read <= 0) _exit(0);
 
-  if (!strcmp(item->thumbnail_type, THUMBNAIL_TYPE_META))
-    generate_meta_theme_thumbnail_async((MateThemeMetaInfo *)item->theme_info,
-                                        item->func, item->user_data,
-                                        item->destroy);
-  else if (!strcmp(item->thumbnail_type, THUMBNAIL_TYPE_GTK))
-    generate_gtk_theme_thumbnail_async((MateThemeInfo *)item->theme_info,
-                                       item->func, item->user_data,
-                                       item->destroy);
-  else if (!strcmp(item->thumbnail_type, THUMBNAIL_TYPE_MARCO))
-    generate_marco_theme_thumbnail_async((MateThemeInfo *)item->theme_info,
-                                         item->func, item->user_data,
-                                         item->destroy);
-  else if (!strcmp(item->thumbnail_type, THUMBNAIL_TYPE_ICON))
-    generate_icon_theme_thumbnail_async((MateThemeIconInfo *)item->theme_info,
-                                        item->func, item->user_data,
-                                        item->destroy);
+  if (bytes_read < (ssize_t)sizeof(header)) {
+    g_warning("Truncated thumbnail request");
+    return TRUE;
+  }
 
-  g_free(item);
+  memcpy(&header, buffer, sizeof(header));
+
+  if (header.length != bytes_read - sizeof(header) ||
+      !parse_thumbnail_request(buffer + sizeof(header), header.length,
+                               &data)) {
+    g_warning("Malformed thumbnail request %u", header.id);
+    send_thumbnail_response(fd, header.id, NULL);
+    return TRUE;
+  }
+
+  if (!strcmp(data.type, THUMBNAIL_TYPE_META))
+    pixbuf = create_meta_theme_pixbuf(&data);
+  else if (!strcmp(data.type, THUMBNAIL_TYPE_GTK))
+    pixbuf = create_gtk_theme_pixbuf(&data);
+  else if (!strcmp(data.type, THUMBNAIL_TYPE_MARCO))
+    pixbuf = create_marco_theme_pixbuf(&data);
+  else if (!strcmp(data.type, THUMBNAIL_TYPE_ICON))
+    pixbuf = create_icon_theme_pixbuf(&data);
+  else
+    g_warning("Unknown thumbnail type %s", data.type);
+
+  send_thumbnail_response(fd, header.id, pixbuf);
+
+  if (pixbuf) g_object_unref(pixbuf);
+
+  return TRUE;
 }
 
-static gboolean message_from_child(GIOChannel *source, GIOCondition condition,
-                                   gpointer data) {
-  gchar buffer[1024];
-  GIOStatus status;
-  gsize bytes_read;
+static void theme_thumbnail_factory_main(int fd, int argc, char *argv[]) {
+  gtk_init(&argc, &argv);
 
-  if (async_data.set == FALSE) return TRUE;
+  g_unix_fd_add(fd, G_IO_IN | G_IO_HUP, message_from_capplet, NULL);
 
-  if (condition == G_IO_HUP) return FALSE;
+  gtk_main();
+  _exit(0);
+}
 
-  status = g_io_channel_read_chars(source, buffer, 1024, &bytes_read, NULL);
-  switch (status) {
-    case G_IO_STATUS_NORMAL:
-      g_byte_array_append(async_data.data, (guchar *)buffer, bytes_read);
+static void theme_thumbnail_request_free(ThemeThumbnailRequest *request) {
+  g_free(request->theme_name);
+  g_free(request->cache_key);
+  g_object_unref(request->cancellable);
+  g_byte_array_free(request->frame, TRUE);
+  g_free(request);
+}
 
-      if (async_data.thumbnail_width == -1 &&
-          async_data.data->len >= 2 * sizeof(gint)) {
-        async_data.thumbnail_width = *((gint *)async_data.data->data);
-        async_data.thumbnail_height = *(((gint *)async_data.data->data) + 1);
-        g_byte_array_remove_range(async_data.data, 0, 2 * sizeof(gint));
-      }
+static void theme_thumbnail_request_finish(ThemeThumbnailRequest *request,
+                                           GdkPixbuf *pixbuf) {
+  /* callback function needs to ref the pixbuf if it wants to keep it */
+  if (!request->cancelled)
+    (*request->func)(pixbuf, request->theme_name, request->user_data);
 
-      if (async_data.thumbnail_width >= 0 &&
-          async_data.data->len ==
-              async_data.thumbnail_width * async_data.thumbnail_height * 4) {
-        GdkPixbuf *pixbuf = NULL;
-
-        if (async_data.thumbnail_width > 0) {
-          gchar *pixels;
-          gint i, rowstride;
-
-          pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8,
-                                  async_data.thumbnail_width,
-                                  async_data.thumbnail_height);
-          pixels = (gchar *)gdk_pixbuf_get_pixels(pixbuf);
-          rowstride = gdk_pixbuf_get_rowstride(pixbuf);
-
-          for (i = 0; i < async_data.thumbnail_height; ++i)
-            memcpy(pixels + rowstride * i,
-                   async_data.data->data + 4 * async_data.thumbnail_width * i,
-                   async_data.thumbnail_width * 4);
-        }
-
-        /* callback function needs to ref the pixbuf if it wants to keep it */
-        (*async_data.func)(pixbuf, async_data.theme_name, async_data.user_data);
-
-        if (async_data.destroy) (*async_data.destroy)(async_data.user_data);
-
-        if (pixbuf) g_object_unref(pixbuf);
-
-        /* Clean up async_data */
-        g_free(async_data.theme_name);
-        g_source_remove(async_data.watch_id);
-        g_io_channel_unref(async_data.channel);
-
-        /* reset async_data */
-        async_data.thumbnail_width = -1;
-        async_data.thumbnail_height = -1;
-        async_data.theme_name = NULL;
-        async_data.channel = NULL;
-        async_data.func = NULL;
-        async_data.user_data = NULL;
-        async_data.destroy = NULL;
-        async_data.set = FALSE;
-        g_byte_array_set_size(async_data.data, 0);
-
-        generate_next_in_queue();
-      }
-      return TRUE;
+  if (request->destroy) (*request->destroy)(request->user_data);
+
+  theme_thumbnail_request_free(request);
+}
+
+static void theme_thumbnail_worker_free(ThemeThumbnailWorker *worker) {
+  if (worker->watch_id) g_source_remove(worker->watch_id);
+
+  close(worker->fd);
+  g_free(worker);
+}
 
-    case G_IO_STATUS_AGAIN:
-      return TRUE;
+static void append_request_string(GByteArray *frame, const gchar *str) {
+  if (str == NULL) str = "";
 
-    case G_IO_STATUS_EOF:
-    case G_IO_STATUS_ERROR:
-      return FALSE;
+  g_byte_array_append(frame, (const guint8 *)str, strlen(str) + 1);
+}
 
-    default:
-      g_assert_not_reached();
+static GByteArray *build_thumbnail_request(
+    guint32 id, const gchar *thumbnail_type, const gchar *gtk_theme_name,
+    const gchar *gtk_color_scheme, const gchar *marco_theme_name,
+    const gchar *icon_theme_name, const gchar *application_font) {
+  ThumbnailRequestHeader header = {id, 0};
+  GByteArray *frame;
+
+  frame = g_byte_array_sized_new(256);
+  g_byte_array_append(frame, (const guint8 *)&header, sizeof(header));
+  append_request_string(frame, thumbnail_type);
+  append_request_string(frame, gtk_theme_name);
+  append_request_string(frame, gtk_color_scheme);
+  append_request_string(frame, marco_theme_name);
+  append_request_string(frame, icon_theme_name);
+  append_request_string(frame,
+                        application_font ? application_font : "Sans 10");
+
+  if (frame->len > MAX_REQUEST_SIZE) {
+    g_warning("Thumbnail request for %s is too large", thumbnail_type);
+    g_byte_array_free(frame, TRUE);
+    return NULL;
   }
 
-  return TRUE;
+  header.length = frame->len - sizeof(header);
+  memcpy(frame->data, &header, sizeof(header));
+
+  return frame;
 }
 
-static void send_thumbnail_request(gchar *thumbnail_type, gchar *gtk_theme_name,
-                                   gchar *gtk_color_scheme,
-                                   gchar *marco_theme_name,
-                                   gchar *icon_theme_name,
-                                   gchar *application_font) {
-  if (write(pipe_to_factory_fd[1], thumbnail_type,
-            strlen(thumbnail_type) + 1) == -1)
+static gboolean send_thumbnail_request(int fd, GByteArray *frame) {
+  if (send(fd, frame->data, frame->len, MSG_NOSIGNAL) != (ssize_t)frame->len) {
     perror("write error");
-
-  if (gtk_theme_name) {
-    if (write(pipe_to_factory_fd[1], gtk_theme_name,
-              strlen(gtk_theme_name) + 1) == -1)
-      perror("write error");
-  } else {
-    if (write(pipe_to_factory_fd[1], "", 1) == -1) perror("write error");
+    return FALSE;
   }
 
-  if (gtk_color_scheme) {
-    if (write(pipe_to_factory_fd[1], gtk_color_scheme,
-              strlen(gtk_color_scheme) + 1) == -1)
-      perror("write error");
-  } else {
-    if (write(pipe_to_factory_fd[1], "", 1) == -1) perror("write error");
+  return TRUE;
+}
+
+static void unmap_pixels(guchar *pixels, gpointer size) {
+  munmap(pixels, GPOINTER_TO_SIZE(size));
+}
+
+/* Reads one reply from a worker.  Returns FALSE if the worker is gone. */
+static gboolean receive_thumbnail(int fd, guint32 *id, GdkPixbuf **pixbuf) {
+  ThumbnailResponseHeader header;
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  struct iovec iov = {&header, sizeof(header)};
+  struct msghdr msg = {0};
+  struct cmsghdr *cmsg;
+  ssize_t bytes_read;
+  int buffer_fd = -1;
+
+  *pixbuf = NULL;
+
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  do {
+    bytes_read = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+  } while (bytes_read == -1 && errno == EINTR);
+
+  if (bytes_read <= 0) return FALSE;
+
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+      memcpy(&buffer_fd, CMSG_DATA(cmsg), sizeof(int));
+
+  if (bytes_read != sizeof(header)) {
+    g_warning("Malformed thumbnail reply");
+    if (buffer_fd != -1) close(buffer_fd);
+    return FALSE;
   }
 
-  if (marco_theme_name) {
-    if (write(pipe_to_factory_fd[1], marco_theme_name,
-              strlen(marco_theme_name) + 1) == -1)
-      perror("write error");
-  } else {
-    if (write(pipe_to_factory_fd[1], "", 1) == -1) perror("write error");
+  *id = header.id;
+
+  if (buffer_fd != -1) {
+    gsize size = (gsize)header.rowstride * header.height;
+    gint n_channels = header.has_alpha ? 4 : 3;
+    struct stat st;
+
+    if (header.width > 0 && header.height > 0 &&
+        header.rowstride >= header.width * n_channels &&
+        fstat(buffer_fd, &st) == 0 && (gsize)st.st_size >= size) {
+      guchar *pixels =
+          mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, buffer_fd, 0);
+
+      if (pixels != MAP_FAILED)
+        *pixbuf = gdk_pixbuf_new_from_data(
+            pixels, GDK_COLORSPACE_RGB, header.has_alpha, 8, header.width,
+            header.height, header.rowstride, unmap_pixels,
+            GSIZE_TO_POINTER(size));
+    }
+
+    close(buffer_fd);
   }
 
-  if (icon_theme_name) {
-    if (write(pipe_to_factory_fd[1], icon_theme_name,
-              strlen(icon_theme_name) + 1) == -1)
-      perror("write error");
-  } else {
-    if (write(pipe_to_factory_fd[1], "", 1) == -1) perror("write error");
+  return TRUE;
+}
+
+static void theme_thumbnail_worker_lost(ThemeThumbnailWorker *worker) {
+  ThemeThumbnailRequest *request = worker->request;
+
+  g_warning("Theme thumbnail factory %d went away", (gint)worker->pid);
+
+  worker->request = NULL;
+  g_ptr_array_remove(workers, worker);
+
+  if (request != NULL) theme_thumbnail_request_finish(request, NULL);
+
+  /* Nobody is left to render whatever is still queued */
+  if (workers->len == 0) {
+    while (!g_queue_is_empty(&pending_requests))
+      theme_thumbnail_request_finish(g_queue_pop_head(&pending_requests),
+                                     NULL);
   }
+}
 
-  if (application_font) {
-    if (write(pipe_to_factory_fd[1], application_font,
-              strlen(application_font) + 1) == -1)
-      perror("write error");
-  } else {
-    if (write(pipe_to_factory_fd[1], "Sans 10", strlen("Sans 10") + 1) == -1)
-      perror("write error");
+static void theme_thumbnail_dispatch(void) {
+  guint i;
+
+  if (workers == NULL) return;
+
+  for (i = 0; i < workers->len && !g_queue_is_empty(&pending_requests);) {
+    ThemeThumbnailWorker *worker = g_ptr_array_index(workers, i);
+    ThemeThumbnailRequest *request;
+
+    if (worker->request != NULL) {
+      i++;
+      continue;
+    }
+
+    request = g_queue_pop_head(&pending_requests);
+
+    if (send_thumbnail_request(worker->fd, request->frame)) {
+      worker->request = request;
+      i++;
+    } else {
+      /* hand it to the next worker; this one is dropped from the array */
+      g_queue_push_head(&pending_requests, request);
+      theme_thumbnail_worker_lost(worker);
+    }
   }
 }
 
-static GdkPixbuf *read_pixbuf(void) {
-  gint bytes_read, i, j = 0;
-  gint size[2];
+static gboolean message_from_child(gint fd, GIOCondition condition,
+                                   gpointer data) {
+  ThemeThumbnailWorker *worker = (ThemeThumbnailWorker *)data;
+  ThemeThumbnailRequest *request;
   GdkPixbuf *pixbuf;
-  gint rowstride;
-  guchar *pixels;
+  guint32 id;
 
-  do {
-    bytes_read =
-        read(pipe_from_factory_fd[0], ((guint8 *)size) + j, 2 * sizeof(gint));
-    if (bytes_read == 0) goto eof;
-    j += bytes_read;
-  } while (j < 2 * sizeof(gint));
+  if (condition == G_IO_HUP || !receive_thumbnail(fd, &id, &pixbuf)) {
+    /* returning FALSE removes the watch for us */
+    worker->watch_id = 0;
+    theme_thumbnail_worker_lost(worker);
+    return FALSE;
+  }
 
-  if (size[0] <= 0 || size[1] <= 0) return NULL;
+  request = worker->request;
 
-  pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, size[0], size[1]);
-  rowstride = gdk_pixbuf_get_rowstride(pixbuf);
-  pixels = gdk_pixbuf_get_pixels(pixbuf);
+  if (request == NULL || request->id != id) {
+    g_warning("Unexpected thumbnail reply %u", id);
+    if (pixbuf) g_object_unref(pixbuf);
+    return TRUE;
+  }
 
-  for (i = 0; i < size[1]; i++) {
-    j = 0;
+  /* reset the worker before running the callback, which may well queue up
+   * more work */
+  worker->request = NULL;
 
-    do {
-      bytes_read = read(pipe_from_factory_fd[0], pixels + rowstride * i + j,
-                        size[0] * gdk_pixbuf_get_n_channels(pixbuf) - j);
+  /* even if nobody wants it anymore, it was expensive enough to keep */
+  if (pixbuf) theme_thumbnail_cache_store(request->cache_key, pixbuf);
 
-      if (bytes_read > 0)
-        j += bytes_read;
-      else if (bytes_read == 0) {
-        g_object_unref(pixbuf);
-        goto eof;
-      }
-    } while (j < size[0] * gdk_pixbuf_get_n_channels(pixbuf));
-  }
+  theme_thumbnail_request_finish(request, pixbuf);
 
-  return pixbuf;
+  if (pixbuf) g_object_unref(pixbuf);
+
+  theme_thumbnail_dispatch();
 
-eof:
-  g_warning("Received EOF while reading thumbnail");
-  close(pipe_to_factory_fd[1]);
-  pipe_to_factory_fd[1] = 0;
-  close(pipe_from_factory_fd[0]);
-  pipe_from_factory_fd[0] = 0;
-  return NULL;
+  return TRUE;
 }
 
 static GdkPixbuf *generate_theme_thumbnail(
-    gchar *thumbnail_type, gchar *gtk_theme_name, gchar *gtk_color_scheme,
-    gchar *marco_theme_name, gchar *icon_theme_name, gchar *application_font) {
-  if (async_data.set || !pipe_to_factory_fd[1] || !pipe_from_factory_fd[0])
-    return NULL;
+    const gchar *thumbnail_type, const gchar *gtk_theme_name,
+    const gchar *gtk_color_scheme, const gchar *marco_theme_name,
+    const gchar *icon_theme_name, const gchar *application_font) {
+  ThemeThumbnailWorker *worker = NULL;
+  GByteArray *frame;
+  GdkPixbuf *pixbuf;
+  gboolean sent;
+  guint32 id;
+  guint i;
 
-  send_thumbnail_request(thumbnail_type, gtk_theme_name, gtk_color_scheme,
-                         marco_theme_name, icon_theme_name, application_font);
+  if (workers == NULL) return NULL;
+
+  for (i = 0; i < workers->len && worker == NULL; i++) {
+    ThemeThumbnailWorker *w = g_ptr_array_index(workers, i);
+
+    if (w->request == NULL) worker = w;
+  }
 
-  return read_pixbuf();
+  if (worker == NULL) return NULL;
+
+  /* synchronous requests don't take an id from the async ones */
+  frame = build_thumbnail_request(0, thumbnail_type, gtk_theme_name,
+                                  gtk_color_scheme, marco_theme_name,
+                                  icon_theme_name, application_font);
+  if (frame == NULL) return NULL;
+
+  sent = send_thumbnail_request(worker->fd, frame);
+  g_byte_array_free(frame, TRUE);
+
+  if (!sent || !receive_thumbnail(worker->fd, &id, &pixbuf)) {
+    g_warning("Received EOF while reading thumbnail");
+    theme_thumbnail_worker_lost(worker);
+    return NULL;
+  }
+
+  return pixbuf;
 }
 
 GdkPixbuf *generate_meta_theme_thumbnail(MateThemeMetaInfo *theme_info) {
@@ -827,13 +853,16 @@ GdkPixbuf *generate_meta_theme_thumbnail(MateThemeMetaInfo *theme_info) {
 }
 
 GdkPixbuf *generate_gtk_theme_thumbnail(MateThemeInfo *theme_info) {
+  GdkPixbuf *pixbuf;
   gchar *scheme;
 
   scheme = gtkrc_get_color_scheme_for_theme(theme_info->name);
 
-  return generate_theme_thumbnail(THUMBNAIL_TYPE_GTK, theme_info->name, scheme,
-                                  NULL, NULL, NULL);
+  pixbuf = generate_theme_thumbnail(THUMBNAIL_TYPE_GTK, theme_info->name,
+                                    scheme, NULL, NULL, NULL);
   g_free(scheme);
+
+  return pixbuf;
 }
 
 GdkPixbuf *generate_marco_theme_thumbnail(MateThemeInfo *theme_info) {
@@ -846,147 +875,240 @@ GdkPixbuf *generate_icon_theme_thumbnail(MateThemeIconInfo *theme_info) {
                                   theme_info->name, NULL);
 }
 
-static void generate_theme_thumbnail_async(
-    gpointer theme_info, gchar *theme_name, gchar *thumbnail_type,
-    gchar *gtk_theme_name, gchar *gtk_color_scheme, gchar *marco_theme_name,
-    gchar *icon_theme_name, gchar *application_font, ThemeThumbnailFunc func,
-    gpointer user_data, GDestroyNotify destroy) {
-  if (async_data.set) {
-    ThemeQueueItem *item = g_new0(ThemeQueueItem, 1);
-
-    item->thumbnail_type = thumbnail_type;
-    item->theme_info = theme_info;
-    item->func = func;
-    item->user_data = user_data;
-    item->destroy = destroy;
+static void cache_lookup_done(GObject *source, GAsyncResult *result,
+                              gpointer user_data) {
+  ThemeThumbnailRequest *request = user_data;
+  GdkPixbuf *pixbuf;
 
-    theme_queue = g_list_append(theme_queue, item);
+  pixbuf = theme_thumbnail_cache_lookup_finish(result, NULL);
+  g_queue_remove(&cache_lookups, request);
 
+  if (pixbuf != NULL || request->cancelled || workers->len == 0) {
+    theme_thumbnail_request_finish(request, pixbuf);
+    if (pixbuf) g_object_unref(pixbuf);
     return;
   }
 
-  if (!pipe_to_factory_fd[1] || !pipe_from_factory_fd[0]) {
+  g_queue_push_tail(&pending_requests, request);
+  theme_thumbnail_dispatch();
+}
+
+static guint generate_theme_thumbnail_async(
+    gchar *theme_name, const gchar *thumbnail_type, const gchar *gtk_theme_name,
+    const gchar *gtk_color_scheme, const gchar *marco_theme_name,
+    const gchar *icon_theme_name, const gchar *application_font,
+    ThemeThumbnailFunc func, gpointer user_data, GDestroyNotify destroy) {
+  ThemeThumbnailRequest *request;
+  GByteArray *frame = NULL;
+  guint id;
+
+  id = next_request_id++;
+  if (next_request_id == 0) next_request_id = 1;
+
+  if (workers != NULL && workers->len > 0)
+    frame = build_thumbnail_request(id, thumbnail_type, gtk_theme_name,
+                                    gtk_color_scheme, marco_theme_name,
+                                    icon_theme_name, application_font);
+
+  if (frame == NULL) {
     (*func)(NULL, theme_name, user_data);
 
     if (destroy) {
       (*destroy)(user_data);
     }
 
-    return;
-  }
-
-  if (async_data.channel == NULL) {
-    async_data.channel = g_io_channel_unix_new(pipe_from_factory_fd[0]);
-
-    g_io_channel_set_flags(
-        async_data.channel,
-        g_io_channel_get_flags(async_data.channel) | G_IO_FLAG_NONBLOCK, NULL);
-    g_io_channel_set_encoding(async_data.channel, NULL, NULL);
-
-    async_data.watch_id = g_io_add_watch(async_data.channel, G_IO_IN | G_IO_HUP,
-                                         message_from_child, NULL);
+    return 0;
   }
 
-  async_data.set = TRUE;
-  async_data.thumbnail_width = -1;
-  async_data.thumbnail_height = -1;
-  async_data.theme_name = g_strdup(theme_name);
-  async_data.func = func;
-  async_data.user_data = user_data;
-  async_data.destroy = destroy;
+  request = g_new0(ThemeThumbnailRequest, 1);
+  request->id = id;
+  request->theme_name = g_strdup(theme_name);
+  request->cache_key = theme_thumbnail_cache_key(
+      thumbnail_type, gtk_theme_name, gtk_color_scheme, marco_theme_name,
+      icon_theme_name, application_font);
+  request->cancellable = g_cancellable_new();
+  request->frame = frame;
+  request->func = func;
+  request->user_data = user_data;
+  request->destroy = destroy;
+
+  g_queue_push_tail(&cache_lookups, request);
+  theme_thumbnail_cache_lookup_async(request->cache_key, request->cancellable,
+                                     cache_lookup_done, request);
+
+  return request->id;
+}
 
-  send_thumbnail_request(thumbnail_type, gtk_theme_name, gtk_color_scheme,
-                         marco_theme_name, icon_theme_name, application_font);
+guint generate_meta_theme_thumbnail_async(MateThemeMetaInfo *theme_info,
+                                          ThemeThumbnailFunc func,
+                                          gpointer user_data,
+                                          GDestroyNotify destroy) {
+  return generate_theme_thumbnail_async(
+      theme_info->name, THUMBNAIL_TYPE_META, theme_info->gtk_theme_name,
+      theme_info->gtk_color_scheme, theme_info->marco_theme_name,
+      theme_info->icon_theme_name, theme_info->application_font, func,
+      user_data, destroy);
 }
 
-void generate_meta_theme_thumbnail_async(MateThemeMetaInfo *theme_info,
+guint generate_gtk_theme_thumbnail_async(MateThemeInfo *theme_info,
                                          ThemeThumbnailFunc func,
                                          gpointer user_data,
                                          GDestroyNotify destroy) {
-  generate_theme_thumbnail_async(
-      theme_info, theme_info->name, THUMBNAIL_TYPE_META,
-      theme_info->gtk_theme_name, theme_info->gtk_color_scheme,
-      theme_info->marco_theme_name, theme_info->icon_theme_name,
-      theme_info->application_font, func, user_data, destroy);
-}
-
-void generate_gtk_theme_thumbnail_async(MateThemeInfo *theme_info,
-                                        ThemeThumbnailFunc func,
-                                        gpointer user_data,
-                                        GDestroyNotify destroy) {
   gchar *scheme = gtkrc_get_color_scheme_for_theme(theme_info->name);
+  guint id;
 
-  generate_theme_thumbnail_async(theme_info, theme_info->name,
-                                 THUMBNAIL_TYPE_GTK, theme_info->name, scheme,
-                                 NULL, NULL, NULL, func, user_data, destroy);
+  id = generate_theme_thumbnail_async(theme_info->name, THUMBNAIL_TYPE_GTK,
+                                      theme_info->name, scheme, NULL, NULL,
+                                      NULL, func, user_data, destroy);
 
   g_free(scheme);
+
+  return id;
 }
 
-void generate_marco_theme_thumbnail_async(MateThemeInfo *theme_info,
+guint generate_marco_theme_thumbnail_async(MateThemeInfo *theme_info,
+                                           ThemeThumbnailFunc func,
+                                           gpointer user_data,
+                                           GDestroyNotify destroy) {
+  return generate_theme_thumbnail_async(
+      theme_info->name, THUMBNAIL_TYPE_MARCO, NULL, NULL, theme_info->name,
+      NULL, NULL, func, user_data, destroy);
+}
+
+guint generate_icon_theme_thumbnail_async(MateThemeIconInfo *theme_info,
                                           ThemeThumbnailFunc func,
                                           gpointer user_data,
                                           GDestroyNotify destroy) {
-  generate_theme_thumbnail_async(
-      theme_info, theme_info->name, THUMBNAIL_TYPE_MARCO, NULL, NULL,
-      theme_info->name, NULL, NULL, func, user_data, destroy);
+  return generate_theme_thumbnail_async(
+      theme_info->name, THUMBNAIL_TYPE_ICON, NULL, NULL, NULL,
+      theme_info->name, NULL, func, user_data, destroy);
 }
 
-void generate_icon_theme_thumbnail_async(MateThemeIconInfo *theme_info,
-                                         ThemeThumbnailFunc func,
-                                         gpointer user_data,
-                                         GDestroyNotify destroy) {
-  generate_theme_thumbnail_async(
-      theme_info, theme_info->name, THUMBNAIL_TYPE_ICON, NULL, NULL, NULL,
-      theme_info->name, NULL, func, user_data, destroy);
+/* For requests we can't take back right away: the result is dropped when it
+ * arrives, but the caller is done with them now. */
+static void theme_thumbnail_request_cancel(ThemeThumbnailRequest *request) {
+  if (request->cancelled) return;
+
+  request->cancelled = TRUE;
+  g_cancellable_cancel(request->cancellable);
+
+  if (request->destroy) (*request->destroy)(request->user_data);
+  request->destroy = NULL;
 }
 
-void theme_thumbnail_factory_init(int argc, char *argv[]) {
-  gint child_pid;
+void theme_thumbnail_cancel(guint request_id) {
+  GList *l;
+  guint i;
+
+  if (request_id == 0) return;
+
+  for (l = cache_lookups.head; l != NULL; l = l->next) {
+    ThemeThumbnailRequest *request = l->data;
 
-  if (pipe(pipe_to_factory_fd) == -1) perror("pipe error");
+    if (request->id == request_id) {
+      theme_thumbnail_request_cancel(request);
+      return;
+    }
+  }
 
-  if (pipe(pipe_from_factory_fd) == -1) perror("pipe error");
+  for (l = pending_requests.head; l != NULL; l = l->next) {
+    ThemeThumbnailRequest *request = l->data;
+
+    if (request->id == request_id) {
+      g_queue_delete_link(&pending_requests, l);
+      request->cancelled = TRUE;
+      theme_thumbnail_request_finish(request, NULL);
+      return;
+    }
+  }
+
+  if (workers == NULL) return;
+
+  /* Already handed to a worker: let it finish, but drop the result */
+  for (i = 0; i < workers->len; i++) {
+    ThemeThumbnailWorker *worker = g_ptr_array_index(workers, i);
+    ThemeThumbnailRequest *request = worker->request;
+
+    if (request != NULL && request->id == request_id) {
+      theme_thumbnail_request_cancel(request);
+      return;
+    }
+  }
+}
+
+static ThemeThumbnailWorker *theme_thumbnail_worker_spawn(int argc,
+                                                          char *argv[]) {
+  ThemeThumbnailWorker *worker;
+  int factory_fd[2];
+  pid_t child_pid;
+
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, factory_fd) == -1) {
+    perror("socketpair error");
+    return NULL;
+  }
 
   child_pid = fork();
   if (child_pid == 0) {
-    ThemeThumbnailData data;
-    GIOChannel *channel;
-
-    /* Child */
-    gtk_init(&argc, &argv);
-
-    close(pipe_to_factory_fd[1]);
-    pipe_to_factory_fd[1] = 0;
-    close(pipe_from_factory_fd[0]);
-    pipe_from_factory_fd[0] = 0;
-
-    data.status = READY_FOR_THEME;
-    data.type = g_byte_array_new();
-    data.control_theme_name = g_byte_array_new();
-    data.gtk_color_scheme = g_byte_array_new();
-    data.wm_theme_name = g_byte_array_new();
-    data.icon_theme_name = g_byte_array_new();
-    data.application_font = g_byte_array_new();
-
-    channel = g_io_channel_unix_new(pipe_to_factory_fd[0]);
-    g_io_channel_set_flags(
-        channel, g_io_channel_get_flags(channel) | G_IO_FLAG_NONBLOCK, NULL);
-    g_io_channel_set_encoding(channel, NULL, NULL);
-    g_io_add_watch(channel, G_IO_IN | G_IO_HUP, message_from_capplet, &data);
-    g_io_channel_unref(channel);
-
-    gtk_main();
-    _exit(0);
+    guint i;
+
+    /* Child: don't hold on to the sockets of the workers forked before us,
+     * or they would never see EOF when the capplet goes away.  Their watches
+     * go first, since gtk_init() may reuse the fd numbers. */
+    for (i = 0; i < workers->len; i++) {
+      ThemeThumbnailWorker *w = g_ptr_array_index(workers, i);
+
+      if (w->watch_id) {
+        g_source_remove(w->watch_id);
+        w->watch_id = 0;
+      }
+      close(w->fd);
+    }
+
+    close(factory_fd[0]);
+
+    theme_thumbnail_factory_main(factory_fd[1], argc, argv);
   }
 
-  g_assert(child_pid > 0);
+  if (child_pid < 0) {
+    perror("fork error");
+    close(factory_fd[0]);
+    close(factory_fd[1]);
+    return NULL;
+  }
 
   /* Parent */
-  close(pipe_to_factory_fd[0]);
-  close(pipe_from_factory_fd[1]);
+  close(factory_fd[1]);
+
+  worker = g_new0(ThemeThumbnailWorker, 1);
+  worker->pid = child_pid;
+  worker->fd = factory_fd[0];
+  worker->watch_id = g_unix_fd_add(worker->fd, G_IO_IN | G_IO_HUP,
+                                   message_from_child, worker);
+
+  return worker;
+}
+
+void theme_thumbnail_factory_init(int argc, char *argv[]) {
+  const gchar *env;
+  gint n_workers;
+  gint i;
+
+  n_workers = g_get_num_processors();
+
+  env = g_getenv(FACTORY_WORKERS_ENV);
+  if (env != NULL && *env != '\0')
+    n_workers = (gint)g_ascii_strtoll(env, NULL, 10);
 
-  async_data.set = FALSE;
-  async_data.theme_name = NULL;
-  async_data.data = g_byte_array_new();
+  n_workers = CLAMP(n_workers, 1, MAX_FACTORY_WORKERS);
+
+  workers = g_ptr_array_new_with_free_func(
+      (GDestroyNotify)theme_thumbnail_worker_free);
+
+  for (i = 0; i < n_workers; i++) {
+    ThemeThumbnailWorker *worker = theme_thumbnail_worker_spawn(argc, argv);
+
+    if (worker == NULL) break;
+
+    g_ptr_array_add(workers, worker);
+  }
 }
@@ -13,20 +13,31 @@ GdkPixbuf *generate_gtk_theme_thumbnail(MateThemeInfo *theme_info);
 GdkPixbuf *generate_marco_theme_thumbnail(MateThemeInfo *theme_info);
 GdkPixbuf *generate_icon_theme_thumbnail(MateThemeIconInfo *theme_info);
 
-void generate_meta_theme_thumbnail_async(MateThemeMetaInfo *theme_info,
-                                         ThemeThumbnailFunc func, gpointer data,
-                                         GDestroyNotify destroy);
-void generate_gtk_theme_thumbnail_async(MateThemeInfo *theme_info,
-                                        ThemeThumbnailFunc func, gpointer data,
-                                        GDestroyNotify destroy);
-void generate_marco_theme_thumbnail_async(MateThemeInfo *theme_info,
+/* The async generators return a request id that can be handed to
+ * theme_thumbnail_cancel(), or 0 if the callback has already been run. */
+guint generate_meta_theme_thumbnail_async(MateThemeMetaInfo *theme_info,
                                           ThemeThumbnailFunc func,
                                           gpointer data,
                                           GDestroyNotify destroy);
-void generate_icon_theme_thumbnail_async(MateThemeIconInfo *theme_info,
+guint generate_gtk_theme_thumbnail_async(MateThemeInfo *theme_info,
                                          ThemeThumbnailFunc func, gpointer data,
                                          GDestroyNotify destroy);
+guint generate_marco_theme_thumbnail_async(MateThemeInfo *theme_info,
+                                           ThemeThumbnailFunc func,
+                                           gpointer data,
+                                           GDestroyNotify destroy);
+guint generate_icon_theme_thumbnail_async(MateThemeIconInfo *theme_info,
+                                          ThemeThumbnailFunc func,
+                                          gpointer data,
+                                          GDestroyNotify destroy);
+
+/* Drops a queued or in-flight request.  Its callback will not be run; the
+ * destroy notify is called right away. */
+void theme_thumbnail_cancel(guint request_id);
 
+/* Forks the thumbnail factory workers.  Must be called before gtk_init().
+ * The pool size defaults to the number of processors and can be overridden
+ * with the MATE_THEME_THUMBNAIL_WORKERS environment variable. */
 void theme_thumbnail_factory_init(int argc, char *argv[]);
 
 #endif /* __THEME_THUMBNAIL_H__ */
@@ -0,0 +1,313 @@
+/* display-layout-bench.c - Checks and times the monitor layout code
+ *
+ * Makes up configurations of outputs with mixed modes and rotations, some
+ * of them turned off, and runs what the monitor preferences do with them:
+ *
+ *   lay-out-horizontally  layout_outputs_horizontally()
+ *   realign               layout_realign_after_resize() after a mode change
+ *   virtual-size          layout_get_virtual_size()
+ *   snap-engine-new       snap_engine_new(), when a drag starts
+ *   snap                  snap_engine_snap(), for each pointer motion
+ *
+ * Each result is checked as well: outputs must not overlap after any of
+ * them, outputs laid out side by side or moved by a snap must each share an
+ * edge with another one, and the virtual size must fit the active outputs.
+ * The results are printed as JSON, the exit status is 1 if any check
+ * failed.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <stdio.h>
+
+#include "bench-report.h"
+#include "display-layout.h"
+
+static gint n_outputs = 8;
+static gint n_configurations = 200;
+static gint n_motions = 100;
+static gint seed = 1;
+static gchar *output_file = NULL;
+
+static GOptionEntry entries[] = {
+    {"outputs", 'n', 0, G_OPTION_ARG_INT, &n_outputs,
+     "Number of outputs in each configuration", "N"},
+    {"configurations", 'c', 0, G_OPTION_ARG_INT, &n_configurations,
+     "Number of configurations to make up", "N"},
+    {"motions", 'm', 0, G_OPTION_ARG_INT, &n_motions,
+     "Number of pointer motions in each drag", "N"},
+    {"seed", 's', 0, G_OPTION_ARG_INT, &seed,
+     "Seed of the made up configurations", "N"},
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output_file,
+     "Write the results to FILE instead of stdout", "FILE"},
+    {NULL}};
+
+static const struct {
+  int width, height;
+} modes[] = {{1024, 768},  {1280, 1024}, {1366, 768},  {1600, 900},
+             {1920, 1080}, {1920, 1200}, {2560, 1080}, {2560, 1440},
+             {2880, 1800}, {3440, 1440}, {3840, 2160}, {5120, 2880}};
+
+typedef struct {
+  const gchar *name;
+  GArray *samples; /* gdouble, in microseconds */
+  guint failures;
+} Operation;
+
+enum {
+  LAY_OUT_HORIZONTALLY,
+  REALIGN,
+  VIRTUAL_SIZE,
+  SNAP_ENGINE_NEW,
+  SNAP,
+  N_OPERATIONS
+};
+
+static Operation operations[N_OPERATIONS] = {
+    {"lay-out-horizontally"}, {"realign"}, {"virtual-size"},
+    {"snap-engine-new"},      {"snap"}};
+
+static guint n_unsnapped = 0;
+
+static void add_sample(guint operation, gint64 start) {
+  gdouble usec = g_get_monotonic_time() - start;
+
+  g_array_append_val(operations[operation].samples, usec);
+}
+
+static void check(guint operation, gboolean ok, const LayoutOutput *outputs) {
+  guint i;
+
+  if (ok) return;
+
+  if (operations[operation].failures++ > 0) return;
+
+  /* show the first failing layout of each operation */
+  g_printerr("%s failed with:\n", operations[operation].name);
+  for (i = 0; i < (guint)n_outputs; i++) {
+    LayoutRect rect;
+
+    layout_output_get_rect(&outputs[i], &rect);
+    g_printerr("  %dx%d%+d%+d%s%s\n", rect.width, rect.height, rect.x, rect.y,
+               outputs[i].rotated ? " rotated" : "",
+               outputs[i].active ? "" : " off");
+  }
+}
+
+/* Configurations */
+
+static void set_random_mode(GRand *rand, LayoutOutput *output) {
+  guint mode = g_rand_int_range(rand, 0, G_N_ELEMENTS(modes));
+
+  output->width = modes[mode].width;
+  output->height = modes[mode].height;
+}
+
+static void make_configuration(GRand *rand, LayoutOutput *outputs) {
+  gint i;
+
+  for (i = 0; i < n_outputs; i++) {
+    LayoutOutput *output = &outputs[i];
+
+    set_random_mode(rand, output);
+    output->preferred_width = output->width;
+    output->preferred_height = output->height;
+    output->rotated = g_rand_int_range(rand, 0, 4) == 0;
+    output->connected = TRUE;
+    /* outputs turned off have no mode */
+    output->active = i == 0 || g_rand_int_range(rand, 0, 8) != 0;
+    if (!output->active) output->width = output->height = 0;
+
+    /* all on top of each other, as when mirroring is turned off */
+    output->x = output->y = 0;
+  }
+}
+
+static gboolean outputs_overlap(const LayoutOutput *outputs) {
+  gint i;
+
+  for (i = 0; i < n_outputs; i++) {
+    if (layout_output_overlaps(outputs, n_outputs, i)) return TRUE;
+  }
+
+  return FALSE;
+}
+
+static gboolean virtual_size_fits_outputs(const LayoutOutput *outputs) {
+  int width, height;
+  int total_width = 0, max_height = 0;
+  gint i;
+
+  layout_get_virtual_size(outputs, n_outputs, &width, &height);
+
+  /* the active outputs come first in a row */
+  for (i = 0; i < n_outputs; i++) {
+    LayoutRect rect;
+
+    if (!outputs[i].active) continue;
+
+    layout_output_get_rect(&outputs[i], &rect);
+    total_width = MAX(total_width, rect.x + rect.width);
+    max_height = MAX(max_height, rect.height);
+  }
+
+  return width == total_width && height == max_height;
+}
+
+static void bench_configuration(GRand *rand, LayoutOutput *outputs) {
+  gint64 start;
+  int width, height;
+  guint index;
+  gint i;
+
+  make_configuration(rand, outputs);
+
+  start = g_get_monotonic_time();
+  layout_outputs_horizontally(outputs, n_outputs);
+  add_sample(LAY_OUT_HORIZONTALLY, start);
+  check(LAY_OUT_HORIZONTALLY, layout_is_aligned(outputs, n_outputs), outputs);
+
+  start = g_get_monotonic_time();
+  layout_get_virtual_size(outputs, n_outputs, &width, &height);
+  add_sample(VIRTUAL_SIZE, start);
+  check(VIRTUAL_SIZE, virtual_size_fits_outputs(outputs), outputs);
+
+  /* the user picks another mode for one of the outputs */
+  do
+    index = g_rand_int_range(rand, 0, n_outputs);
+  while (!outputs[index].active);
+
+  width = outputs[index].width;
+  height = outputs[index].height;
+  set_random_mode(rand, &outputs[index]);
+
+  start = g_get_monotonic_time();
+  layout_realign_after_resize(outputs, n_outputs, index, width, height);
+  add_sample(REALIGN, start);
+  check(REALIGN, !outputs_overlap(outputs), outputs);
+
+  if (n_outputs < 2) return;
+
+  /* and drags an output around, starting from outputs side by side since
+   * realigning can leave one with no edge shared */
+  layout_outputs_horizontally(outputs, n_outputs);
+  for (i = 0; i < 4; i++) {
+    SnapEngine *engine;
+    int grab_x, grab_y;
+    int pointer_x, pointer_y;
+    gint motion;
+
+    index = g_rand_int_range(rand, 0, n_outputs);
+    grab_x = outputs[index].x;
+    grab_y = outputs[index].y;
+
+    start = g_get_monotonic_time();
+    engine = snap_engine_new(outputs, n_outputs, index);
+    add_sample(SNAP_ENGINE_NEW, start);
+
+    pointer_x = grab_x;
+    pointer_y = grab_y;
+    for (motion = 0; motion < n_motions; motion++) {
+      int x, y;
+
+      pointer_x += g_rand_int_range(rand, -150, 151);
+      pointer_y += g_rand_int_range(rand, -150, 151);
+      x = pointer_x;
+      y = pointer_y;
+
+      start = g_get_monotonic_time();
+      if (!snap_engine_snap(engine, &x, &y)) {
+        x = grab_x;
+        y = grab_y;
+      }
+      add_sample(SNAP, start);
+
+      outputs[index].x = x;
+      outputs[index].y = y;
+
+      if ((x != pointer_x || y != pointer_y) && (x != grab_x || y != grab_y))
+        check(SNAP, layout_is_aligned(outputs, n_outputs), outputs);
+      else if (!layout_is_aligned(outputs, n_outputs))
+        n_unsnapped++; /* nothing was near enough to snap to */
+    }
+
+    snap_engine_free(engine);
+
+    /* the drag ends where the layout is aligned */
+    if (!layout_is_aligned(outputs, n_outputs)) {
+      outputs[index].x = grab_x;
+      outputs[index].y = grab_y;
+    }
+  }
+}
+
+/* Results */
+
+static void report(GString *out, Operation *operation) {
+  bench_report_begin(out, operation->name, "us", operation->samples);
+  g_string_append_printf(out, ", \"failures\": %u}", operation->failures);
+}
+
+int main(int argc, char *argv[]) {
+  GOptionContext *context;
+  GError *error = NULL;
+  LayoutOutput *outputs;
+  GRand *rand;
+  GString *out;
+  guint failures = 0;
+  gint i;
+
+  context = g_option_context_new("- check and time the monitor layout code");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free(context);
+
+  n_outputs = MAX(n_outputs, 1);
+  n_configurations = MAX(n_configurations, 0);
+  n_motions = MAX(n_motions, 0);
+
+  for (i = 0; i < N_OPERATIONS; i++)
+    operations[i].samples = g_array_new(FALSE, FALSE, sizeof(gdouble));
+
+  rand = g_rand_new_with_seed(seed);
+  outputs = g_new(LayoutOutput, n_outputs);
+
+  for (i = 0; i < n_configurations; i++) bench_configuration(rand, outputs);
+
+  out = g_string_new(NULL);
+  g_string_append_printf(out,
+                         "{\n  \"outputs\": %d,\n  \"configurations\": %d,\n"
+                         "  \"motions\": %d,\n  \"seed\": %d,\n"
+                         "  \"results\": [",
+                         n_outputs, n_configurations, n_motions, seed);
+
+  for (i = 0; i < N_OPERATIONS; i++) {
+    report(out, &operations[i]);
+    failures += operations[i].failures;
+    g_array_unref(operations[i].samples);
+  }
+
+  g_string_append_printf(out, "\n  ],\n  \"unsnapped\": %u\n}\n",
+                         n_unsnapped);
+
+  if (output_file != NULL) {
+    if (!g_file_set_contents(output_file, out->str, out->len, &error)) {
+      g_printerr("%s\n", error->message);
+      g_clear_error(&error);
+    }
+  } else {
+    fputs(out->str, stdout);
+  }
+
+  g_string_free(out, TRUE);
+  g_free(outputs);
+  g_rand_free(rand);
+
+  return failures > 0 ? 1 : 0;
+}
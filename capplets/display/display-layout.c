@@ -0,0 +1,580 @@
+/* Monitor Settings. A preference panel for configuring monitors
+ *
+ * Copyright (C) 2007, 2008  Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "display-layout.h"
+
+typedef struct Edge {
+  int output; /* index, -1 for the dragged output */
+  int x1, y1;
+  int x2, y2;
+} Edge;
+
+typedef struct Snap {
+  int dy, dx;
+} Snap;
+
+/* Position a corner snap moves the dragged output to */
+typedef struct SnapTarget {
+  int x, y;
+} SnapTarget;
+
+/* Edge of another output the dragged output can be slid along */
+typedef struct SnapRail {
+  gboolean horizontal;
+  int position; /* y, or x for a vertical rail, of the dragged output */
+  int start, end;
+} SnapRail;
+
+/* What the dragged output can snap to, built when the drag starts since the
+ * other outputs do not move while it lasts. */
+struct SnapEngine {
+  int width, height; /* of the dragged output, rotation applied */
+
+  GArray *edges; /* Edge, of the other outputs */
+  GArray *rects; /* LayoutRect, of the other outputs */
+  /* other outputs that only an edge of the dragged output can align */
+  GArray *unaligned;
+  gboolean overlapping; /* the other outputs overlap each other */
+
+  GArray *rails;        /* SnapRail */
+  GArray *targets_by_x; /* SnapTarget, sorted by x */
+  GArray *targets_by_y; /* SnapTarget, sorted by y */
+
+  GArray *snaps; /* Snap, reused by each query */
+};
+
+static void rotate_size(const LayoutOutput *output, int *width, int *height) {
+  if (output->rotated) {
+    int tmp;
+    tmp = *height;
+    *height = *width;
+    *width = tmp;
+  }
+}
+
+void layout_output_get_size(const LayoutOutput *output, int *width,
+                            int *height) {
+  if (output->active) {
+    *width = output->width;
+    *height = output->height;
+  } else {
+    *width = output->preferred_width;
+    *height = output->preferred_height;
+  }
+  rotate_size(output, width, height);
+}
+
+void layout_output_get_rect(const LayoutOutput *output, LayoutRect *rect) {
+  rect->x = output->x;
+  rect->y = output->y;
+  layout_output_get_size(output, &rect->width, &rect->height);
+}
+
+static gboolean rects_intersect(const LayoutRect *r1, const LayoutRect *r2) {
+  return r1->x < r2->x + r2->width && r2->x < r1->x + r1->width &&
+         r1->y < r2->y + r2->height && r2->y < r1->y + r1->height;
+}
+
+static void get_edges(int output, int x, int y, int w, int h, Edge edges[4]) {
+  /* Top, Bottom, Left, Right */
+  edges[0] = (Edge){output, x, y, x + w, y};
+  edges[1] = (Edge){output, x, y + h, x + w, y + h};
+  edges[2] = (Edge){output, x, y, x, y + h};
+  edges[3] = (Edge){output, x + w, y, x + w, y + h};
+}
+
+static gboolean overlap(int s1, int e1, int s2, int e2) {
+  return (!(e1 < s2 || s1 >= e2));
+}
+
+static gboolean corner_on_edge(int x, int y, Edge *e) {
+  if (x == e->x1 && x == e->x2 && y >= e->y1 && y <= e->y2) return TRUE;
+
+  if (y == e->y1 && y == e->y2 && x >= e->x1 && x <= e->x2) return TRUE;
+
+  return FALSE;
+}
+
+static gboolean edges_align(Edge *e1, Edge *e2) {
+  if (corner_on_edge(e1->x1, e1->y1, e2)) return TRUE;
+
+  if (corner_on_edge(e2->x1, e2->y1, e1)) return TRUE;
+
+  return FALSE;
+}
+
+static gboolean edge_aligns_with_output(Edge *edge, GArray *edges,
+                                        int output) {
+  guint i;
+
+  for (i = 0; i < edges->len; ++i) {
+    Edge *other = &g_array_index(edges, Edge, i);
+
+    if (other->output == output && edges_align(edge, other)) return TRUE;
+  }
+
+  return FALSE;
+}
+
+gboolean layout_output_overlaps(const LayoutOutput *outputs, guint n_outputs,
+                                guint index) {
+  guint i;
+  LayoutRect output_rect;
+
+  layout_output_get_rect(&outputs[index], &output_rect);
+
+  for (i = 0; i < n_outputs; ++i) {
+    if (i != index && outputs[i].connected) {
+      LayoutRect other_rect;
+
+      layout_output_get_rect(&outputs[i], &other_rect);
+      if (rects_intersect(&output_rect, &other_rect)) return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+gboolean layout_is_aligned(const LayoutOutput *outputs, guint n_outputs) {
+  GArray *edges = g_array_new(FALSE, FALSE, sizeof(Edge));
+  gboolean aligned = TRUE;
+  guint i, j, k;
+
+  for (i = 0; i < n_outputs && aligned; ++i) {
+    LayoutRect rect;
+    Edge output_edges[4];
+
+    if (!outputs[i].connected) continue;
+
+    if (layout_output_overlaps(outputs, n_outputs, i)) aligned = FALSE;
+
+    layout_output_get_rect(&outputs[i], &rect);
+    get_edges(i, rect.x, rect.y, rect.width, rect.height, output_edges);
+    g_array_append_vals(edges, output_edges, 4);
+  }
+
+  /* every output needs an edge aligned with one of another output */
+  for (i = 0; i < edges->len && aligned; i += 4) {
+    gboolean found = edges->len == 4;
+
+    for (j = 0; j < edges->len && !found; ++j) {
+      Edge *other = &g_array_index(edges, Edge, j);
+
+      if (j / 4 == i / 4) continue;
+
+      for (k = i; k < i + 4 && !found; ++k)
+        found = edges_align(&g_array_index(edges, Edge, k), other);
+    }
+
+    aligned = found;
+  }
+
+  g_array_free(edges, TRUE);
+
+  return aligned;
+}
+
+void layout_outputs_horizontally(LayoutOutput *outputs, guint n_outputs) {
+  guint i;
+  int x;
+
+  /* Lay out all the monitors horizontally when "mirror screens" is turned
+   * off, to avoid having all of them overlapped initially.  We put the
+   * outputs turned off on the right-hand side.  Each output takes the room
+   * it is shown with, so rotated ones do not overlap their neighbours.
+   */
+
+  x = 0;
+
+  /* First pass, all "on" outputs */
+  for (i = 0; i < n_outputs; ++i) {
+    int width, height;
+    if (outputs[i].connected && outputs[i].active) {
+      layout_output_get_size(&outputs[i], &width, &height);
+      outputs[i].x = x;
+      outputs[i].y = 0;
+      x += width;
+    }
+  }
+
+  /* Second pass, all the black screens */
+  for (i = 0; i < n_outputs; ++i) {
+    int width, height;
+    if (!(outputs[i].connected && outputs[i].active)) {
+      layout_output_get_size(&outputs[i], &width, &height);
+      outputs[i].x = x;
+      outputs[i].y = 0;
+      x += width;
+    }
+  }
+}
+
+void layout_realign_after_resize(LayoutOutput *outputs, guint n_outputs,
+                                 guint index, int old_width, int old_height) {
+  /* We find the outputs that were below or to the right of the output that
+   * changed, and realign them; we also do that for outputs that shared the
+   * right/bottom edges with the output that changed.  The outputs that are
+   * above or to the left of that output don't need to change.
+   */
+
+  guint i;
+  int old_right_edge, old_bottom_edge;
+  int dx, dy;
+  int x, y, width, height;
+
+  x = outputs[index].x;
+  y = outputs[index].y;
+  width = outputs[index].width;
+  height = outputs[index].height;
+  if (width == old_width && height == old_height) return;
+
+  rotate_size(&outputs[index], &width, &height);
+  rotate_size(&outputs[index], &old_width, &old_height);
+
+  old_right_edge = x + old_width;
+  old_bottom_edge = y + old_height;
+
+  dx = width - old_width;
+  dy = height - old_height;
+
+  for (i = 0; i < n_outputs; i++) {
+    int output_width, output_height;
+
+    if (i == index || !outputs[i].connected) continue;
+
+    output_width = outputs[i].width;
+    output_height = outputs[i].height;
+    rotate_size(&outputs[i], &output_width, &output_height);
+
+    if (outputs[i].x >= old_right_edge)
+      outputs[i].x += dx;
+    else if (outputs[i].x + output_width == old_right_edge)
+      outputs[i].x = x + width - output_width;
+
+    if (outputs[i].y >= old_bottom_edge)
+      outputs[i].y += dy;
+    else if (outputs[i].y + output_height == old_bottom_edge)
+      outputs[i].y = y + height - output_height;
+  }
+}
+
+void layout_get_virtual_size(const LayoutOutput *outputs, guint n_outputs,
+                             int *width, int *height) {
+  guint i;
+
+  *width = *height = 0;
+
+  for (i = 0; i < n_outputs; i++) {
+    if (outputs[i].active) {
+      int output_width = outputs[i].width;
+      int output_height = outputs[i].height;
+
+      rotate_size(&outputs[i], &output_width, &output_height);
+      *width = MAX(*width, outputs[i].x + output_width);
+      *height = MAX(*height, outputs[i].y + output_height);
+    }
+  }
+}
+
+static int compare_targets_by_x(gconstpointer v1, gconstpointer v2) {
+  const SnapTarget *t1 = v1;
+  const SnapTarget *t2 = v2;
+
+  return t1->x != t2->x ? t1->x - t2->x : t1->y - t2->y;
+}
+
+static int compare_targets_by_y(gconstpointer v1, gconstpointer v2) {
+  const SnapTarget *t1 = v1;
+  const SnapTarget *t2 = v2;
+
+  return t1->y != t2->y ? t1->y - t2->y : t1->x - t2->x;
+}
+
+static void add_target(GArray *targets, int x, int y) {
+  SnapTarget target = {x, y};
+
+  g_array_append_val(targets, target);
+}
+
+static void add_rail(GArray *rails, gboolean horizontal, int position,
+                     int start, int end) {
+  SnapRail rail = {horizontal, position, start, end};
+
+  g_array_append_val(rails, rail);
+}
+
+SnapEngine *snap_engine_new(const LayoutOutput *outputs, guint n_outputs,
+                            guint index) {
+  SnapEngine *engine;
+  Edge output_edges[4];
+  guint i, j, k;
+
+  engine = g_new0(SnapEngine, 1);
+  engine->edges = g_array_new(FALSE, FALSE, sizeof(Edge));
+  engine->rects = g_array_new(FALSE, FALSE, sizeof(LayoutRect));
+  engine->unaligned = g_array_new(FALSE, FALSE, sizeof(int));
+  engine->rails = g_array_new(FALSE, FALSE, sizeof(SnapRail));
+  engine->targets_by_x = g_array_new(FALSE, FALSE, sizeof(SnapTarget));
+  engine->snaps = g_array_new(FALSE, FALSE, sizeof(Snap));
+
+  layout_output_get_size(&outputs[index], &engine->width, &engine->height);
+
+  for (i = 0; i < n_outputs; ++i) {
+    LayoutRect rect;
+    Edge edges[4];
+
+    if (i == index || !outputs[i].connected) continue;
+
+    layout_output_get_rect(&outputs[i], &rect);
+    get_edges(i, rect.x, rect.y, rect.width, rect.height, edges);
+
+    g_array_append_val(engine->rects, rect);
+    g_array_append_vals(engine->edges, edges, 4);
+  }
+
+  for (i = 0; i < engine->rects->len; ++i) {
+    LayoutRect *rect = &g_array_index(engine->rects, LayoutRect, i);
+    int other = g_array_index(engine->edges, Edge, i * 4).output;
+    gboolean aligned = FALSE;
+
+    for (j = 0; j < engine->rects->len; ++j) {
+      if (j == i) continue;
+
+      if (rects_intersect(rect, &g_array_index(engine->rects, LayoutRect, j)))
+        engine->overlapping = TRUE;
+
+      for (k = 0; k < 4 && !aligned; ++k) {
+        aligned = edge_aligns_with_output(
+            &g_array_index(engine->edges, Edge, i * 4 + k), engine->edges,
+            g_array_index(engine->edges, Edge, j * 4).output);
+      }
+    }
+
+    if (!aligned) g_array_append_val(engine->unaligned, other);
+  }
+
+  /* the dragged output's edges relative to its own position */
+  get_edges(-1, 0, 0, engine->width, engine->height, output_edges);
+
+  for (i = 0; i < engine->edges->len; ++i) {
+    Edge *e = &g_array_index(engine->edges, Edge, i);
+
+    /* sliding the top or bottom edge along a horizontal edge */
+    if (e->y1 == e->y2) {
+      add_rail(engine->rails, TRUE, e->y1, e->x1, e->x2);
+      add_rail(engine->rails, TRUE, e->y1 - engine->height, e->x1, e->x2);
+    } else {
+      add_rail(engine->rails, FALSE, e->x1, e->y1, e->y2);
+      add_rail(engine->rails, FALSE, e->x1 - engine->width, e->y1, e->y2);
+    }
+
+    /* corner snaps: 1->1, 1->2, 2->2, 2->1 */
+    for (j = 0; j < 4; ++j) {
+      Edge *o = &output_edges[j];
+
+      add_target(engine->targets_by_x, e->x1 - o->x1, e->y1 - o->y1);
+      add_target(engine->targets_by_x, e->x2 - o->x1, e->y2 - o->y1);
+      add_target(engine->targets_by_x, e->x2 - o->x2, e->y2 - o->y2);
+      add_target(engine->targets_by_x, e->x1 - o->x2, e->y1 - o->y2);
+    }
+  }
+
+  /* many edges share corners, keep each target once */
+  g_array_sort(engine->targets_by_x, compare_targets_by_x);
+  for (i = 0, j = 0; i < engine->targets_by_x->len; ++i) {
+    if (j > 0 && compare_targets_by_x(
+                     &g_array_index(engine->targets_by_x, SnapTarget, i),
+                     &g_array_index(engine->targets_by_x, SnapTarget,
+                                    j - 1)) == 0)
+      continue;
+
+    g_array_index(engine->targets_by_x, SnapTarget, j++) =
+        g_array_index(engine->targets_by_x, SnapTarget, i);
+  }
+  g_array_set_size(engine->targets_by_x, j);
+
+  engine->targets_by_y = g_array_sized_new(FALSE, FALSE, sizeof(SnapTarget), j);
+  g_array_append_vals(engine->targets_by_y, engine->targets_by_x->data, j);
+  g_array_sort(engine->targets_by_y, compare_targets_by_y);
+
+  return engine;
+}
+
+void snap_engine_free(SnapEngine *engine) {
+  g_array_free(engine->edges, TRUE);
+  g_array_free(engine->rects, TRUE);
+  g_array_free(engine->unaligned, TRUE);
+  g_array_free(engine->rails, TRUE);
+  g_array_free(engine->targets_by_x, TRUE);
+  g_array_free(engine->targets_by_y, TRUE);
+  g_array_free(engine->snaps, TRUE);
+  g_free(engine);
+}
+
+/* Whether the layout is aligned with the dragged output at (x, y): no
+ * outputs overlap and each one has an edge aligned with another output. */
+static gboolean snap_engine_is_aligned(SnapEngine *engine, int x, int y) {
+  LayoutRect rect = {x, y, engine->width, engine->height};
+  Edge edges[4];
+  gboolean aligned = FALSE;
+  guint i, j;
+
+  if (engine->overlapping) return FALSE;
+
+  for (i = 0; i < engine->rects->len; ++i) {
+    if (rects_intersect(&rect, &g_array_index(engine->rects, LayoutRect, i)))
+      return FALSE;
+  }
+
+  get_edges(-1, x, y, engine->width, engine->height, edges);
+
+  for (i = 0; i < 4 && !aligned; ++i) {
+    for (j = 0; j < engine->edges->len && !aligned; ++j)
+      aligned = edges_align(&edges[i], &g_array_index(engine->edges, Edge, j));
+  }
+  if (!aligned) return FALSE;
+
+  for (i = 0; i < engine->unaligned->len; ++i) {
+    aligned = FALSE;
+    for (j = 0; j < 4 && !aligned; ++j) {
+      aligned = edge_aligns_with_output(
+          &edges[j], engine->edges,
+          g_array_index(engine->unaligned, int, i));
+    }
+    if (!aligned) return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Index of the first target whose coordinate is at least @value. */
+static guint lower_bound(GArray *targets, gboolean by_x, int value) {
+  guint low = 0, high = targets->len;
+
+  while (low < high) {
+    guint mid = (low + high) / 2;
+    SnapTarget *target = &g_array_index(targets, SnapTarget, mid);
+
+    if ((by_x ? target->x : target->y) < value)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return low;
+}
+
+static void add_snap(GArray *snaps, int dx, int dy) {
+  Snap snap;
+
+  snap.dx = dx;
+  snap.dy = dy;
+
+  g_array_append_val(snaps, snap);
+}
+
+static gboolean is_corner_snap(const Snap *s) {
+  return s->dx != 0 && s->dy != 0;
+}
+
+static int compare_snaps(gconstpointer v1, gconstpointer v2) {
+  const Snap *s1 = v1;
+  const Snap *s2 = v2;
+  int sv1 = MAX(ABS(s1->dx), ABS(s1->dy));
+  int sv2 = MAX(ABS(s2->dx), ABS(s2->dy));
+  int d;
+
+  d = sv1 - sv2;
+
+  /* This snapping algorithm is good enough for rock'n'roll, but
+   * this is probably a better:
+   *
+   *    First do a horizontal/vertical snap, then
+   *    with the new coordinates from that snap,
+   *    do a corner snap.
+   *
+   * Right now, it's confusing that corner snapping
+   * depends on the distance in an axis that you can't actually see.
+   *
+   */
+  if (d == 0) {
+    if (is_corner_snap(s1) && !is_corner_snap(s2))
+      return -1;
+    else if (is_corner_snap(s2) && !is_corner_snap(s1))
+      return 1;
+    else
+      return 0;
+  } else {
+    return d;
+  }
+}
+
+gboolean snap_engine_snap(SnapEngine *engine, int *x, int *y) {
+  GArray *snaps = engine->snaps;
+  guint i;
+
+  g_array_set_size(snaps, 0);
+
+  for (i = 0; i < engine->rails->len; ++i) {
+    SnapRail *rail = &g_array_index(engine->rails, SnapRail, i);
+
+    if (rail->horizontal &&
+        overlap(*x, *x + engine->width, rail->start, rail->end))
+      add_snap(snaps, 0, rail->position - *y);
+    else if (!rail->horizontal &&
+             overlap(*y, *y + engine->height, rail->start, rail->end))
+      add_snap(snaps, rail->position - *x, 0);
+  }
+
+  /* corner snaps are only tried within 200 pixels in one of the axes */
+  for (i = lower_bound(engine->targets_by_x, TRUE, *x - 200);
+       i < engine->targets_by_x->len; ++i) {
+    SnapTarget *target = &g_array_index(engine->targets_by_x, SnapTarget, i);
+
+    if (target->x > *x + 200) break;
+    add_snap(snaps, target->x - *x, target->y - *y);
+  }
+
+  for (i = lower_bound(engine->targets_by_y, FALSE, *y - 200);
+       i < engine->targets_by_y->len; ++i) {
+    SnapTarget *target = &g_array_index(engine->targets_by_y, SnapTarget, i);
+
+    if (target->y > *y + 200) break;
+    if (ABS(target->x - *x) > 200)
+      add_snap(snaps, target->x - *x, target->y - *y);
+  }
+
+  g_array_sort(snaps, compare_snaps);
+
+  for (i = 0; i < snaps->len; ++i) {
+    Snap *snap = &g_array_index(snaps, Snap, i);
+
+    if (snap_engine_is_aligned(engine, *x + snap->dx, *y + snap->dy)) {
+      *x += snap->dx;
+      *y += snap->dy;
+      return TRUE;
+    }
+  }
+
+  return snaps->len == 0;
+}
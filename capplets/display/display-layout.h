@@ -0,0 +1,78 @@
+/* Monitor Settings. A preference panel for configuring monitors
+ *
+ * Copyright (C) 2007, 2008  Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __DISPLAY_LAYOUT_H__
+#define __DISPLAY_LAYOUT_H__
+
+#include <glib.h>
+
+/* Arrangement of the outputs in the monitor preferences.  This only needs
+ * GLib, so that it can be run on made up configurations without a display.
+ */
+
+typedef struct {
+  int x, y;
+  int width, height; /* of the mode, before rotation */
+  int preferred_width, preferred_height;
+  gboolean rotated; /* by 90 or 270 degrees */
+  gboolean connected;
+  gboolean active;
+} LayoutOutput;
+
+typedef struct {
+  int x, y;
+  int width, height;
+} LayoutRect;
+
+typedef struct SnapEngine SnapEngine;
+
+/* The size @output is shown at: its mode, or its preferred mode when it is
+ * off, with the rotation applied. */
+void layout_output_get_size(const LayoutOutput *output, int *width,
+                            int *height);
+void layout_output_get_rect(const LayoutOutput *output, LayoutRect *rect);
+
+/* Whether output @index overlaps another connected output. */
+gboolean layout_output_overlaps(const LayoutOutput *outputs, guint n_outputs,
+                                guint index);
+/* Whether no connected outputs overlap and each one has an edge aligned with
+ * another output, which is what dragging an output snaps to. */
+gboolean layout_is_aligned(const LayoutOutput *outputs, guint n_outputs);
+
+/* Puts the outputs side by side, the ones turned off on the right. */
+void layout_outputs_horizontally(LayoutOutput *outputs, guint n_outputs);
+/* Moves the outputs right of or below output @index after its mode changed
+ * from @old_width x @old_height. */
+void layout_realign_after_resize(LayoutOutput *outputs, guint n_outputs,
+                                 guint index, int old_width, int old_height);
+/* The screen size the active outputs need. */
+void layout_get_virtual_size(const LayoutOutput *outputs, guint n_outputs,
+                             int *width, int *height);
+
+/* What dragging output @index can snap to, the other outputs must not move
+ * while it is used. */
+SnapEngine *snap_engine_new(const LayoutOutput *outputs, guint n_outputs,
+                            guint index);
+void snap_engine_free(SnapEngine *engine);
+/* Moves (*x, *y), where the pointer drags the output to, to the closest
+ * aligned position.  Returns FALSE if there were snaps to try but none of
+ * them is aligned. */
+gboolean snap_engine_snap(SnapEngine *engine, int *x, int *y);
+
+#endif /* __DISPLAY_LAYOUT_H__ */
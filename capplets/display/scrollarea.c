@@ -35,12 +35,19 @@ typedef struct InputPath InputPath;
 typedef struct InputRegion InputRegion;
 typedef struct AutoScrollInfo AutoScrollInfo;
 
+typedef struct {
+  double x1, y1, x2, y2;
+} Box;
+
 struct InputPath {
   gboolean is_stroke;
   cairo_fill_rule_t fill_rule;
   double line_width;
   cairo_path_t *path; /* In canvas coordinates */
 
+  Box extents;           /* of the filled or stroked path */
+  gboolean is_rectangle; /* an axis-aligned filled rectangle, the extents */
+
   FooScrollAreaEventFunc func;
   gpointer data;
 
@@ -94,6 +101,8 @@ struct FooScrollAreaPrivate {
 
   cairo_surface_t *surface;
   cairo_region_t *update_region; /* In canvas coordinates */
+
+  cairo_t *hit_cr; /* reused to test points against input paths */
 };
 
 enum {
@@ -158,6 +167,7 @@ static void foo_scroll_area_finalize(GObject *object) {
   g_object_unref(scroll_area->priv->vadj);
 
   g_ptr_array_free(scroll_area->priv->input_regions, TRUE);
+  if (scroll_area->priv->hit_cr) cairo_destroy(scroll_area->priv->hit_cr);
 
   g_free(scroll_area->priv);
 
@@ -311,10 +321,6 @@ static void path_foreach_point(cairo_path_t *path, PathForeachFunc func,
   }
 }
 
-typedef struct {
-  double x1, y1, x2, y2;
-} Box;
-
 static void input_path_free_list(InputPath *paths) {
   if (!paths) return;
 
@@ -418,8 +424,13 @@ static gboolean foo_scroll_area_draw(GtkWidget *widget, cairo_t *widget_cr) {
   region = scroll_area->priv->update_region;
   scroll_area->priv->update_region = cairo_region_create();
 
-  /* Create cairo context */
+  /* Create cairo context, only the invalidated area is repainted */
   cr = cairo_create(scroll_area->priv->surface);
+  cairo_translate(cr, -scroll_area->priv->x_offset,
+                  -scroll_area->priv->y_offset);
+  gdk_cairo_region(cr, region);
+  cairo_clip(cr);
+  cairo_identity_matrix(cr);
   initialize_background(widget, cr);
 
   g_signal_emit(widget, signals[PAINT], 0, cr);
@@ -550,6 +561,8 @@ static void foo_scroll_area_realize(GtkWidget *widget) {
       cairo_get_target(cr), CAIRO_CONTENT_COLOR, widget_allocation.width,
       widget_allocation.height);
   cairo_destroy(cr);
+  /* draws only repaint what was invalidated, start from a full repaint */
+  foo_scroll_area_invalidate(area);
 
   gdk_window_set_user_data(area->priv->input_window, area);
 
@@ -674,9 +687,39 @@ static void emit_input(FooScrollArea *scroll_area, FooScrollAreaEventType type,
   func(scroll_area, &event, data);
 }
 
+static gboolean input_path_contains(FooScrollArea *scroll_area,
+                                    InputPath *path, int x, int y) {
+  cairo_t *cr;
+
+  if (x < path->extents.x1 || x > path->extents.x2 || y < path->extents.y1 ||
+      y > path->extents.y2)
+    return FALSE;
+
+  if (path->is_rectangle) return TRUE;
+
+  if (!scroll_area->priv->hit_cr) {
+    cairo_surface_t *surface;
+
+    /* cairo_in_fill() and cairo_in_stroke() never draw to the target */
+    surface = cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
+    scroll_area->priv->hit_cr = cairo_create(surface);
+    cairo_surface_destroy(surface);
+  }
+
+  cr = scroll_area->priv->hit_cr;
+  cairo_new_path(cr);
+  cairo_set_fill_rule(cr, path->fill_rule);
+  cairo_set_line_width(cr, path->line_width);
+  cairo_append_path(cr, path->path);
+
+  if (path->is_stroke)
+    return cairo_in_stroke(cr, x, y);
+  else
+    return cairo_in_fill(cr, x, y);
+}
+
 static void process_event(FooScrollArea *scroll_area,
                           FooScrollAreaEventType input_type, int x, int y) {
-  GtkWidget *widget = GTK_WIDGET(scroll_area);
   guint i;
 
   allocation_to_canvas(scroll_area, &x, &y);
@@ -695,22 +738,7 @@ static void process_event(FooScrollArea *scroll_area,
 
       path = region->paths;
       while (path) {
-        cairo_t *cr;
-        gboolean inside;
-
-        cr = gdk_cairo_create(gtk_widget_get_window(widget));
-        cairo_set_fill_rule(cr, path->fill_rule);
-        cairo_set_line_width(cr, path->line_width);
-        cairo_append_path(cr, path->path);
-
-        if (path->is_stroke)
-          inside = cairo_in_stroke(cr, x, y);
-        else
-          inside = cairo_in_fill(cr, x, y);
-
-        cairo_destroy(cr);
-
-        if (inside) {
+        if (input_path_contains(scroll_area, path, x, y)) {
           emit_input(scroll_area, input_type, x, y, path->func, path->data);
           return;
         }
@@ -981,6 +1009,58 @@ static void user_to_device(double *x, double *y, gpointer data) {
   cairo_user_to_device(cr, x, y);
 }
 
+/* Whether the path is a single axis-aligned rectangle, as drawn by
+ * cairo_rectangle() */
+static gboolean path_is_rectangle(cairo_path_t *path) {
+  static const cairo_path_data_type_t types[] = {
+      CAIRO_PATH_MOVE_TO, CAIRO_PATH_LINE_TO, CAIRO_PATH_LINE_TO,
+      CAIRO_PATH_LINE_TO, CAIRO_PATH_CLOSE_PATH, CAIRO_PATH_MOVE_TO};
+  cairo_path_data_t *p[4];
+  int i, n;
+
+  for (i = 0, n = 0; i < path->num_data; i += path->data[i].header.length) {
+    if (n == G_N_ELEMENTS(types) || path->data[i].header.type != types[n])
+      return FALSE;
+    if (n < 4) p[n] = &path->data[i + 1];
+    n++;
+  }
+  if (n < 5) return FALSE;
+
+  if (p[0]->point.x == p[1]->point.x && p[1]->point.y == p[2]->point.y &&
+      p[2]->point.x == p[3]->point.x && p[3]->point.y == p[0]->point.y)
+    return TRUE;
+
+  return p[0]->point.y == p[1]->point.y && p[1]->point.x == p[2]->point.x &&
+         p[2]->point.y == p[3]->point.y && p[3]->point.x == p[0]->point.x;
+}
+
+/* Device space bounding box of the current path of @cr, as filled or
+ * stroked with its current settings. */
+static void get_device_extents(cairo_t *cr, gboolean is_stroke, Box *box) {
+  double x[4], y[4];
+  int i;
+
+  if (is_stroke)
+    cairo_stroke_extents(cr, &x[0], &y[0], &x[2], &y[2]);
+  else
+    cairo_fill_extents(cr, &x[0], &y[0], &x[2], &y[2]);
+
+  x[1] = x[2];
+  y[1] = y[0];
+  x[3] = x[0];
+  y[3] = y[2];
+
+  box->x1 = box->y1 = G_MAXDOUBLE;
+  box->x2 = box->y2 = -G_MAXDOUBLE;
+  for (i = 0; i < 4; ++i) {
+    cairo_user_to_device(cr, &x[i], &y[i]);
+    box->x1 = MIN(box->x1, x[i]);
+    box->y1 = MIN(box->y1, y[i]);
+    box->x2 = MAX(box->x2, x[i]);
+    box->y2 = MAX(box->y2, y[i]);
+  }
+}
+
 static InputPath *make_path(FooScrollArea *area, cairo_t *cr,
                             gboolean is_stroke, FooScrollAreaEventFunc func,
                             gpointer data) {
@@ -991,6 +1071,8 @@ static InputPath *make_path(FooScrollArea *area, cairo_t *cr,
   path->line_width = cairo_get_line_width(cr);
   path->path = cairo_copy_path(cr);
   path_foreach_point(path->path, user_to_device, cr);
+  get_device_extents(cr, is_stroke, &path->extents);
+  path->is_rectangle = !is_stroke && path_is_rectangle(path->path);
   path->func = func;
   path->data = data;
   path->next = area->priv->current_input->paths;
@@ -24,10 +24,12 @@
 #endif
 
 #include <gtk/gtk.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/wait.h>
 
+#include "display-layout.h"
 #include "scrollarea.h"
 #define MATE_DESKTOP_USE_UNSTABLE_API
 #include <X11/Xlib.h>
@@ -92,7 +94,6 @@ enum { RESPONSE_MAKE_DEFAULT = 1 };
 static void rebuild_gui(App *app);
 static void on_clone_changed(GtkWidget *box, gpointer data);
 static void on_rate_changed(GtkComboBox *box, gpointer data);
-static gboolean output_overlaps(MateRROutputInfo *output, MateRRConfig *config);
 static void select_current_output_from_dialog_position(App *app);
 static void monitor_on_off_toggled_cb(GtkToggleButton *toggle, gpointer data);
 static void apply_configuration_returned_cb(GObject *source_object,
@@ -801,59 +802,57 @@ static void monitor_on_off_toggled_cb(GtkToggleButton *toggle, gpointer data) {
   foo_scroll_area_invalidate(FOO_SCROLL_AREA(app->area));
 }
 
-static void realign_outputs_after_resolution_change(
-    App *app, MateRROutputInfo *output_that_changed, int old_width,
-    int old_height) {
-  /* We find the outputs that were below or to the right of the output that
-   * changed, and realign them; we also do that for outputs that shared the
-   * right/bottom edges with the output that changed.  The outputs that are
-   * above or to the left of that output don't need to change.
-   */
-
-  int i;
-  int old_right_edge, old_bottom_edge;
-  int dx, dy;
-  int x, y, width, height;
-  MateRROutputInfo **outputs;
+static void get_layout_output(MateRROutputInfo *info, LayoutOutput *output) {
+  MateRRRotation rotation = mate_rr_output_info_get_rotation(info);
 
-  g_assert(app->current_configuration != NULL);
+  mate_rr_output_info_get_geometry(info, &output->x, &output->y,
+                                   &output->width, &output->height);
+  output->preferred_width = mate_rr_output_info_get_preferred_width(info);
+  output->preferred_height = mate_rr_output_info_get_preferred_height(info);
+  output->rotated =
+      (rotation & (MATE_RR_ROTATION_90 | MATE_RR_ROTATION_270)) != 0;
+  output->connected = mate_rr_output_info_is_connected(info);
+  output->active = mate_rr_output_info_is_active(info);
+}
 
-  mate_rr_output_info_get_geometry(output_that_changed, &x, &y, &width,
-                                   &height);
-  if (width == old_width && height == old_height) return;
+/* Returns the outputs of @config, in the same order, for the layout code to
+ * work on.  Free with g_free(). */
+static LayoutOutput *get_layout(MateRRConfig *config, guint *n_outputs) {
+  MateRROutputInfo **outputs = mate_rr_config_get_outputs(config);
+  LayoutOutput *layout;
+  guint i;
 
-  old_right_edge = x + old_width;
-  old_bottom_edge = y + old_height;
+  for (*n_outputs = 0; outputs[*n_outputs]; ++*n_outputs)
+    ;
 
-  dx = width - old_width;
-  dy = height - old_height;
+  layout = g_new(LayoutOutput, *n_outputs);
+  for (i = 0; i < *n_outputs; ++i) get_layout_output(outputs[i], &layout[i]);
 
-  outputs = mate_rr_config_get_outputs(app->current_configuration);
+  return layout;
+}
 
-  for (i = 0; outputs[i] != NULL; i++) {
-    int output_x, output_y;
-    int output_width, output_height;
+/* Moves the outputs of @config to where get_layout()'s copy has them */
+static void set_layout(MateRRConfig *config, const LayoutOutput *layout) {
+  MateRROutputInfo **outputs = mate_rr_config_get_outputs(config);
+  guint i;
 
-    if (outputs[i] == output_that_changed ||
-        mate_rr_output_info_is_connected(outputs[i]))
-      continue;
+  for (i = 0; outputs[i]; ++i) {
+    int x, y;
 
-    mate_rr_output_info_get_geometry(outputs[i], &output_x, &output_y,
-                                     &output_width, &output_height);
+    mate_rr_output_info_get_geometry(outputs[i], &x, &y, NULL, NULL);
+    if (x != layout[i].x || y != layout[i].y)
+      mate_rr_output_info_set_geometry(outputs[i], layout[i].x, layout[i].y,
+                                       layout[i].width, layout[i].height);
+  }
+}
 
-    if (output_x >= old_right_edge)
-      output_x += dx;
-    else if (output_x + output_width == old_right_edge)
-      output_x = x + width - output_width;
+static guint get_layout_index(MateRRConfig *config, MateRROutputInfo *output) {
+  MateRROutputInfo **outputs = mate_rr_config_get_outputs(config);
+  guint i;
 
-    if (output_y >= old_bottom_edge)
-      output_y += dy;
-    else if (output_y + output_height == old_bottom_edge)
-      output_y = y + height - output_height;
+  for (i = 0; outputs[i] != output; ++i) g_assert(outputs[i] != NULL);
 
-    mate_rr_output_info_set_geometry(outputs[i], output_x, output_y,
-                                     output_width, output_height);
-  }
+  return i;
 }
 
 static void on_resolution_changed(GtkComboBox *box, gpointer data) {
@@ -862,6 +861,8 @@ static void on_resolution_changed(GtkComboBox *box, gpointer data) {
   int x, y;
   int width;
   int height;
+  LayoutOutput *layout;
+  guint n_outputs;
 
   if (!app->current_output) return;
 
@@ -877,8 +878,13 @@ static void on_resolution_changed(GtkComboBox *box, gpointer data) {
       mate_rr_output_info_set_active(app->current_output, TRUE);
   }
 
-  realign_outputs_after_resolution_change(app, app->current_output, old_width,
-                                          old_height);
+  layout = get_layout(app->current_configuration, &n_outputs);
+  layout_realign_after_resize(
+      layout, n_outputs,
+      get_layout_index(app->current_configuration, app->current_output),
+      old_width, old_height);
+  set_layout(app->current_configuration, layout);
+  g_free(layout);
 
   rebuild_rate_combo(app);
   rebuild_rotation_combo(app);
@@ -886,44 +892,6 @@ static void on_resolution_changed(GtkComboBox *box, gpointer data) {
   foo_scroll_area_invalidate(FOO_SCROLL_AREA(app->area));
 }
 
-static void lay_out_outputs_horizontally(App *app) {
-  int i;
-  int x;
-  MateRROutputInfo **outputs;
-
-  /* Lay out all the monitors horizontally when "mirror screens" is turned
-   * off, to avoid having all of them overlapped initially.  We put the
-   * outputs turned off on the right-hand side.
-   */
-
-  x = 0;
-
-  /* First pass, all "on" outputs */
-  outputs = mate_rr_config_get_outputs(app->current_configuration);
-
-  for (i = 0; outputs[i]; ++i) {
-    int width, height;
-    if (mate_rr_output_info_is_connected(outputs[i]) &&
-        mate_rr_output_info_is_active(outputs[i])) {
-      mate_rr_output_info_get_geometry(outputs[i], NULL, NULL, &width, &height);
-      mate_rr_output_info_set_geometry(outputs[i], x, 0, width, height);
-      x += width;
-    }
-  }
-
-  /* Second pass, all the black screens */
-
-  for (i = 0; outputs[i]; ++i) {
-    int width, height;
-    if (!(mate_rr_output_info_is_connected(outputs[i]) &&
-          mate_rr_output_info_is_active(outputs[i]))) {
-      mate_rr_output_info_get_geometry(outputs[i], NULL, NULL, &width, &height);
-      mate_rr_output_info_set_geometry(outputs[i], x, 0, width, height);
-      x += width;
-    }
-  }
-}
-
 static void on_clone_changed(GtkWidget *box, gpointer data) {
   App *app = data;
 
@@ -963,8 +931,17 @@ static void on_clone_changed(GtkWidget *box, gpointer data) {
       }
     }
   } else {
-    if (output_overlaps(app->current_output, app->current_configuration))
-      lay_out_outputs_horizontally(app);
+    MateRRConfig *config = app->current_configuration;
+    guint n_outputs;
+    LayoutOutput *layout = get_layout(config, &n_outputs);
+
+    if (layout_output_overlaps(layout, n_outputs,
+                               get_layout_index(config, app->current_output))) {
+      layout_outputs_horizontally(layout, n_outputs);
+      set_layout(config, layout);
+    }
+
+    g_free(layout);
   }
 
   rebuild_gui(app);
@@ -973,22 +950,11 @@ static void on_clone_changed(GtkWidget *box, gpointer data) {
 #define SPACE 15
 #define MARGIN 15
 
-static void get_geometry(MateRROutputInfo *output, int *w, int *h) {
-  MateRRRotation rotation;
+static void get_geometry(MateRROutputInfo *info, int *w, int *h) {
+  LayoutOutput output;
 
-  if (mate_rr_output_info_is_active(output)) {
-    mate_rr_output_info_get_geometry(output, NULL, NULL, w, h);
-  } else {
-    *h = mate_rr_output_info_get_preferred_height(output);
-    *w = mate_rr_output_info_get_preferred_width(output);
-  }
-  rotation = mate_rr_output_info_get_rotation(output);
-  if ((rotation & MATE_RR_ROTATION_90) || (rotation & MATE_RR_ROTATION_270)) {
-    int tmp;
-    tmp = *h;
-    *h = *w;
-    *w = tmp;
-  }
+  get_layout_output(info, &output);
+  layout_output_get_size(&output, w, h);
 }
 
 static GList *list_connected_outputs(App *app, int *total_w, int *total_h) {
@@ -1050,267 +1016,18 @@ static double compute_scale(App *app) {
   return MIN((double)available_w / total_w, (double)available_h / total_h);
 }
 
-typedef struct Edge {
-  MateRROutputInfo *output;
-  int x1, y1;
-  int x2, y2;
-} Edge;
-
-typedef struct Snap {
-  Edge *snapper; /* Edge that should be snapped */
-  Edge *snappee;
-  int dy, dx;
-} Snap;
-
-static void add_edge(MateRROutputInfo *output, int x1, int y1, int x2, int y2,
-                     GArray *edges) {
-  Edge e;
-
-  e.x1 = x1;
-  e.x2 = x2;
-  e.y1 = y1;
-  e.y2 = y2;
-  e.output = output;
-
-  g_array_append_val(edges, e);
-}
-
-static void list_edges_for_output(MateRROutputInfo *output, GArray *edges) {
-  int x, y, w, h;
-
-  mate_rr_output_info_get_geometry(output, &x, &y, &w, &h);
-  get_geometry(output, &w, &h); /* accounts for rotation */
-
-  /* Top, Bottom, Left, Right */
-  add_edge(output, x, y, x + w, y, edges);
-  add_edge(output, x, y + h, x + w, y + h, edges);
-  add_edge(output, x, y, x, y + h, edges);
-  add_edge(output, x + w, y, x + w, y + h, edges);
-}
-
-static void list_edges(MateRRConfig *config, GArray *edges) {
-  int i;
-  MateRROutputInfo **outputs = mate_rr_config_get_outputs(config);
-
-  for (i = 0; outputs[i]; ++i) {
-    if (mate_rr_output_info_is_connected(outputs[i]))
-      list_edges_for_output(outputs[i], edges);
-  }
-}
-
-static gboolean overlap(int s1, int e1, int s2, int e2) {
-  return (!(e1 < s2 || s1 >= e2));
-}
-
-static gboolean horizontal_overlap(Edge *snapper, Edge *snappee) {
-  if (snapper->y1 != snapper->y2 || snappee->y1 != snappee->y2) return FALSE;
-
-  return overlap(snapper->x1, snapper->x2, snappee->x1, snappee->x2);
-}
-
-static gboolean vertical_overlap(Edge *snapper, Edge *snappee) {
-  if (snapper->x1 != snapper->x2 || snappee->x1 != snappee->x2) return FALSE;
-
-  return overlap(snapper->y1, snapper->y2, snappee->y1, snappee->y2);
-}
-
-static void add_snap(GArray *snaps, Snap snap) {
-  if (ABS(snap.dx) <= 200 || ABS(snap.dy) <= 200)
-    g_array_append_val(snaps, snap);
-}
-
-static void add_edge_snaps(Edge *snapper, Edge *snappee, GArray *snaps) {
-  Snap snap;
-
-  snap.snapper = snapper;
-  snap.snappee = snappee;
-
-  if (horizontal_overlap(snapper, snappee)) {
-    snap.dx = 0;
-    snap.dy = snappee->y1 - snapper->y1;
-
-    add_snap(snaps, snap);
-  } else if (vertical_overlap(snapper, snappee)) {
-    snap.dy = 0;
-    snap.dx = snappee->x1 - snapper->x1;
-
-    add_snap(snaps, snap);
-  }
-
-  /* Corner snaps */
-  /* 1->1 */
-  snap.dx = snappee->x1 - snapper->x1;
-  snap.dy = snappee->y1 - snapper->y1;
-
-  add_snap(snaps, snap);
-
-  /* 1->2 */
-  snap.dx = snappee->x2 - snapper->x1;
-  snap.dy = snappee->y2 - snapper->y1;
-
-  add_snap(snaps, snap);
-
-  /* 2->2 */
-  snap.dx = snappee->x2 - snapper->x2;
-  snap.dy = snappee->y2 - snapper->y2;
-
-  add_snap(snaps, snap);
-
-  /* 2->1 */
-  snap.dx = snappee->x1 - snapper->x2;
-  snap.dy = snappee->y1 - snapper->y2;
-
-  add_snap(snaps, snap);
-}
-
-static void list_snaps(MateRROutputInfo *output, GArray *edges, GArray *snaps) {
-  guint i;
-
-  for (i = 0; i < edges->len; ++i) {
-    Edge *output_edge = &(g_array_index(edges, Edge, i));
-
-    if (output_edge->output == output) {
-      guint j;
-
-      for (j = 0; j < edges->len; ++j) {
-        Edge *edge = &(g_array_index(edges, Edge, j));
-
-        if (edge->output != output) add_edge_snaps(output_edge, edge, snaps);
-      }
-    }
-  }
-}
-
-static gboolean corner_on_edge(int x, int y, Edge *e) {
-  if (x == e->x1 && x == e->x2 && y >= e->y1 && y <= e->y2) return TRUE;
-
-  if (y == e->y1 && y == e->y2 && x >= e->x1 && x <= e->x2) return TRUE;
-
-  return FALSE;
-}
-
-static gboolean edges_align(Edge *e1, Edge *e2) {
-  if (corner_on_edge(e1->x1, e1->y1, e2)) return TRUE;
-
-  if (corner_on_edge(e2->x1, e2->y1, e1)) return TRUE;
-
-  return FALSE;
-}
-
-static gboolean output_is_aligned(MateRROutputInfo *output, GArray *edges) {
-  gboolean result = FALSE;
-  guint i;
-
-  for (i = 0; i < edges->len; ++i) {
-    Edge *output_edge = &(g_array_index(edges, Edge, i));
-
-    if (output_edge->output == output) {
-      guint j;
-
-      for (j = 0; j < edges->len; ++j) {
-        Edge *edge = &(g_array_index(edges, Edge, j));
-
-        /* We are aligned if an output edge matches
-         * an edge of another output
-         */
-        if ((edge->output != output_edge->output) &&
-            edges_align(output_edge, edge)) {
-          result = TRUE;
-          goto done;
-        }
-      }
-    }
-  }
-done:
-
-  return result;
-}
-
-static void get_output_rect(MateRROutputInfo *output, GdkRectangle *rect) {
-  mate_rr_output_info_get_geometry(output, &rect->x, &rect->y, &rect->width,
-                                   &rect->height);
-  get_geometry(output, &rect->width, &rect->height); /* accounts for rotation */
-}
-
-static gboolean output_overlaps(MateRROutputInfo *output,
-                                MateRRConfig *config) {
-  int i;
-  GdkRectangle output_rect;
-  MateRROutputInfo **outputs;
-
-  get_output_rect(output, &output_rect);
-
-  outputs = mate_rr_config_get_outputs(config);
-  for (i = 0; outputs[i]; ++i) {
-    if (outputs[i] != output && mate_rr_output_info_is_connected(outputs[i])) {
-      GdkRectangle other_rect;
-
-      get_output_rect(outputs[i], &other_rect);
-      if (gdk_rectangle_intersect(&output_rect, &other_rect, NULL)) return TRUE;
-    }
-  }
-
-  return FALSE;
-}
-
-static gboolean mate_rr_config_is_aligned(MateRRConfig *config, GArray *edges) {
-  int i;
-  gboolean result = TRUE;
-  MateRROutputInfo **outputs;
-
-  outputs = mate_rr_config_get_outputs(config);
-  for (i = 0; outputs[i]; ++i) {
-    if (mate_rr_output_info_is_connected(outputs[i])) {
-      if (!output_is_aligned(outputs[i], edges)) return FALSE;
-
-      if (output_overlaps(outputs[i], config)) return FALSE;
-    }
-  }
-
-  return result;
-}
-
 struct GrabInfo {
   int grab_x;
   int grab_y;
   int output_x;
   int output_y;
+
+  SnapEngine *snap;
 };
 
-static gboolean is_corner_snap(const Snap *s) {
-  return s->dx != 0 && s->dy != 0;
-}
-
-static int compare_snaps(gconstpointer v1, gconstpointer v2) {
-  const Snap *s1 = v1;
-  const Snap *s2 = v2;
-  int sv1 = MAX(ABS(s1->dx), ABS(s1->dy));
-  int sv2 = MAX(ABS(s2->dx), ABS(s2->dy));
-  int d;
-
-  d = sv1 - sv2;
-
-  /* This snapping algorithm is good enough for rock'n'roll, but
-   * this is probably a better:
-   *
-   *    First do a horizontal/vertical snap, then
-   *    with the new coordinates from that snap,
-   *    do a corner snap.
-   *
-   * Right now, it's confusing that corner snapping
-   * depends on the distance in an axis that you can't actually see.
-   *
-   */
-  if (d == 0) {
-    if (is_corner_snap(s1) && !is_corner_snap(s2))
-      return -1;
-    else if (is_corner_snap(s2) && !is_corner_snap(s1))
-      return 1;
-    else
-      return 0;
-  } else {
-    return d;
-  }
+static void grab_info_free(GrabInfo *info) {
+  snap_engine_free(info->snap);
+  g_free(info);
 }
 
 /* Sets a mouse cursor for a widget's window.  As a hack, you can pass
@@ -1321,13 +1038,21 @@ static void set_cursor(GtkWidget *widget, GdkCursorType type) {
   GdkCursor *cursor;
   GdkWindow *window;
 
+  window = gtk_widget_get_window(widget);
+
+  /* This is called on every motion event, keep the cursor if it is set */
+  if (window) {
+    cursor = gdk_window_get_cursor(window);
+
+    if (!cursor && type == GDK_BLANK_CURSOR) return;
+    if (cursor && gdk_cursor_get_cursor_type(cursor) == type) return;
+  }
+
   if (type == GDK_BLANK_CURSOR)
     cursor = NULL;
   else
     cursor = gdk_cursor_new_for_display(gtk_widget_get_display(widget), type);
 
-  window = gtk_widget_get_window(widget);
-
   if (window) gdk_window_set_cursor(window, cursor);
 
   if (cursor) g_object_unref(cursor);
@@ -1346,6 +1071,47 @@ static void set_monitors_tooltip(App *app, gboolean is_dragging) {
   gtk_widget_set_tooltip_text(app->area, text);
 }
 
+/* Where paint_output() draws @output, in canvas coordinates */
+static void get_output_canvas_rect(App *app, MateRROutputInfo *output,
+                                   double *x, double *y, double *width,
+                                   double *height) {
+  double scale = compute_scale(app);
+  int total_w, total_h;
+  int output_x, output_y;
+  int w, h;
+  GdkRectangle viewport;
+
+  g_list_free(list_connected_outputs(app, &total_w, &total_h));
+
+  foo_scroll_area_get_viewport(FOO_SCROLL_AREA(app->area), &viewport);
+
+  get_geometry(output, &w, &h);
+
+  viewport.height -= 2 * MARGIN;
+  viewport.width -= 2 * MARGIN;
+
+  mate_rr_output_info_get_geometry(output, &output_x, &output_y, NULL, NULL);
+  *x = output_x * scale + MARGIN + (viewport.width - total_w * scale) / 2.0;
+  *y = output_y * scale + MARGIN + (viewport.height - total_h * scale) / 2.0;
+  *width = w * scale + 0.5;
+  *height = h * scale + 0.5;
+}
+
+static void invalidate_output(App *app, MateRROutputInfo *output) {
+  double x, y, width, height;
+  int x1, y1, x2, y2;
+
+  get_output_canvas_rect(app, output, &x, &y, &width, &height);
+
+  x1 = (int)floor(x);
+  y1 = (int)floor(y);
+  x2 = (int)ceil(x + width);
+  y2 = (int)ceil(y + height);
+
+  foo_scroll_area_invalidate_rect(FOO_SCROLL_AREA(app->area), x1, y1, x2 - x1,
+                                  y2 - y1);
+}
+
 static void on_output_event(FooScrollArea *area, FooScrollAreaEvent *event,
                             gpointer data) {
   MateRROutputInfo *output = data;
@@ -1370,6 +1136,9 @@ static void on_output_event(FooScrollArea *area, FooScrollAreaEvent *event,
     if (!mate_rr_config_get_clone(app->current_configuration) &&
         get_n_connected(app) > 1) {
       int output_x, output_y;
+      LayoutOutput *layout;
+      guint n_outputs;
+
       mate_rr_output_info_get_geometry(output, &output_x, &output_y, NULL,
                                        NULL);
 
@@ -1381,6 +1150,12 @@ static void on_output_event(FooScrollArea *area, FooScrollAreaEvent *event,
       info->output_x = output_x;
       info->output_y = output_y;
 
+      layout = get_layout(app->current_configuration, &n_outputs);
+      info->snap = snap_engine_new(
+          layout, n_outputs,
+          get_layout_index(app->current_configuration, output));
+      g_free(layout);
+
       g_object_set_data(G_OBJECT(output), "grab-info", info);
     }
 
@@ -1392,58 +1167,30 @@ static void on_output_event(FooScrollArea *area, FooScrollAreaEvent *event,
       int old_x, old_y;
       int width, height;
       int new_x, new_y;
-      guint i;
-      GArray *edges, *snaps, *new_edges;
 
       mate_rr_output_info_get_geometry(output, &old_x, &old_y, &width, &height);
       new_x = info->output_x + (int)((double)(event->x - info->grab_x) / scale);
       new_y = info->output_y + (int)((double)(event->y - info->grab_y) / scale);
 
-      mate_rr_output_info_set_geometry(output, new_x, new_y, width, height);
-
-      edges = g_array_new(TRUE, TRUE, sizeof(Edge));
-      snaps = g_array_new(TRUE, TRUE, sizeof(Snap));
-      new_edges = g_array_new(TRUE, TRUE, sizeof(Edge));
-
-      list_edges(app->current_configuration, edges);
-      list_snaps(output, edges, snaps);
-
-      g_array_sort(snaps, compare_snaps);
-
-      mate_rr_output_info_set_geometry(output, new_x, new_y, width, height);
-
-      for (i = 0; i < snaps->len; ++i) {
-        Snap *snap = &(g_array_index(snaps, Snap, i));
-        GArray *new_edges = g_array_new(TRUE, TRUE, sizeof(Edge));
-
-        mate_rr_output_info_set_geometry(output, new_x + snap->dx,
-                                         new_y + snap->dy, width, height);
-
-        g_array_set_size(new_edges, 0);
-        list_edges(app->current_configuration, new_edges);
-
-        if (mate_rr_config_is_aligned(app->current_configuration, new_edges)) {
-          g_array_free(new_edges, TRUE);
-          break;
-        } else {
-          mate_rr_output_info_set_geometry(output, info->output_x,
-                                           info->output_y, width, height);
-        }
+      if (!snap_engine_snap(info->snap, &new_x, &new_y)) {
+        new_x = info->output_x;
+        new_y = info->output_y;
       }
 
-      g_array_free(new_edges, TRUE);
-      g_array_free(snaps, TRUE);
-      g_array_free(edges, TRUE);
+      /* Only the output's old and new place need to be repainted */
+      if (new_x != old_x || new_y != old_y) {
+        invalidate_output(app, output);
+        mate_rr_output_info_set_geometry(output, new_x, new_y, width, height);
+        invalidate_output(app, output);
+      }
 
       if (event->type == FOO_BUTTON_RELEASE) {
         foo_scroll_area_end_grab(area);
         set_monitors_tooltip(app, FALSE);
 
-        g_free(g_object_get_data(G_OBJECT(output), "grab-info"));
+        grab_info_free(g_object_get_data(G_OBJECT(output), "grab-info"));
         g_object_set_data(G_OBJECT(output), "grab-info", NULL);
       }
-
-      foo_scroll_area_invalidate(area);
     }
   }
 }
@@ -1627,17 +1374,25 @@ static void on_area_paint(FooScrollArea *area, cairo_t *cr, gpointer data) {
   App *app = data;
   GList *connected_outputs = NULL;
   GList *list;
+  double clip_x1, clip_y1, clip_x2, clip_y2;
 
   paint_background(area, cr);
 
   if (!app->current_configuration) return;
 
+  cairo_clip_extents(cr, &clip_x1, &clip_y1, &clip_x2, &clip_y2);
+
   connected_outputs = list_connected_outputs(app, NULL, NULL);
 
   for (list = connected_outputs; list != NULL; list = list->next) {
+    double x, y, width, height;
     int pos;
 
-    if ((pos = g_list_position(connected_outputs, list)) != -1)
+    /* Outputs outside of the repainted area keep their pixels and input */
+    get_output_canvas_rect(app, list->data, &x, &y, &width, &height);
+    if (x < clip_x2 && y < clip_y2 && x + width > clip_x1 &&
+        y + height > clip_y1 &&
+        (pos = g_list_position(connected_outputs, list)) != -1)
       paint_output(app, cr, (guint)pos);
 
     if (mate_rr_config_get_clone(app->current_configuration)) break;
@@ -1669,37 +1424,16 @@ static void make_text_combo(GtkWidget *widget, int sort_column) {
   }
 }
 
-static void compute_virtual_size_for_configuration(MateRRConfig *config,
-                                                   int *ret_width,
-                                                   int *ret_height) {
-  int i;
-  int width, height;
-  int output_x, output_y, output_width, output_height;
-  MateRROutputInfo **outputs;
-
-  width = height = 0;
-
-  outputs = mate_rr_config_get_outputs(config);
-  for (i = 0; outputs[i] != NULL; i++) {
-    if (mate_rr_output_info_is_active(outputs[i])) {
-      mate_rr_output_info_get_geometry(outputs[i], &output_x, &output_y,
-                                       &output_width, &output_height);
-      width = MAX(width, output_x + output_width);
-      height = MAX(height, output_y + output_height);
-    }
-  }
-
-  *ret_width = width;
-  *ret_height = height;
-}
-
 static void check_required_virtual_size(App *app) {
   int req_width, req_height;
   int min_width, max_width;
   int min_height, max_height;
+  LayoutOutput *layout;
+  guint n_outputs;
 
-  compute_virtual_size_for_configuration(app->current_configuration, &req_width,
-                                         &req_height);
+  layout = get_layout(app->current_configuration, &n_outputs);
+  layout_get_virtual_size(layout, n_outputs, &req_width, &req_height);
+  g_free(layout);
 
   mate_rr_screen_get_ranges(app->screen, &min_width, &max_width, &min_height,
                             &max_height);
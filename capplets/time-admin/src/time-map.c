@@ -35,6 +35,15 @@
 #define PIN_HOT_POINT_X 8
 #define PIN_HOT_POINT_Y 15
 
+/* edge of a square bucket of the location grid, in pixels */
+#define GRID_CELL_SIZE 32
+
+typedef struct {
+  gdouble x;
+  gdouble y;
+  TzLocation *location;
+} TzLocationPoint;
+
 typedef struct {
   gdouble offset;
   guchar red;
@@ -44,6 +53,23 @@ typedef struct {
 } TimezoneMapOffset;
 enum { LOCATION_CHANGED, LAST_SIGNAL };
 
+struct TzLocationGrid {
+  gint width;
+  gint height;
+
+  gdouble origin_x;
+  gdouble origin_y;
+  gint columns;
+  gint rows;
+
+  /* the points of cell i are points[cells[i]] to points[cells[i + 1] - 1] */
+  guint *cells;
+  TzLocationPoint *points;
+};
+
+static TzLocationGrid *location_grid_new(TzDB *tzdb, gint width, gint height);
+static void location_grid_free(TzLocationGrid *grid);
+
 G_DEFINE_TYPE(TimezoneMap, timezone_map, GTK_TYPE_WIDGET)
 static guint signals[LAST_SIGNAL];
 static TimezoneMapOffset color_codes[] = {
@@ -76,6 +102,7 @@ static void cc_timezone_map_dispose(GObject *object) {
   g_clear_object(&self->orig_color_map);
   g_clear_object(&self->background);
   g_clear_object(&self->pin);
+  g_clear_pointer(&self->highlights, g_hash_table_unref);
   g_clear_pointer(&self->bubble_text, g_free);
 
   if (self->color_map) {
@@ -90,6 +117,7 @@ static void cc_timezone_map_dispose(GObject *object) {
 static void timezone_map_finalize(GObject *object) {
   TimezoneMap *self = TIMEZONEMAP(object);
 
+  g_clear_pointer(&self->grid, location_grid_free);
   g_clear_pointer(&self->tzdb, TimeZoneDateBaseFree);
 
   G_OBJECT_CLASS(timezone_map_parent_class)->finalize(object);
@@ -118,8 +146,14 @@ static void cc_timezone_map_get_preferred_height(GtkWidget *widget,
 static void cc_timezone_map_size_allocate(GtkWidget *widget,
                                           GtkAllocation *allocation) {
   TimezoneMap *map = TIMEZONEMAP(widget);
+  GtkAllocation old_allocation;
   GdkPixbuf *pixbuf;
 
+  gtk_widget_get_allocation(widget, &old_allocation);
+  if (old_allocation.width != allocation->width ||
+      old_allocation.height != allocation->height)
+    g_hash_table_remove_all(map->highlights);
+
   if (map->background) g_object_unref(map->background);
 
   if (!gtk_widget_is_sensitive(widget))
@@ -138,6 +172,14 @@ static void cc_timezone_map_size_allocate(GtkWidget *widget,
 
   map->visible_map_pixels = gdk_pixbuf_get_pixels(map->color_map);
   map->visible_map_rowstride = gdk_pixbuf_get_rowstride(map->color_map);
+
+  if (!map->grid || map->grid->width != allocation->width ||
+      map->grid->height != allocation->height) {
+    g_clear_pointer(&map->grid, location_grid_free);
+    map->grid = location_grid_new(map->tzdb, allocation->width,
+                                  allocation->height);
+  }
+
   GTK_WIDGET_CLASS(timezone_map_parent_class)
       ->size_allocate(widget, allocation);
 }
@@ -197,6 +239,138 @@ static gdouble convert_latitude_to_y(gdouble latitude, gdouble map_height) {
   return y;
 }
 
+static void location_grid_free(TzLocationGrid *grid) {
+  g_free(grid->cells);
+  g_free(grid->points);
+  g_free(grid);
+}
+
+static gint location_grid_column(TzLocationGrid *grid, gdouble x) {
+  gint column;
+
+  column = floor((x - grid->origin_x) / GRID_CELL_SIZE);
+
+  return CLAMP(column, 0, grid->columns - 1);
+}
+
+static gint location_grid_row(TzLocationGrid *grid, gdouble y) {
+  gint row;
+
+  row = floor((y - grid->origin_y) / GRID_CELL_SIZE);
+
+  return CLAMP(row, 0, grid->rows - 1);
+}
+
+/* Projects every location onto a map of the given size and buckets the
+ * points into square cells covering their bounding box, so a lookup only
+ * has to look at the cells around the queried point. */
+static TzLocationGrid *location_grid_new(TzDB *tzdb, gint width, gint height) {
+  TzLocationGrid *grid;
+  GPtrArray *locations;
+  TzLocationPoint *points;
+  gdouble max_x, max_y;
+  guint *cell_of;
+  guint n_cells;
+  guint i;
+
+  locations = tz_get_locations(tzdb);
+  if (locations->len == 0) return NULL;
+
+  grid = g_new0(TzLocationGrid, 1);
+  grid->width = width;
+  grid->height = height;
+
+  points = g_new(TzLocationPoint, locations->len);
+  grid->origin_x = grid->origin_y = G_MAXDOUBLE;
+  max_x = max_y = -G_MAXDOUBLE;
+
+  for (i = 0; i < locations->len; i++) {
+    TzLocation *loc = locations->pdata[i];
+
+    points[i].x = convert_longitude_to_x(loc->longitude, width);
+    points[i].y = convert_latitude_to_y(loc->latitude, height);
+    points[i].location = loc;
+
+    grid->origin_x = MIN(grid->origin_x, points[i].x);
+    grid->origin_y = MIN(grid->origin_y, points[i].y);
+    max_x = MAX(max_x, points[i].x);
+    max_y = MAX(max_y, points[i].y);
+  }
+
+  grid->columns = floor((max_x - grid->origin_x) / GRID_CELL_SIZE) + 1;
+  grid->rows = floor((max_y - grid->origin_y) / GRID_CELL_SIZE) + 1;
+  n_cells = grid->columns * grid->rows;
+
+  /* counting sort of the points by cell */
+  grid->cells = g_new0(guint, n_cells + 1);
+  cell_of = g_new(guint, locations->len);
+
+  for (i = 0; i < locations->len; i++) {
+    cell_of[i] = location_grid_row(grid, points[i].y) * grid->columns +
+                 location_grid_column(grid, points[i].x);
+    grid->cells[cell_of[i]]++;
+  }
+  for (i = 1; i < n_cells; i++) grid->cells[i] += grid->cells[i - 1];
+  grid->cells[n_cells] = locations->len;
+
+  grid->points = g_new(TzLocationPoint, locations->len);
+  for (i = locations->len; i > 0; i--)
+    grid->points[--grid->cells[cell_of[i - 1]]] = points[i - 1];
+
+  g_free(cell_of);
+  g_free(points);
+
+  return grid;
+}
+
+/* Returns the location nearest to the given point of the map, searching the
+ * cells in growing rings around it until no closer point can be left. */
+static TzLocation *location_grid_nearest(TzLocationGrid *grid, gdouble x,
+                                         gdouble y) {
+  TzLocation *nearest = NULL;
+  gdouble best = G_MAXDOUBLE;
+  gdouble reach;
+  gint column, row;
+  gint ring, max_ring;
+
+  column = location_grid_column(grid, x);
+  row = location_grid_row(grid, y);
+  max_ring = MAX(grid->columns, grid->rows);
+
+  for (ring = 0; ring < max_ring; ring++) {
+    gint r, c;
+
+    for (r = row - ring; r <= row + ring; r++) {
+      if (r < 0 || r >= grid->rows) continue;
+
+      for (c = column - ring; c <= column + ring; c++) {
+        guint cell, i;
+
+        /* inner cells were searched by the previous rings */
+        if (c < 0 || c >= grid->columns) continue;
+        if (ABS(r - row) != ring && ABS(c - column) != ring) continue;
+
+        cell = r * grid->columns + c;
+        for (i = grid->cells[cell]; i < grid->cells[cell + 1]; i++) {
+          gdouble dx = grid->points[i].x - x;
+          gdouble dy = grid->points[i].y - y;
+
+          if (dx * dx + dy * dy < best) {
+            best = dx * dx + dy * dy;
+            nearest = grid->points[i].location;
+          }
+        }
+      }
+    }
+
+    /* points in the next ring are at least ring cells away */
+    reach = (gdouble)ring * GRID_CELL_SIZE;
+    if (nearest && best <= reach * reach) break;
+  }
+
+  return nearest;
+}
+
 static void draw_text_bubble(cairo_t *cr, GtkWidget *widget, gdouble pointx,
                              gdouble pointy) {
   static const double corner_radius = 9.0;
@@ -267,23 +441,17 @@ static void draw_text_bubble(cairo_t *cr, GtkWidget *widget, gdouble pointx,
   cairo_restore(cr);
 }
 
-static gboolean cc_timezone_map_draw(GtkWidget *widget, cairo_t *cr) {
-  TimezoneMap *map = TIMEZONEMAP(widget);
+/* Returns the highlight of the selected offset scaled to the allocation,
+ * loading it the first time it is drawn at that size. */
+static cairo_surface_t *get_highlight(TimezoneMap *map, GtkAllocation *alloc) {
+  cairo_surface_t *surface;
   g_autoptr(GdkPixbuf) orig_hilight = NULL;
-  GtkAllocation alloc;
-  g_autofree gchar *file = NULL;
+  g_autoptr(GdkPixbuf) hilight = NULL;
   g_autoptr(GError) err = NULL;
-  gdouble pointx, pointy;
+  gchar *file;
   char buf[16];
 
-  gtk_widget_get_allocation(widget, &alloc);
-
-  /* paint background */
-  gdk_cairo_set_source_pixbuf(cr, map->background, 0, 0);
-  cairo_paint(cr);
-
-  /* paint hilight */
-  if (gtk_widget_is_sensitive(widget)) {
+  if (gtk_widget_is_sensitive(GTK_WIDGET(map))) {
     file = g_strdup_printf(
         TIMPZONEDIR "timezone_%s.png",
         g_ascii_formatd(buf, sizeof(buf), "%g", map->selected_offset));
@@ -293,18 +461,46 @@ static gboolean cc_timezone_map_draw(GtkWidget *widget, cairo_t *cr) {
         g_ascii_formatd(buf, sizeof(buf), "%g", map->selected_offset));
   }
 
+  /* failed loads are cached as NULL so they are only reported once */
+  if (g_hash_table_lookup_extended(map->highlights, file, NULL,
+                                   (gpointer *)&surface)) {
+    g_free(file);
+    return surface;
+  }
+
   orig_hilight = gdk_pixbuf_new_from_file(file, &err);
 
   if (!orig_hilight) {
     g_warning("Could not load hilight: %s",
               (err) ? err->message : "Unknown Error");
+    surface = NULL;
   } else {
-    g_autoptr(GdkPixbuf) hilight = NULL;
+    hilight = gdk_pixbuf_scale_simple(orig_hilight, alloc->width,
+                                      alloc->height, GDK_INTERP_BILINEAR);
+    surface = gdk_cairo_surface_create_from_pixbuf(hilight, 1, NULL);
+  }
+
+  g_hash_table_insert(map->highlights, file, surface);
+
+  return surface;
+}
+
+static gboolean cc_timezone_map_draw(GtkWidget *widget, cairo_t *cr) {
+  TimezoneMap *map = TIMEZONEMAP(widget);
+  cairo_surface_t *hilight;
+  GtkAllocation alloc;
+  gdouble pointx, pointy;
 
-    hilight = gdk_pixbuf_scale_simple(orig_hilight, alloc.width, alloc.height,
-                                      GDK_INTERP_BILINEAR);
-    gdk_cairo_set_source_pixbuf(cr, hilight, 0, 0);
+  gtk_widget_get_allocation(widget, &alloc);
+
+  /* paint background */
+  gdk_cairo_set_source_pixbuf(cr, map->background, 0, 0);
+  cairo_paint(cr);
 
+  /* paint hilight */
+  hilight = get_highlight(map, &alloc);
+  if (hilight) {
+    cairo_set_source_surface(cr, hilight, 0, 0);
     cairo_paint(cr);
   }
 
@@ -349,22 +545,14 @@ static void cc_timezone_map_state_flags_changed(GtkWidget *widget,
     GTK_WIDGET_CLASS(timezone_map_parent_class)
         ->state_flags_changed(widget, prev_state);
 }
-static gint sort_locations(TzLocation *a, TzLocation *b) {
-  if (a->dist > b->dist) return 1;
-
-  if (a->dist < b->dist) return -1;
-
-  return 0;
-}
-
 static void set_location(TimezoneMap *map, TzLocation *location) {
-  g_autoptr(TzInfo) info = NULL;
+  TzOffset offset;
 
   map->location = location;
-  info = tz_info_from_location(map->location);
-  map->selected_offset =
-      tz_location_get_utc_offset(map->location) / (60.0 * 60.0) +
-      ((info->daylight) ? -1.0 : 0.0);
+  tz_location_get_offset(map->location, g_get_real_time() / G_USEC_PER_SEC,
+                         &offset);
+  map->selected_offset = offset.utc_offset / (60.0 * 60.0) +
+                         ((offset.daylight) ? -1.0 : 0.0);
 
   g_signal_emit(map, signals[LOCATION_CHANGED], 0, map->location, NULL);
 }
@@ -375,11 +563,7 @@ static gboolean button_press_event(TimezoneMap *map, GdkEventButton *event) {
   guchar *pixels;
   gint rowstride;
   guint i;
-
-  const GPtrArray *array;
-  gint width, height;
-  GList *distances = NULL;
-  GtkAllocation alloc;
+  TzLocation *location;
 
   x = event->x;
   y = event->y;
@@ -401,32 +585,8 @@ static gboolean button_press_event(TimezoneMap *map, GdkEventButton *event) {
 
   gtk_widget_queue_draw(GTK_WIDGET(map));
 
-  /* work out the co-ordinates */
-
-  array = tz_get_locations(map->tzdb);
-
-  gtk_widget_get_allocation(GTK_WIDGET(map), &alloc);
-  width = alloc.width;
-  height = alloc.height;
-
-  for (i = 0; i < array->len; i++) {
-    gdouble pointx, pointy, dx, dy;
-    TzLocation *loc = array->pdata[i];
-
-    pointx = convert_longitude_to_x(loc->longitude, width);
-    pointy = convert_latitude_to_y(loc->latitude, height);
-
-    dx = pointx - x;
-    dy = pointy - y;
-
-    loc->dist = dx * dx + dy * dy;
-    distances = g_list_prepend(distances, loc);
-  }
-  distances = g_list_sort(distances, (GCompareFunc)sort_locations);
-
-  set_location(map, (TzLocation *)distances->data);
-
-  g_list_free(distances);
+  location = timezone_map_get_location_at(map, x, y);
+  if (location) set_location(map, location);
 
   return TRUE;
 }
@@ -481,6 +641,10 @@ static void timezone_map_init(TimezoneMap *map) {
     g_clear_error(&err);
   }
 
+  map->highlights =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                            (GDestroyNotify)cairo_surface_destroy);
+
   map->tzdb = tz_load_db();
 
   g_signal_connect_object(map, "button-press-event",
@@ -515,6 +679,14 @@ gboolean timezone_map_set_timezone(TimezoneMap *map, const gchar *timezone) {
 TzLocation *timezone_map_get_location(TimezoneMap *map) {
   return map->location;
 }
+/* Returns the location nearest to the given widget coordinates, or NULL if
+ * the map has not been allocated yet. */
+TzLocation *timezone_map_get_location_at(TimezoneMap *map, gdouble x,
+                                         gdouble y) {
+  if (!map->grid) return NULL;
+
+  return location_grid_nearest(map->grid, x, y);
+}
 void timezone_map_set_bubble_text(TimezoneMap *map, const gchar *text) {
   g_free(map->bubble_text);
   map->bubble_text = g_strdup(text);
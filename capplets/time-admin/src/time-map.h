@@ -33,6 +33,9 @@ G_BEGIN_DECLS
 #define TYPE_TIMEZONE_MAP (timezone_map_get_type())
 #define TIMEZONEMAP(object) \
   (G_TYPE_CHECK_INSTANCE_CAST((object), TYPE_TIMEZONE_MAP, TimezoneMap))
+
+typedef struct TzLocationGrid TzLocationGrid;
+
 typedef struct TimezoneMap {
   GtkWidget parent_instance;
   GdkPixbuf *orig_background;
@@ -42,6 +45,8 @@ typedef struct TimezoneMap {
   GdkPixbuf *background;
   GdkPixbuf *color_map;
   GdkPixbuf *pin;
+  /* highlight image file name -> cairo_surface_t scaled to the allocation */
+  GHashTable *highlights;
 
   guchar *visible_map_pixels;
   gint visible_map_rowstride;
@@ -50,6 +55,8 @@ typedef struct TimezoneMap {
 
   TzDB *tzdb;
   TzLocation *location;
+  /* locations bucketed by their position on the map at its current size */
+  TzLocationGrid *grid;
 
   gchar *bubble_text;
 } TimezoneMap;
@@ -67,6 +74,9 @@ gboolean timezone_map_set_timezone(TimezoneMap *map, const gchar *timezone);
 
 TzLocation *timezone_map_get_location(TimezoneMap *map);
 
+TzLocation *timezone_map_get_location_at(TimezoneMap *map, gdouble x,
+                                         gdouble y);
+
 TimezoneMap *timezone_map_new(void);
 
 G_END_DECLS
@@ -47,7 +47,15 @@
 static void LocationChanged(TimezoneMap *map, TzLocation *location,
                             TimeAdmin *ta);
 
-enum { CITY_COL_CITY_HUMAN_READABLE, CITY_COL_ZONE, CITY_NUM_COLS };
+static void CreateCityList(TimeAdmin *ta, TzDB *db);
+
+enum {
+  CITY_COL_CITY_HUMAN_READABLE,
+  CITY_COL_ZONE,
+  CITY_COL_OFFSET,
+  CITY_COL_LOCATION,
+  CITY_NUM_COLS
+};
 
 static gchar *tz_data_file_get(void) {
   gchar *file;
@@ -210,17 +218,26 @@ TzDB *tz_load_db(void) {
 
 static GtkWidget *GetTimeZoneMap(TimeAdmin *ta) {
   GtkWidget *map;
+  GtkCellRenderer *renderer;
   g_autoptr(GtkEntryCompletion) completion = NULL;
 
   map = (GtkWidget *)timezone_map_new();
   g_signal_connect(map, "location-changed", G_CALLBACK(LocationChanged), ta);
 
+  /* the cities point into the map's database */
+  CreateCityList(ta, TIMEZONEMAP(map)->tzdb);
+
   completion = gtk_entry_completion_new();
   gtk_entry_set_completion(GTK_ENTRY(ta->TimezoneEntry), completion);
   gtk_entry_completion_set_model(completion, GTK_TREE_MODEL(ta->CityListStore));
   gtk_entry_completion_set_text_column(completion,
                                        CITY_COL_CITY_HUMAN_READABLE);
 
+  renderer = gtk_cell_renderer_text_new();
+  gtk_cell_layout_pack_end(GTK_CELL_LAYOUT(completion), renderer, FALSE);
+  gtk_cell_layout_add_attribute(GTK_CELL_LAYOUT(completion), renderer, "text",
+                                CITY_COL_OFFSET);
+
   return map;
 }
 static char *translated_city_name(TzLocation *loc) {
@@ -312,17 +329,63 @@ static void LoadCities(TzLocation *loc, GtkListStore *CityStore) {
   human_readable = translated_city_name(loc);
   gtk_list_store_insert_with_values(
       CityStore, NULL, 0, CITY_COL_CITY_HUMAN_READABLE, human_readable,
-      CITY_COL_ZONE, loc->zone, -1);
+      CITY_COL_ZONE, loc->zone, CITY_COL_LOCATION, loc, -1);
+}
+
+static gchar *format_offset(const TzOffset *offset) {
+  glong minutes = ABS(offset->utc_offset) / 60;
+  gchar sign = offset->utc_offset < 0 ? '-' : '+';
+
+  if (offset->abbreviation == NULL) return NULL;
+
+  if (minutes % 60 == 0)
+    return g_strdup_printf("%s (UTC%c%02ld)", offset->abbreviation, sign,
+                           minutes / 60);
+
+  return g_strdup_printf("%s (UTC%c%02ld:%02ld)", offset->abbreviation, sign,
+                         minutes / 60, minutes % 60);
 }
 
-static void CreateCityList(TimeAdmin *ta) {
-  TzDB *db;
+/* Shows the current offset of every city, looked up all at once */
+static void UpdateCityOffsets(TimeAdmin *ta) {
+  GtkTreeModel *model = GTK_TREE_MODEL(ta->CityListStore);
+  g_autofree TzOffset *offsets = NULL;
+  GPtrArray *locations;
+  GtkTreeIter iter;
+  gboolean valid;
+  guint i;
+
+  locations = g_ptr_array_new();
+  for (valid = gtk_tree_model_get_iter_first(model, &iter); valid;
+       valid = gtk_tree_model_iter_next(model, &iter)) {
+    TzLocation *loc;
+
+    gtk_tree_model_get(model, &iter, CITY_COL_LOCATION, &loc, -1);
+    g_ptr_array_add(locations, loc);
+  }
+
+  offsets = g_new(TzOffset, locations->len);
+  tz_locations_get_offsets(locations, g_get_real_time() / G_USEC_PER_SEC,
+                           offsets);
 
+  i = 0;
+  for (valid = gtk_tree_model_get_iter_first(model, &iter); valid;
+       valid = gtk_tree_model_iter_next(model, &iter)) {
+    g_autofree gchar *label = format_offset(&offsets[i++]);
+
+    gtk_list_store_set(ta->CityListStore, &iter, CITY_COL_OFFSET, label, -1);
+  }
+
+  g_ptr_array_free(locations, TRUE);
+}
+
+static void CreateCityList(TimeAdmin *ta, TzDB *db) {
   ta->CityListStore =
-      gtk_list_store_new(CITY_NUM_COLS, G_TYPE_STRING, G_TYPE_STRING);
-  if ((db = tz_load_db()) != NULL) {
+      gtk_list_store_new(CITY_NUM_COLS, G_TYPE_STRING, G_TYPE_STRING,
+                         G_TYPE_STRING, G_TYPE_POINTER);
+  if (db != NULL) {
     g_ptr_array_foreach(db->locations, (GFunc)LoadCities, ta->CityListStore);
-    TimeZoneDateBaseFree(db);
+    UpdateCityOffsets(ta);
   }
 }
 
@@ -433,7 +496,6 @@ void SetupTimezoneDialog(TimeAdmin *ta) {
   TimeZoneFrame = CreateZoneFrame(ta);
   Scrolled = CreateZoneScrolled(ta);
   gtk_container_add(GTK_CONTAINER(TimeZoneFrame), Scrolled);
-  CreateCityList(ta);
   CreateZoneEntry(ta);
   gtk_box_pack_start(GTK_BOX(Vbox), ta->SearchBar, FALSE, FALSE, 0);
   ta->map = GetTimeZoneMap(ta);
@@ -539,61 +601,117 @@ char *tz_info_get_clean_name(TzDB *tz_db, const char *tz) {
   return g_strdup(ret);
 }
 
-TzInfo *tz_info_from_location(TzLocation *loc) {
-  TzInfo *tzinfo;
-  time_t curtime;
-  struct tm *curzone;
-  g_autofree gchar *tz_env_value = NULL;
+/* Zones are looked up through GTimeZone, which reads the TZif file once and
+ * answers queries for any instant without going through $TZ and tzset().
+ * Every zone used is kept here for the life of the process. */
+static GHashTable *zones;
+static GMutex zones_lock;
 
-  g_return_val_if_fail(loc != NULL, NULL);
-  g_return_val_if_fail(loc->zone != NULL, NULL);
-
-  tz_env_value = g_strdup(getenv("TZ"));
-  setenv("TZ", loc->zone, 1);
+static GTimeZone *get_zone_locked(const gchar *zone) {
+  GTimeZone *tz;
 
-  tzinfo = g_new0(TzInfo, 1);
-
-  curtime = time(NULL);
-  curzone = localtime(&curtime);
+  if (zones == NULL)
+    zones = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                  (GDestroyNotify)g_time_zone_unref);
 
-#ifndef __sun
-  tzinfo->tzname_normal = g_strdup(curzone->tm_zone);
-  if (curzone->tm_isdst)
-    tzinfo->tzname_daylight = g_strdup(&curzone->tm_zone[curzone->tm_isdst]);
-  else
-    tzinfo->tzname_daylight = NULL;
+  if (g_hash_table_lookup_extended(zones, zone, NULL, (gpointer *)&tz))
+    return tz;
 
-  tzinfo->utc_offset = curzone->tm_gmtoff;
+#if GLIB_CHECK_VERSION(2, 68, 0)
+  tz = g_time_zone_new_identifier(zone);
+  if (tz == NULL) g_warning("Could not load timezone '%s'", zone);
 #else
-  tzinfo->tzname_normal = NULL;
-  tzinfo->tzname_daylight = NULL;
-  tzinfo->utc_offset = 0;
+  tz = g_time_zone_new(zone);
 #endif
+  g_hash_table_insert(zones, g_strdup(zone), tz);
 
-  tzinfo->daylight = curzone->tm_isdst;
+  return tz;
+}
 
-  if (tz_env_value)
-    setenv("TZ", tz_env_value, 1);
-  else
-    unsetenv("TZ");
+static gboolean get_offset_locked(TzLocation *loc, gint64 instant,
+                                  TzOffset *offset) {
+  GTimeZone *tz;
+  gint interval;
+
+  tz = get_zone_locked(loc->zone);
+  if (tz == NULL) {
+    offset->utc_offset = 0;
+    offset->daylight = FALSE;
+    offset->abbreviation = NULL;
+    return FALSE;
+  }
+
+  interval = g_time_zone_find_interval(tz, G_TIME_TYPE_UNIVERSAL, instant);
+  offset->utc_offset = g_time_zone_get_offset(tz, interval);
+  offset->daylight = g_time_zone_is_dst(tz, interval);
+  offset->abbreviation = g_time_zone_get_abbreviation(tz, interval);
+
+  return TRUE;
+}
+
+/* Fills @offset with the offset of the location's zone at @instant, in seconds
+ * since the epoch.  Safe to call from any thread. */
+gboolean tz_location_get_offset(TzLocation *loc, gint64 instant,
+                                TzOffset *offset) {
+  gboolean ret;
+
+  g_return_val_if_fail(loc != NULL, FALSE);
+  g_return_val_if_fail(loc->zone != NULL, FALSE);
+
+  g_mutex_lock(&zones_lock);
+  ret = get_offset_locked(loc, instant, offset);
+  g_mutex_unlock(&zones_lock);
+
+  return ret;
+}
+
+/* Like tz_location_get_offset() for every location of @locations, filling
+ * the matching entries of @offsets. */
+void tz_locations_get_offsets(GPtrArray *locations, gint64 instant,
+                              TzOffset *offsets) {
+  guint i;
+
+  g_mutex_lock(&zones_lock);
+  for (i = 0; i < locations->len; i++)
+    get_offset_locked(locations->pdata[i], instant, &offsets[i]);
+  g_mutex_unlock(&zones_lock);
+}
+
+TzInfo *tz_info_from_location(TzLocation *loc) {
+  TzInfo *tzinfo;
+  TzOffset offset;
+
+  g_return_val_if_fail(loc != NULL, NULL);
+  g_return_val_if_fail(loc->zone != NULL, NULL);
+
+  tz_location_get_offset(loc, time(NULL), &offset);
+
+  tzinfo = g_new0(TzInfo, 1);
+  tzinfo->tzname_normal = g_strdup(offset.abbreviation);
+  if (offset.daylight)
+    tzinfo->tzname_daylight = g_strdup(offset.abbreviation);
+  tzinfo->utc_offset = offset.utc_offset;
+  tzinfo->daylight = offset.daylight;
 
   return tzinfo;
 }
 
 glong tz_location_get_utc_offset(TzLocation *loc) {
-  TzInfo *tz_info;
-  glong offset;
+  TzOffset offset;
+
+  g_return_val_if_fail(loc != NULL, 0);
+  g_return_val_if_fail(loc->zone != NULL, 0);
 
-  tz_info = tz_info_from_location(loc);
-  offset = tz_info->utc_offset;
-  tz_info_free(tz_info);
+  tz_location_get_offset(loc, time(NULL), &offset);
 
-  return offset;
+  return offset.utc_offset;
 }
 
 void RunTimeZoneDialog(GtkButton *button, gpointer data) {
   TimeAdmin *ta = (TimeAdmin *)data;
 
+  /* daylight saving time may have started since the dialog was set up */
+  UpdateCityOffsets(ta);
   gtk_widget_show_all(GTK_WIDGET(ta->dialog));
 }
 
@@ -46,8 +46,6 @@ typedef struct TzLocation {
   gdouble longitude;
   gchar *zone;
   gchar *comment;
-
-  gdouble dist; /* distance to clicked point for comparison */
 } TzLocation;
 
 typedef struct TzInfo {
@@ -56,6 +54,14 @@ typedef struct TzInfo {
   glong utc_offset;
   gint daylight;
 } TzInfo;
+
+typedef struct TzOffset {
+  glong utc_offset;
+  gboolean daylight;
+  /* owned by the zone cache, valid for the life of the process */
+  const gchar *abbreviation;
+} TzOffset;
+
 TzDB *tz_load_db(void);
 
 void SetupTimezoneDialog(TimeAdmin *ta);
@@ -70,6 +76,12 @@ TzInfo *tz_info_from_location(TzLocation *loc);
 
 glong tz_location_get_utc_offset(TzLocation *loc);
 
+gboolean tz_location_get_offset(TzLocation *loc, gint64 instant,
+                                TzOffset *offset);
+
+void tz_locations_get_offsets(GPtrArray *locations, gint64 instant,
+                              TzOffset *offsets);
+
 char *tz_info_get_clean_name(TzDB *tz_db, const char *tz);
 
 void tz_info_free(TzInfo *tzinfo);
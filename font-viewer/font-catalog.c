@@ -0,0 +1,411 @@
+/* -*- mode: C; c-basic-offset: 4 -*-
+ * mate-font-viewer
+ *
+ * Copyright (C) 2013-2021 MATE Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "font-catalog.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Bump this whenever the records or the way faces are named change */
+#define CATALOG_VERSION 1
+
+#define CATALOG_GROUP "Catalog"
+
+/* seconds to wait after a thumbnail state changed before writing */
+#define SAVE_DELAY 5
+
+/* The key file has a group per font file, named after its path, holding the
+ * stamp of the file and a set of keys for each of its faces. */
+struct _FontCatalog {
+  GMutex lock;
+  /* "path:index" -> FontCatalogFace */
+  GHashTable *faces;
+  gboolean dirty;
+  guint save_id;
+};
+
+FontCatalogFace *font_catalog_face_copy(const FontCatalogFace *face) {
+  FontCatalogFace *copy = g_slice_dup(FontCatalogFace, face);
+
+  copy->path = g_strdup(face->path);
+  copy->name = g_strdup(face->name);
+  copy->collation_key = g_strdup(face->collation_key);
+
+  return copy;
+}
+
+void font_catalog_face_free(FontCatalogFace *face) {
+  g_free(face->path);
+  g_free(face->name);
+  g_free(face->collation_key);
+
+  g_slice_free(FontCatalogFace, face);
+}
+
+static gchar *face_key(const gchar *path, gint face_index) {
+  return g_strdup_printf("%s:%d", path, face_index);
+}
+
+static gboolean face_equal(const FontCatalogFace *a, const FontCatalogFace *b) {
+  return a->face_index == b->face_index && a->mtime == b->mtime &&
+         a->size == b->size && g_strcmp0(a->path, b->path) == 0 &&
+         g_strcmp0(a->name, b->name) == 0;
+}
+
+static gchar *catalog_filename(void) {
+  return g_build_filename(g_get_user_cache_dir(), "mate-font-viewer",
+                          "catalog", NULL);
+}
+
+static const gchar *collate_locale(void) {
+  const gchar *locale = setlocale(LC_COLLATE, NULL);
+
+  return locale != NULL ? locale : "C";
+}
+
+static const gchar *thumbnail_to_string(FontCatalogThumbnail thumbnail) {
+  switch (thumbnail) {
+    case FONT_CATALOG_THUMBNAIL_CACHED:
+      return "cached";
+    case FONT_CATALOG_THUMBNAIL_FAILED:
+      return "failed";
+    default:
+      return NULL;
+  }
+}
+
+static FontCatalogThumbnail thumbnail_from_string(const gchar *str) {
+  if (g_strcmp0(str, "cached") == 0) return FONT_CATALOG_THUMBNAIL_CACHED;
+  if (g_strcmp0(str, "failed") == 0) return FONT_CATALOG_THUMBNAIL_FAILED;
+
+  return FONT_CATALOG_THUMBNAIL_UNKNOWN;
+}
+
+static void load_file_group(FontCatalog *catalog, GKeyFile *key_file,
+                            const gchar *path) {
+  gchar *stamp, **face_indices, **p;
+  gint64 mtime, size;
+
+  stamp = g_key_file_get_string(key_file, path, "Stamp", NULL);
+  if (stamp == NULL ||
+      sscanf(stamp, "%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT, &mtime, &size) !=
+          2) {
+    g_free(stamp);
+    return;
+  }
+  g_free(stamp);
+
+  face_indices =
+      g_key_file_get_string_list(key_file, path, "Faces", NULL, NULL);
+  if (face_indices == NULL) return;
+
+  for (p = face_indices; *p != NULL; p++) {
+    FontCatalogFace *face;
+    gchar *name_key, *collation_key, *thumbnail_key, *thumbnail, *encoded;
+    gsize length;
+
+    name_key = g_strconcat("Name-", *p, NULL);
+    collation_key = g_strconcat("Key-", *p, NULL);
+    thumbnail_key = g_strconcat("Thumbnail-", *p, NULL);
+
+    face = g_slice_new0(FontCatalogFace);
+    face->path = g_strdup(path);
+    face->face_index = atoi(*p);
+    face->mtime = mtime;
+    face->size = size;
+    face->name = g_key_file_get_string(key_file, path, name_key, NULL);
+
+    /* collation keys are not text, so they are stored encoded */
+    encoded = g_key_file_get_value(key_file, path, collation_key, NULL);
+    if (encoded != NULL) {
+      guchar *decoded = g_base64_decode(encoded, &length);
+
+      face->collation_key = g_strndup((const gchar *)decoded, length);
+      g_free(decoded);
+      g_free(encoded);
+    }
+
+    thumbnail = g_key_file_get_value(key_file, path, thumbnail_key, NULL);
+    face->thumbnail = thumbnail_from_string(thumbnail);
+    g_free(thumbnail);
+
+    if (face->name != NULL && face->collation_key != NULL)
+      g_hash_table_insert(catalog->faces,
+                          face_key(face->path, face->face_index), face);
+    else
+      font_catalog_face_free(face);
+
+    g_free(thumbnail_key);
+    g_free(collation_key);
+    g_free(name_key);
+  }
+
+  g_strfreev(face_indices);
+}
+
+FontCatalog *font_catalog_new(void) {
+  FontCatalog *catalog = g_slice_new0(FontCatalog);
+  GKeyFile *key_file = g_key_file_new();
+  gchar *filename = catalog_filename();
+  gchar *locale, **groups;
+  gsize n_groups, i;
+
+  g_mutex_init(&catalog->lock);
+  catalog->faces = g_hash_table_new_full(
+      g_str_hash, g_str_equal, g_free, (GDestroyNotify)font_catalog_face_free);
+
+  if (!g_key_file_load_from_file(key_file, filename, G_KEY_FILE_NONE, NULL))
+    goto out;
+
+  /* collation keys only hold for the locale they were made in */
+  locale = g_key_file_get_string(key_file, CATALOG_GROUP, "Locale", NULL);
+  if (g_key_file_get_integer(key_file, CATALOG_GROUP, "Version", NULL) !=
+          CATALOG_VERSION ||
+      g_strcmp0(locale, collate_locale()) != 0) {
+    g_free(locale);
+    goto out;
+  }
+  g_free(locale);
+
+  groups = g_key_file_get_groups(key_file, &n_groups);
+  for (i = 0; i < n_groups; i++) {
+    if (strcmp(groups[i], CATALOG_GROUP) != 0)
+      load_file_group(catalog, key_file, groups[i]);
+  }
+  g_strfreev(groups);
+
+out:
+  g_key_file_free(key_file);
+  g_free(filename);
+
+  return catalog;
+}
+
+void font_catalog_free(FontCatalog *catalog) {
+  font_catalog_save(catalog);
+
+  g_hash_table_destroy(catalog->faces);
+  g_mutex_clear(&catalog->lock);
+
+  g_slice_free(FontCatalog, catalog);
+}
+
+GPtrArray *font_catalog_get_faces(FontCatalog *catalog) {
+  GPtrArray *faces;
+  GHashTableIter iter;
+  gpointer face;
+
+  g_mutex_lock(&catalog->lock);
+
+  faces = g_ptr_array_new_full(g_hash_table_size(catalog->faces),
+                               (GDestroyNotify)font_catalog_face_free);
+  g_hash_table_iter_init(&iter, catalog->faces);
+  while (g_hash_table_iter_next(&iter, NULL, &face))
+    g_ptr_array_add(faces, font_catalog_face_copy(face));
+
+  g_mutex_unlock(&catalog->lock);
+
+  return faces;
+}
+
+FontCatalogFace *font_catalog_lookup(FontCatalog *catalog, const gchar *path,
+                                     gint face_index, gint64 mtime,
+                                     gint64 size) {
+  FontCatalogFace *face, *copy = NULL;
+  gchar *key = face_key(path, face_index);
+
+  g_mutex_lock(&catalog->lock);
+
+  face = g_hash_table_lookup(catalog->faces, key);
+  if (face != NULL && face->mtime == mtime && face->size == size)
+    copy = font_catalog_face_copy(face);
+
+  g_mutex_unlock(&catalog->lock);
+
+  g_free(key);
+
+  return copy;
+}
+
+gboolean font_catalog_set_faces(FontCatalog *catalog, GPtrArray *faces) {
+  GHashTable *old_faces;
+  gboolean changed;
+  guint i;
+
+  g_mutex_lock(&catalog->lock);
+
+  old_faces = catalog->faces;
+  catalog->faces = g_hash_table_new_full(
+      g_str_hash, g_str_equal, g_free, (GDestroyNotify)font_catalog_face_free);
+
+  changed = g_hash_table_size(old_faces) != faces->len;
+
+  for (i = 0; i < faces->len; i++) {
+    FontCatalogFace *face = g_ptr_array_index(faces, i);
+    gchar *key = face_key(face->path, face->face_index);
+    FontCatalogFace *old_face = g_hash_table_lookup(old_faces, key);
+
+    if (old_face == NULL || !face_equal(face, old_face)) changed = TRUE;
+
+    g_hash_table_replace(catalog->faces, key, font_catalog_face_copy(face));
+  }
+
+  catalog->dirty |= changed;
+
+  g_mutex_unlock(&catalog->lock);
+
+  g_hash_table_destroy(old_faces);
+
+  return changed;
+}
+
+void font_catalog_set_thumbnail(FontCatalog *catalog, const gchar *path,
+                                gint face_index,
+                                FontCatalogThumbnail thumbnail) {
+  FontCatalogFace *face;
+  gchar *key = face_key(path, face_index);
+
+  g_mutex_lock(&catalog->lock);
+
+  face = g_hash_table_lookup(catalog->faces, key);
+  if (face != NULL && face->thumbnail != thumbnail) {
+    face->thumbnail = thumbnail;
+    catalog->dirty = TRUE;
+  }
+
+  g_mutex_unlock(&catalog->lock);
+
+  g_free(key);
+}
+
+static void save_face(GKeyFile *key_file, const FontCatalogFace *face) {
+  gchar *index, *key, *value, *stamp;
+  const gchar *thumbnail;
+
+  /* group names can't hold brackets, such files are just read every time */
+  if (strpbrk(face->path, "[]\n") != NULL) return;
+
+  index = g_strdup_printf("%d", face->face_index);
+
+  stamp = g_strdup_printf("%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT,
+                          face->mtime, face->size);
+  g_key_file_set_string(key_file, face->path, "Stamp", stamp);
+  g_free(stamp);
+
+  value = g_key_file_get_value(key_file, face->path, "Faces", NULL);
+  if (value != NULL) {
+    gchar *faces = g_strconcat(value, index, ";", NULL);
+
+    g_key_file_set_value(key_file, face->path, "Faces", faces);
+    g_free(faces);
+    g_free(value);
+  } else {
+    value = g_strconcat(index, ";", NULL);
+    g_key_file_set_value(key_file, face->path, "Faces", value);
+    g_free(value);
+  }
+
+  key = g_strconcat("Name-", index, NULL);
+  g_key_file_set_string(key_file, face->path, key, face->name);
+  g_free(key);
+
+  key = g_strconcat("Key-", index, NULL);
+  value = g_base64_encode((const guchar *)face->collation_key,
+                          strlen(face->collation_key));
+  g_key_file_set_value(key_file, face->path, key, value);
+  g_free(value);
+  g_free(key);
+
+  thumbnail = thumbnail_to_string(face->thumbnail);
+  if (thumbnail != NULL) {
+    key = g_strconcat("Thumbnail-", index, NULL);
+    g_key_file_set_value(key_file, face->path, key, thumbnail);
+    g_free(key);
+  }
+
+  g_free(index);
+}
+
+void font_catalog_save(FontCatalog *catalog) {
+  GKeyFile *key_file;
+  GHashTableIter iter;
+  gpointer face;
+  gchar *filename, *dirname, *contents;
+  gsize length;
+  GError *error = NULL;
+
+  if (catalog->save_id != 0) {
+    g_source_remove(catalog->save_id);
+    catalog->save_id = 0;
+  }
+
+  g_mutex_lock(&catalog->lock);
+
+  if (!catalog->dirty) {
+    g_mutex_unlock(&catalog->lock);
+    return;
+  }
+
+  key_file = g_key_file_new();
+  g_key_file_set_integer(key_file, CATALOG_GROUP, "Version", CATALOG_VERSION);
+  g_key_file_set_string(key_file, CATALOG_GROUP, "Locale", collate_locale());
+
+  g_hash_table_iter_init(&iter, catalog->faces);
+  while (g_hash_table_iter_next(&iter, NULL, &face))
+    save_face(key_file, face);
+
+  catalog->dirty = FALSE;
+
+  g_mutex_unlock(&catalog->lock);
+
+  filename = catalog_filename();
+  dirname = g_path_get_dirname(filename);
+  contents = g_key_file_to_data(key_file, &length, NULL);
+
+  if (g_mkdir_with_parents(dirname, 0700) != 0 ||
+      !g_file_set_contents(filename, contents, length, &error)) {
+    g_warning("Could not write the font catalog %s: %s", filename,
+              error ? error->message : g_strerror(errno));
+    g_clear_error(&error);
+  }
+
+  g_free(contents);
+  g_free(dirname);
+  g_free(filename);
+  g_key_file_free(key_file);
+}
+
+static gboolean save_timeout(gpointer data) {
+  FontCatalog *catalog = data;
+
+  catalog->save_id = 0;
+  font_catalog_save(catalog);
+
+  return FALSE;
+}
+
+void font_catalog_save_later(FontCatalog *catalog) {
+  if (catalog->save_id == 0)
+    catalog->save_id = g_timeout_add_seconds(SAVE_DELAY, save_timeout, catalog);
+}
@@ -0,0 +1,73 @@
+/* -*- mode: C; c-basic-offset: 4 -*-
+ * mate-font-viewer
+ *
+ * Copyright (C) 2013-2021 MATE Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __FONT_CATALOG_H__
+#define __FONT_CATALOG_H__
+
+#include <glib.h>
+
+/* On-disk cache of the faces listed in the overview, so it can be filled
+ * without opening every font file with FreeType. */
+
+typedef enum {
+  FONT_CATALOG_THUMBNAIL_UNKNOWN,
+  FONT_CATALOG_THUMBNAIL_CACHED,
+  FONT_CATALOG_THUMBNAIL_FAILED
+} FontCatalogThumbnail;
+
+typedef struct {
+  gchar *path;
+  gint face_index;
+  gchar *name;
+  gchar *collation_key;
+
+  /* of the font file when the face was read */
+  gint64 mtime;
+  gint64 size;
+
+  FontCatalogThumbnail thumbnail;
+} FontCatalogFace;
+
+typedef struct _FontCatalog FontCatalog;
+
+FontCatalogFace *font_catalog_face_copy(const FontCatalogFace *face);
+void font_catalog_face_free(FontCatalogFace *face);
+
+FontCatalog *font_catalog_new(void);
+void font_catalog_free(FontCatalog *catalog);
+
+/* Returns the faces in the catalog, free with g_ptr_array_unref(). */
+GPtrArray *font_catalog_get_faces(FontCatalog *catalog);
+/* Returns a copy of the record for the face if it was read from a file with
+ * the same mtime and size, NULL otherwise.  Can be called from any thread. */
+FontCatalogFace *font_catalog_lookup(FontCatalog *catalog, const gchar *path,
+                                     gint face_index, gint64 mtime,
+                                     gint64 size);
+/* Replaces the catalog with copies of @faces; returns TRUE if that changed
+ * which faces it lists. */
+gboolean font_catalog_set_faces(FontCatalog *catalog, GPtrArray *faces);
+void font_catalog_set_thumbnail(FontCatalog *catalog, const gchar *path,
+                                gint face_index,
+                                FontCatalogThumbnail thumbnail);
+
+void font_catalog_save(FontCatalog *catalog);
+void font_catalog_save_later(FontCatalog *catalog);
+
+#endif /* __FONT_CATALOG_H__ */
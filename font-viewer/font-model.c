@@ -27,6 +27,7 @@
 
 #include <errno.h>
 #include <ft2build.h>
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -37,6 +38,7 @@
 #define MATE_DESKTOP_USE_UNSTABLE_API
 #include <libmate-desktop/mate-desktop-thumbnail.h>
 
+#include "font-catalog.h"
 #include "font-model.h"
 #include "font-utils.h"
 #include "sushi-font-loader.h"
@@ -49,8 +51,25 @@ struct _FontViewModelPrivate {
   FT_Library library;
 
   GList *monitors;
+  guint reload_id;
   GdkPixbuf *fallback_icon;
   GCancellable *cancellable;
+
+  /* names of the faces listed last time, checked against the font files */
+  FontCatalog *catalog;
+  /* "path:index" -> FaceRow, for every row of the store */
+  GHashTable *rows;
+  guint rows_serial;
+
+  /* thumbnails are made by a pool of workers, visible rows first */
+  GThreadPool *thumbnail_pool;
+  GHashTable *pending_thumbnails;
+  guint thumbnail_sequence;
+  guint visible_serial;
+
+  /* finished thumbnails wait here to be applied a frame's worth at a time */
+  GAsyncQueue *finished_thumbnails;
+  gint flush_scheduled;
 };
 
 enum { CONFIG_CHANGED, NUM_SIGNALS };
@@ -66,6 +85,17 @@ G_DEFINE_TYPE_WITH_PRIVATE(FontViewModel, font_view_model, GTK_TYPE_LIST_STORE);
 #define ATTRIBUTES_FOR_EXISTING_THUMBNAIL \
   G_FILE_ATTRIBUTE_THUMBNAIL_PATH "," G_FILE_ATTRIBUTE_THUMBNAILING_FAILED
 
+/* milliseconds to wait for a font directory to settle before reloading */
+#define RELOAD_DELAY 500
+
+#define MAX_THUMBNAIL_WORKERS 8
+/* one frame at 60 Hz, and the share of it spent updating rows */
+#define THUMBNAIL_FLUSH_INTERVAL 16
+#define THUMBNAIL_FLUSH_BUDGET 5000
+
+/* every worker thread keeps its own factory */
+static GPrivate thumbnail_factory = G_PRIVATE_INIT(g_object_unref);
+
 typedef struct {
   const gchar *file;
   FT_Face face;
@@ -115,12 +145,20 @@ gboolean font_view_model_get_iter_for_face(FontViewModel *self, FT_Face face,
 
 typedef struct {
   FontViewModel *self;
+  /* set once the row went away or changed, the job is skipped then */
+  gint dropped;
   GFile *font_file;
   gchar *font_path;
   gint face_index;
   gchar *uri;
   GdkPixbuf *pixbuf;
   GtkTreeIter iter;
+  FontCatalogThumbnail thumbnail;
+
+  /* queue order, only touched from the main thread */
+  guint sequence;
+  guint visible_serial;
+  guint visible_rank;
 } ThumbInfoData;
 
 static void thumb_info_data_free(gpointer user_data) {
@@ -135,18 +173,71 @@ static void thumb_info_data_free(gpointer user_data) {
   g_slice_free(ThumbInfoData, thumb_info);
 }
 
-static gboolean one_thumbnail_done(gpointer user_data) {
-  ThumbInfoData *thumb_info = user_data;
+static void apply_thumbnail(ThumbInfoData *thumb_info) {
+  FontViewModelPrivate *priv = thumb_info->self->priv;
+
+  if (!g_atomic_int_get(&thumb_info->dropped)) {
+    g_hash_table_remove(priv->pending_thumbnails, thumb_info->iter.user_data);
 
-  if (thumb_info->pixbuf != NULL)
-    gtk_list_store_set(GTK_LIST_STORE(thumb_info->self), &(thumb_info->iter),
-                       COLUMN_ICON, thumb_info->pixbuf, -1);
+    if (thumb_info->pixbuf != NULL)
+      gtk_list_store_set(GTK_LIST_STORE(thumb_info->self), &(thumb_info->iter),
+                         COLUMN_ICON, thumb_info->pixbuf, -1);
+
+    font_catalog_set_thumbnail(priv->catalog, thumb_info->font_path,
+                               thumb_info->face_index, thumb_info->thumbnail);
+    font_catalog_save_later(priv->catalog);
+  }
 
   thumb_info_data_free(thumb_info);
+}
+
+static gboolean flush_thumbnails(gpointer user_data) {
+  FontViewModel *self = user_data;
+  ThumbInfoData *thumb_info;
+  gint64 deadline = g_get_monotonic_time() + THUMBNAIL_FLUSH_BUDGET;
+
+  while ((thumb_info = g_async_queue_try_pop(
+              self->priv->finished_thumbnails)) != NULL) {
+    apply_thumbnail(thumb_info);
+
+    /* leave the rest of the frame to layout and drawing */
+    if (g_get_monotonic_time() > deadline) return TRUE;
+  }
+
+  g_atomic_int_set(&self->priv->flush_scheduled, 0);
+
+  /* a worker may have finished since the queue was found empty */
+  if (g_async_queue_length(self->priv->finished_thumbnails) > 0 &&
+      g_atomic_int_compare_and_exchange(&self->priv->flush_scheduled, 0, 1))
+    return TRUE;
 
   return FALSE;
 }
 
+/* Called from the workers: thumbnails finished within one frame interval are
+ * applied together, below the priority of layout and redraw. */
+static void thumbnail_finished(ThumbInfoData *thumb_info) {
+  FontViewModel *self = thumb_info->self;
+
+  g_async_queue_push(self->priv->finished_thumbnails, thumb_info);
+
+  if (g_atomic_int_compare_and_exchange(&self->priv->flush_scheduled, 0, 1))
+    g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE, THUMBNAIL_FLUSH_INTERVAL,
+                       flush_thumbnails, g_object_ref(self), g_object_unref);
+}
+
+static MateDesktopThumbnailFactory *get_thumbnail_factory(void) {
+  MateDesktopThumbnailFactory *factory = g_private_get(&thumbnail_factory);
+
+  if (factory == NULL) {
+    factory =
+        mate_desktop_thumbnail_factory_new(MATE_DESKTOP_THUMBNAIL_SIZE_NORMAL);
+    g_private_set(&thumbnail_factory, factory);
+  }
+
+  return factory;
+}
+
 static GdkPixbuf *create_thumbnail(ThumbInfoData *thumb_info) {
   GFile *file = thumb_info->font_file;
   MateDesktopThumbnailFactory *factory;
@@ -166,8 +257,7 @@ static GdkPixbuf *create_thumbnail(ThumbInfoData *thumb_info) {
   mtime =
       g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
 
-  factory =
-      mate_desktop_thumbnail_factory_new(MATE_DESKTOP_THUMBNAIL_SIZE_NORMAL);
+  factory = get_thumbnail_factory();
   pixbuf = mate_desktop_thumbnail_factory_generate_thumbnail(
       factory, thumb_info->uri, g_file_info_get_content_type(info));
 
@@ -178,175 +268,297 @@ static GdkPixbuf *create_thumbnail(ThumbInfoData *thumb_info) {
     mate_desktop_thumbnail_factory_create_failed_thumbnail(
         factory, thumb_info->uri, (time_t)mtime);
 
-  g_object_unref(factory);
-
 out:
   g_clear_object(&info);
 
   return pixbuf;
 }
 
-static void ensure_thumbnails_job(GTask *task, gpointer source_object,
-                                  gpointer user_data,
-                                  GCancellable *cancellable) {
-  GList *thumb_infos = user_data, *l;
-
-  for (l = thumb_infos; l != NULL; l = l->next) {
-    gboolean thumb_failed;
-    gchar *thumb_path = NULL;
-    ThumbInfoData *thumb_info = l->data;
+static void ensure_thumbnail(ThumbInfoData *thumb_info) {
+  gboolean thumb_failed;
+  gchar *thumb_path = NULL;
 
-    GError *error = NULL;
-    GFile *thumb_file = NULL;
-    GFileInputStream *is = NULL;
-    GFileInfo *info = NULL;
+  GError *error = NULL;
+  GFile *thumb_file = NULL;
+  GFileInputStream *is = NULL;
+  GFileInfo *info = NULL;
 
-    if (thumb_info->face_index == 0) {
-      thumb_info->uri = g_file_get_uri(thumb_info->font_file);
-      info = g_file_query_info(thumb_info->font_file,
-                               ATTRIBUTES_FOR_EXISTING_THUMBNAIL,
-                               G_FILE_QUERY_INFO_NONE, NULL, &error);
+  if (thumb_info->face_index == 0) {
+    thumb_info->uri = g_file_get_uri(thumb_info->font_file);
+    info = g_file_query_info(thumb_info->font_file,
+                             ATTRIBUTES_FOR_EXISTING_THUMBNAIL,
+                             G_FILE_QUERY_INFO_NONE, NULL, &error);
 
-      if (error != NULL) {
-        gchar *font_path;
+    if (error != NULL) {
+      gchar *font_path;
 
-        font_path = g_file_get_path(thumb_info->font_file);
-        g_debug("Can't query info for file %s: %s\n", font_path,
-                error->message);
-        g_free(font_path);
+      font_path = g_file_get_path(thumb_info->font_file);
+      g_debug("Can't query info for file %s: %s\n", font_path,
+              error->message);
+      g_free(font_path);
 
-        goto next;
-      }
+      goto out;
+    }
 
-      thumb_failed = g_file_info_get_attribute_boolean(
-          info, G_FILE_ATTRIBUTE_THUMBNAILING_FAILED);
-      if (thumb_failed) goto next;
+    thumb_failed = g_file_info_get_attribute_boolean(
+        info, G_FILE_ATTRIBUTE_THUMBNAILING_FAILED);
+    if (thumb_failed) {
+      thumb_info->thumbnail = FONT_CATALOG_THUMBNAIL_FAILED;
+      goto out;
+    }
 
-      thumb_path = g_strdup(g_file_info_get_attribute_byte_string(
-          info, G_FILE_ATTRIBUTE_THUMBNAIL_PATH));
-    } else {
-      gchar *file_uri;
-      gchar *checksum;
-      gchar *filename;
-
-      file_uri = g_file_get_uri(thumb_info->font_file);
-      thumb_info->uri =
-          g_strdup_printf("%s#0x%08X", file_uri, thumb_info->face_index);
-      g_free(file_uri);
-
-      checksum = g_compute_checksum_for_data(G_CHECKSUM_MD5,
-                                             (const guchar *)thumb_info->uri,
-                                             strlen(thumb_info->uri));
-      filename = g_strdup_printf("%s.png", checksum);
-      g_free(checksum);
-
-      thumb_path = g_build_filename(g_get_user_cache_dir(), "thumbnails",
-                                    "large", filename, NULL);
-      g_free(filename);
-
-      if (!g_file_test(thumb_path, G_FILE_TEST_IS_REGULAR)) {
-        g_clear_pointer(&thumb_path, g_free);
-      }
+    thumb_path = g_strdup(g_file_info_get_attribute_byte_string(
+        info, G_FILE_ATTRIBUTE_THUMBNAIL_PATH));
+  } else {
+    gchar *file_uri;
+    gchar *checksum;
+    gchar *filename;
+
+    file_uri = g_file_get_uri(thumb_info->font_file);
+    thumb_info->uri =
+        g_strdup_printf("%s#0x%08X", file_uri, thumb_info->face_index);
+    g_free(file_uri);
+
+    checksum = g_compute_checksum_for_data(G_CHECKSUM_MD5,
+                                           (const guchar *)thumb_info->uri,
+                                           strlen(thumb_info->uri));
+    filename = g_strdup_printf("%s.png", checksum);
+    g_free(checksum);
+
+    thumb_path = g_build_filename(g_get_user_cache_dir(), "thumbnails",
+                                  "large", filename, NULL);
+    g_free(filename);
+
+    if (!g_file_test(thumb_path, G_FILE_TEST_IS_REGULAR)) {
+      g_clear_pointer(&thumb_path, g_free);
     }
+  }
 
-    if (thumb_path != NULL) {
-      thumb_file = g_file_new_for_path(thumb_path);
-      is = g_file_read(thumb_file, NULL, &error);
+  if (thumb_path != NULL) {
+    thumb_file = g_file_new_for_path(thumb_path);
+    is = g_file_read(thumb_file, NULL, &error);
 
-      if (error != NULL) {
-        g_debug("Can't read file %s: %s\n", thumb_path, error->message);
-        goto next;
-      }
+    if (error != NULL) {
+      g_debug("Can't read file %s: %s\n", thumb_path, error->message);
+      goto out;
+    }
 
-      thumb_info->pixbuf = gdk_pixbuf_new_from_stream_at_scale(
-          G_INPUT_STREAM(is), 128, 128, TRUE, NULL, &error);
+    thumb_info->pixbuf = gdk_pixbuf_new_from_stream_at_scale(
+        G_INPUT_STREAM(is), 128, 128, TRUE, NULL, &error);
 
-      if (error != NULL) {
-        g_debug("Can't read thumbnail pixbuf %s: %s\n", thumb_path,
-                error->message);
-        goto next;
-      }
-    } else {
-      thumb_info->pixbuf = create_thumbnail(thumb_info);
+    if (error != NULL) {
+      g_debug("Can't read thumbnail pixbuf %s: %s\n", thumb_path,
+              error->message);
+      goto out;
     }
+    thumb_info->thumbnail = FONT_CATALOG_THUMBNAIL_CACHED;
+  } else {
+    thumb_info->pixbuf = create_thumbnail(thumb_info);
+    thumb_info->thumbnail = thumb_info->pixbuf != NULL
+                                ? FONT_CATALOG_THUMBNAIL_CACHED
+                                : FONT_CATALOG_THUMBNAIL_FAILED;
+  }
 
-  next:
-    g_clear_error(&error);
-    g_clear_object(&is);
-    g_clear_object(&thumb_file);
-    g_clear_object(&info);
-    g_clear_pointer(&thumb_path, g_free);
+out:
+  g_clear_error(&error);
+  g_clear_object(&is);
+  g_clear_object(&thumb_file);
+  g_clear_object(&info);
+  g_clear_pointer(&thumb_path, g_free);
+}
+
+static void ensure_thumbnail_worker(gpointer data, gpointer user_data) {
+  ThumbInfoData *thumb_info = data;
+
+  /* don't retry faces that failed before, unless their file changed */
+  if (!g_atomic_int_get(&thumb_info->dropped) &&
+      thumb_info->thumbnail != FONT_CATALOG_THUMBNAIL_FAILED)
+    ensure_thumbnail(thumb_info);
+
+  thumbnail_finished(thumb_info);
+}
+
+/* Dropped jobs go first since they are skipped anyway, then the rows last
+ * marked visible, in the order given, then everything else in the order it
+ * was queued. */
+static gint thumb_info_compare(gconstpointer a, gconstpointer b,
+                               gpointer user_data) {
+  const ThumbInfoData *info_a = a, *info_b = b;
+  FontViewModel *self = user_data;
+  gboolean dropped_a, dropped_b, visible_a, visible_b;
 
-    g_main_context_invoke(NULL, one_thumbnail_done, thumb_info);
+  dropped_a = g_atomic_int_get(&info_a->dropped);
+  dropped_b = g_atomic_int_get(&info_b->dropped);
+  if (dropped_a != dropped_b) return dropped_a ? -1 : 1;
+
+  visible_a = info_a->visible_serial == self->priv->visible_serial;
+  visible_b = info_b->visible_serial == self->priv->visible_serial;
+  if (visible_a != visible_b) return visible_a ? -1 : 1;
+
+  if (visible_a && info_a->visible_rank != info_b->visible_rank)
+    return info_a->visible_rank < info_b->visible_rank ? -1 : 1;
+
+  return info_a->sequence < info_b->sequence ? -1 : 1;
+}
+
+static void sort_thumbnail_queue(FontViewModel *self) {
+  /* setting the sort function again sorts what is already queued */
+  g_thread_pool_set_sort_function(self->priv->thumbnail_pool,
+                                  thumb_info_compare, self);
+}
+
+void font_view_model_prioritize_thumbnails(FontViewModel *self,
+                                           const GtkTreeIter *iters,
+                                           guint n_iters) {
+  guint i;
+
+  self->priv->visible_serial++;
+
+  for (i = 0; i < n_iters; i++) {
+    ThumbInfoData *thumb_info = g_hash_table_lookup(
+        self->priv->pending_thumbnails, iters[i].user_data);
+
+    if (thumb_info == NULL) continue;
+
+    thumb_info->visible_serial = self->priv->visible_serial;
+    thumb_info->visible_rank = i;
   }
 
-  g_list_free(thumb_infos);
+  sort_thumbnail_queue(self);
 }
 
 typedef struct {
-  gchar *font_path;
-  gint face_index;
-  gchar *font_name;
-} FontInfoData;
+  GtkTreeIter iter;
+  FontCatalogFace *face;
+  guint serial;
+} FaceRow;
+
+static void face_row_free(FaceRow *row) {
+  font_catalog_face_free(row->face);
+  g_slice_free(FaceRow, row);
+}
+
+static void queue_thumbnail(FontViewModel *self, const FontCatalogFace *face,
+                            GtkTreeIter *iter) {
+  ThumbInfoData *thumb_info = g_slice_new0(ThumbInfoData);
+
+  thumb_info->font_file = g_file_new_for_path(face->path);
+  thumb_info->font_path = g_strdup(face->path);
+  thumb_info->face_index = face->face_index;
+  thumb_info->thumbnail = face->thumbnail;
+  thumb_info->iter = *iter;
+  thumb_info->self = g_object_ref(self);
+  thumb_info->sequence = self->priv->thumbnail_sequence++;
+
+  g_hash_table_insert(self->priv->pending_thumbnails, iter->user_data,
+                      thumb_info);
+  g_thread_pool_push(self->priv->thumbnail_pool, thumb_info, NULL);
+}
+
+static void drop_thumbnail(FontViewModel *self, GtkTreeIter *iter) {
+  ThumbInfoData *thumb_info =
+      g_hash_table_lookup(self->priv->pending_thumbnails, iter->user_data);
+
+  if (thumb_info == NULL) return;
+
+  g_atomic_int_set(&thumb_info->dropped, TRUE);
+  g_hash_table_remove(self->priv->pending_thumbnails, iter->user_data);
+}
+
+/* Brings the store in line with @faces, touching only the rows that were
+ * added, removed or changed, so the view keeps its place and the thumbnails
+ * of the other rows carry on. */
+static void update_faces(FontViewModel *self, GPtrArray *faces) {
+  GHashTableIter hash_iter;
+  FaceRow *row;
+  guint i;
+
+  self->priv->rows_serial++;
+
+  /* queue the new thumbnails unsorted, then sort them once */
+  g_thread_pool_set_sort_function(self->priv->thumbnail_pool, NULL, NULL);
+
+  for (i = 0; i < faces->len; i++) {
+    FontCatalogFace *face = g_ptr_array_index(faces, i);
+    gchar *key = g_strdup_printf("%s:%d", face->path, face->face_index);
+
+    row = g_hash_table_lookup(self->priv->rows, key);
+
+    if (row == NULL) {
+      row = g_slice_new0(FaceRow);
+      row->face = font_catalog_face_copy(face);
+      gtk_list_store_insert_with_values(
+          GTK_LIST_STORE(self), &row->iter, -1, COLUMN_NAME, face->name,
+          COLUMN_PATH, face->path, COLUMN_FACE_INDEX, face->face_index,
+          COLUMN_ICON, self->priv->fallback_icon, COLUMN_COLLATION_KEY,
+          face->collation_key, -1);
+      g_hash_table_insert(self->priv->rows, key, row);
+
+      queue_thumbnail(self, face, &row->iter);
+    } else {
+      /* the file was replaced, name and thumbnail may differ now */
+      if (row->face->mtime != face->mtime || row->face->size != face->size ||
+          g_strcmp0(row->face->name, face->name) != 0) {
+        gtk_list_store_set(GTK_LIST_STORE(self), &row->iter, COLUMN_NAME,
+                           face->name, COLUMN_COLLATION_KEY,
+                           face->collation_key, -1);
+        font_catalog_face_free(row->face);
+        row->face = font_catalog_face_copy(face);
+
+        drop_thumbnail(self, &row->iter);
+        queue_thumbnail(self, face, &row->iter);
+      }
+
+      g_free(key);
+    }
 
-static void font_info_data_free(gpointer user_data) {
-  FontInfoData *font_info = user_data;
+    row->serial = self->priv->rows_serial;
+  }
+
+  g_hash_table_iter_init(&hash_iter, self->priv->rows);
+  while (g_hash_table_iter_next(&hash_iter, NULL, (gpointer *)&row)) {
+    if (row->serial == self->priv->rows_serial) continue;
+
+    drop_thumbnail(self, &row->iter);
+    gtk_list_store_remove(GTK_LIST_STORE(self), &row->iter);
+    g_hash_table_iter_remove(&hash_iter);
+  }
 
-  g_free(font_info->font_path);
-  g_free(font_info->font_name);
-  g_slice_free(FontInfoData, font_info);
+  sort_thumbnail_queue(self);
 }
 
 static void font_infos_loaded(GObject *source_object, GAsyncResult *result,
                               gpointer user_data) {
   FontViewModel *self = FONT_VIEW_MODEL(source_object);
-  GTask *task = NULL;
-  GList *l, *thumb_infos = NULL;
-  GList *font_infos = g_task_propagate_pointer(G_TASK(result), NULL);
-
-  for (l = font_infos; l != NULL; l = l->next) {
-    FontInfoData *font_info = l->data;
-    gchar *collation_key;
-    GtkTreeIter iter;
-    ThumbInfoData *thumb_info;
-
-    collation_key = g_utf8_collate_key(font_info->font_name, -1);
-    gtk_list_store_insert_with_values(
-        GTK_LIST_STORE(self), &iter, -1, COLUMN_NAME, font_info->font_name,
-        COLUMN_PATH, font_info->font_path, COLUMN_FACE_INDEX,
-        font_info->face_index, COLUMN_ICON, self->priv->fallback_icon,
-        COLUMN_COLLATION_KEY, collation_key, -1);
-    g_free(collation_key);
-
-    thumb_info = g_slice_new0(ThumbInfoData);
-    thumb_info->font_file = g_file_new_for_path(font_info->font_path);
-    thumb_info->face_index = font_info->face_index;
-    thumb_info->iter = iter;
-    thumb_info->self = g_object_ref(self);
-
-    font_info_data_free(font_info);
-    thumb_infos = g_list_prepend(thumb_infos, thumb_info);
+  GPtrArray *faces = g_task_propagate_pointer(G_TASK(result), NULL);
+
+  if (faces == NULL) return;
+
+  /* the list shown from the catalog is still right most of the time */
+  if (font_catalog_set_faces(self->priv->catalog, faces)) {
+    update_faces(self, faces);
+    font_catalog_save_later(self->priv->catalog);
   }
 
   g_signal_emit(self, signals[CONFIG_CHANGED], 0);
-  g_list_free(font_infos);
-
-  task = g_task_new(NULL, NULL, NULL, NULL);
-  g_task_set_task_data(task, thumb_infos, NULL);
-  g_task_run_in_thread(task, ensure_thumbnails_job);
-  g_object_unref(task);
+  g_ptr_array_unref(faces);
 }
 
 static void load_font_infos(GTask *task, gpointer source_object,
                             gpointer user_data, GCancellable *cancellable) {
   FontViewModel *self = FONT_VIEW_MODEL(source_object);
   gint i, n_fonts;
-  GList *font_infos = NULL;
+  GPtrArray *faces;
+  gchar *stat_path = NULL;
+  GStatBuf stat_buf;
+  gboolean stat_ok = FALSE;
+  FT_Face held_face = NULL; /* keeps the contents of stat_path loaded */
 
   n_fonts = self->priv->font_list->nfont;
+  faces = g_ptr_array_new_full(n_fonts, (GDestroyNotify)font_catalog_face_free);
 
   for (i = 0; i < n_fonts; i++) {
-    FontInfoData *font_info;
+    FontCatalogFace *face = NULL;
     FcChar8 *file;
     int index;
     gchar *font_name;
@@ -358,20 +570,46 @@ static void load_font_infos(GTask *task, gpointer source_object,
     FcPatternGetInteger(self->priv->font_list->fonts[i], FC_INDEX, 0, &index);
     g_mutex_unlock(&self->priv->font_list_mutex);
 
-    font_name = font_utils_get_font_name_for_file(self->priv->library,
-                                                  (const gchar *)file, index);
+    /* the faces of a collection usually come one after another */
+    if (g_strcmp0(stat_path, (const gchar *)file) != 0) {
+      g_free(stat_path);
+      stat_path = g_strdup((const gchar *)file);
+      stat_ok = g_stat(stat_path, &stat_buf) == 0;
 
-    if (!font_name) continue;
+      if (held_face != NULL) {
+        FT_Done_Face(held_face);
+        held_face = NULL;
+      }
+    }
 
-    font_info = g_slice_new0(FontInfoData);
-    font_info->font_name = font_name;
-    font_info->font_path = g_strdup((const gchar *)file);
-    font_info->face_index = index;
+    /* only files that changed since the last time are opened */
+    if (stat_ok)
+      face = font_catalog_lookup(self->priv->catalog, (const gchar *)file,
+                                 index, (gint64)stat_buf.st_mtime,
+                                 (gint64)stat_buf.st_size);
+
+    if (face == NULL) {
+      font_name = font_utils_get_font_name_for_file(
+          self->priv->library, (const gchar *)file, index, &held_face);
+
+      if (!font_name) continue;
+
+      face = g_slice_new0(FontCatalogFace);
+      face->path = g_strdup((const gchar *)file);
+      face->face_index = index;
+      face->name = font_name;
+      face->collation_key = g_utf8_collate_key(font_name, -1);
+      face->mtime = stat_ok ? (gint64)stat_buf.st_mtime : -1;
+      face->size = stat_ok ? (gint64)stat_buf.st_size : -1;
+    }
 
-    font_infos = g_list_prepend(font_infos, font_info);
+    g_ptr_array_add(faces, face);
   }
 
-  g_task_return_pointer(task, font_infos, NULL);
+  if (held_face != NULL) FT_Done_Face(held_face);
+  g_free(stat_path);
+
+  g_task_return_pointer(task, faces, (GDestroyNotify)g_ptr_array_unref);
 }
 
 /* make sure the font list is valid */
@@ -388,8 +626,6 @@ static void ensure_font_list(FontViewModel *self) {
     g_clear_object(&self->priv->cancellable);
   }
 
-  gtk_list_store_clear(GTK_LIST_STORE(self));
-
   pat = FcPatternCreate();
   os =
       FcObjectSetBuild(FC_FILE, FC_INDEX, FC_FAMILY, FC_WEIGHT, FC_SLANT, NULL);
@@ -419,6 +655,22 @@ static void ensure_font_list(FontViewModel *self) {
 
 static gboolean ensure_font_list_idle(gpointer user_data) {
   FontViewModel *self = user_data;
+  GPtrArray *faces;
+
+  /* show what was there last time right away, then check it */
+  faces = font_catalog_get_faces(self->priv->catalog);
+  update_faces(self, faces);
+  g_ptr_array_unref(faces);
+
+  ensure_font_list(self);
+
+  return FALSE;
+}
+
+static gboolean reload_timeout(gpointer user_data) {
+  FontViewModel *self = user_data;
+
+  self->priv->reload_id = 0;
   ensure_font_list(self);
 
   return FALSE;
@@ -447,8 +699,11 @@ static void file_monitor_changed_cb(GFileMonitor *monitor, GFile *file,
 
   if (event == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT ||
       event == G_FILE_MONITOR_EVENT_DELETED ||
-      event == G_FILE_MONITOR_EVENT_CREATED)
-    ensure_font_list(self);
+      event == G_FILE_MONITOR_EVENT_CREATED) {
+    /* installing a font sends a burst of these, only reload once */
+    if (self->priv->reload_id != 0) g_source_remove(self->priv->reload_id);
+    self->priv->reload_id = g_timeout_add(RELOAD_DELAY, reload_timeout, self);
+  }
 }
 
 static void create_file_monitors(FontViewModel *self) {
@@ -516,6 +771,17 @@ static void font_view_model_init(FontViewModel *self) {
 
   self->priv->fallback_icon = get_fallback_icon();
 
+  self->priv->catalog = font_catalog_new();
+
+  self->priv->rows = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                           (GDestroyNotify)face_row_free);
+  self->priv->pending_thumbnails = g_hash_table_new(NULL, NULL);
+  self->priv->finished_thumbnails = g_async_queue_new();
+  self->priv->thumbnail_pool = g_thread_pool_new(
+      ensure_thumbnail_worker, NULL,
+      CLAMP(g_get_num_processors(), 1, MAX_THUMBNAIL_WORKERS), FALSE, NULL);
+  sort_thumbnail_queue(self);
+
   g_idle_add(ensure_font_list_idle, self);
   create_file_monitors(self);
 }
@@ -528,6 +794,18 @@ static void font_view_model_finalize(GObject *obj) {
     g_clear_object(&self->priv->cancellable);
   }
 
+  if (self->priv->reload_id != 0) {
+    g_source_remove(self->priv->reload_id);
+    self->priv->reload_id = 0;
+  }
+
+  /* every queued thumbnail holds a reference, so the pool is idle by now */
+  g_thread_pool_free(self->priv->thumbnail_pool, FALSE, TRUE);
+  g_hash_table_destroy(self->priv->rows);
+  font_catalog_free(self->priv->catalog);
+  g_hash_table_destroy(self->priv->pending_thumbnails);
+  g_async_queue_unref(self->priv->finished_thumbnails);
+
   if (self->priv->font_list) {
     FcFontSetDestroy(self->priv->font_list);
     self->priv->font_list = NULL;
@@ -61,6 +61,9 @@ GtkTreeModel *font_view_model_new(void);
 
 gboolean font_view_model_get_iter_for_face(FontViewModel *self, FT_Face face,
                                            GtkTreeIter *iter);
+void font_view_model_prioritize_thumbnails(FontViewModel *self,
+                                           const GtkTreeIter *iters,
+                                           guint n_iters);
 
 G_END_DECLS
 
@@ -25,7 +25,10 @@
 #include <config.h>
 #endif
 
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #ifdef ENABLE_NLS
 #include <locale.h>
 #endif /* ENABLE_NLS */
@@ -38,6 +41,7 @@
 #include <gdk/gdk.h>
 #include <gio/gio.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 
 #include "sushi-font-loader.h"
 #include "totem-resources.h"
@@ -60,37 +64,6 @@ static const gchar *get_ft_error(FT_Error error) {
 #define PADDING_VERTICAL 2
 #define PADDING_HORIZONTAL 4
 
-static gboolean check_font_contain_text(FT_Face face, const gchar *text) {
-  gunichar *string;
-  glong len, idx, map;
-  FT_CharMap charmap;
-  gboolean retval;
-
-  string = g_utf8_to_ucs4_fast(text, -1, &len);
-
-  for (map = 0; map < face->num_charmaps; map++) {
-    charmap = face->charmaps[map];
-    FT_Set_Charmap(face, charmap);
-
-    retval = TRUE;
-
-    for (idx = 0; idx < len; idx++) {
-      gunichar c = string[idx];
-
-      if (!FT_Get_Char_Index(face, c)) {
-        retval = FALSE;
-        break;
-      }
-    }
-
-    if (retval) break;
-  }
-
-  g_free(string);
-
-  return retval;
-}
-
 static gchar *check_for_ascii_glyph_numbers(FT_Face face,
                                             gboolean *found_ascii) {
   GString *ascii_string, *string;
@@ -152,109 +125,99 @@ static gchar *build_fallback_thumbstr(FT_Face face) {
   return g_string_free(retval, FALSE);
 }
 
-int main(int argc, char **argv) {
-  FT_Error error;
-  FT_Library library;
+/* Faces of one library can be used from several threads, as long as
+ * creating and destroying them is serialized. */
+static GMutex face_lock;
+static const cairo_user_data_key_t face_key;
+
+static void done_face(void *data) {
+  g_mutex_lock(&face_lock);
+  FT_Done_Face(data);
+  g_mutex_unlock(&face_lock);
+}
+
+/* Returns the cached surface, cleared, if it has the right size */
+static cairo_surface_t *get_surface(cairo_surface_t **cached, gint size) {
+  cairo_t *cr;
+
+  if (*cached != NULL && cairo_image_surface_get_width(*cached) == size) {
+    cr = cairo_create(*cached);
+    cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+
+    return *cached;
+  }
+
+  if (*cached != NULL) cairo_surface_destroy(*cached);
+  *cached = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+
+  return *cached;
+}
+
+static gboolean render_thumbnail(FT_Library library, const gchar *input,
+                                 const gchar *output, gint thumb_size,
+                                 const gchar *text, cairo_surface_t **cached,
+                                 GError **error) {
   FT_Face face;
   GFile *file;
-  gint font_size, thumb_size = THUMB_SIZE;
-  gchar *thumbstr_utf8 = NULL, *help, *uri;
-  gchar **arguments = NULL;
-  GOptionContext *context;
-  GError *gerror = NULL;
-  gchar *contents = NULL;
-  gboolean retval, default_thumbstr = TRUE;
-  gint rv = 1;
+  gint font_size;
+  gchar *uri, *fragment, *str;
   GdkRGBA black = {0.0, 0.0, 0.0, 1.0};
   cairo_surface_t *surface;
+  cairo_status_t status;
   cairo_t *cr;
   cairo_text_extents_t text_extents;
   cairo_font_face_t *font;
-  gchar *str = NULL;
   gdouble scale, scale_x, scale_y;
   gint face_index = 0;
-  gchar *fragment;
+  GError *load_error = NULL;
 
-  const GOptionEntry options[] = {
-      {"text", 't', 0, G_OPTION_ARG_STRING, &thumbstr_utf8,
-       N_("Text to thumbnail (default: Aa)"), N_("TEXT")},
-      {"size", 's', 0, G_OPTION_ARG_INT, &thumb_size,
-       N_("Thumbnail size (default: 128)"), N_("SIZE")},
-      {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &arguments, NULL,
-       N_("FONT-FILE OUTPUT-FILE")},
-      {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
-
-#ifdef ENABLE_NLS
-  setlocale(LC_ALL, "");
-  bindtextdomain(GETTEXT_PACKAGE, MATELOCALEDIR);
-  bind_textdomain_codeset(GETTEXT_PACKAGE, "UTF-8");
-  textdomain(GETTEXT_PACKAGE);
-#endif /* ENABLE_NLS */
-
-  context = g_option_context_new(NULL);
-  g_option_context_add_main_entries(context, options, GETTEXT_PACKAGE);
-
-  retval = g_option_context_parse(context, &argc, &argv, &gerror);
-  if (!retval) {
-    g_printerr("Error parsing arguments: %s\n", gerror->message);
-
-    g_option_context_free(context);
-    g_error_free(gerror);
-    return 1;
-  }
-
-  if (!arguments || g_strv_length(arguments) != 2) {
-    help = g_option_context_get_help(context, TRUE, NULL);
-    g_printerr("%s", help);
-
-    g_option_context_free(context);
-    goto out;
-  }
-
-  g_option_context_free(context);
-
-  if (thumbstr_utf8 != NULL) default_thumbstr = FALSE;
-
-  error = FT_Init_FreeType(&library);
-  if (error) {
-    g_printerr("Could not initialise freetype: %s\n", get_ft_error(error));
-    goto out;
-  }
-
-  totem_resources_monitor_start(arguments[0], 30 * G_USEC_PER_SEC);
-
-  fragment = strrchr(arguments[0], '#');
+  fragment = strrchr(input, '#');
   if (fragment) face_index = strtol(fragment + 1, NULL, 0);
 
-  file = g_file_new_for_commandline_arg(arguments[0]);
+  file = g_file_new_for_commandline_arg(input);
   uri = g_file_get_uri(file);
   g_object_unref(file);
 
-  face =
-      sushi_new_ft_face_from_uri(library, uri, face_index, &contents, &gerror);
-  if (gerror) {
-    g_printerr("Could not load face '%s': %s\n", uri, gerror->message);
+  g_mutex_lock(&face_lock);
+  face = sushi_new_ft_face_from_uri(library, uri, face_index, &load_error);
+  g_mutex_unlock(&face_lock);
+
+  if (load_error) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "Could not load face '%s': %s", uri, load_error->message);
     g_free(uri);
-    g_error_free(gerror);
-    goto out;
+    g_error_free(load_error);
+    return FALSE;
   }
 
   g_free(uri);
 
-  if (default_thumbstr) {
-    if (check_font_contain_text(face, "Aa"))
+  if (text == NULL) {
+    if (sushi_font_contains_text(face, "Aa"))
       str = g_strdup("Aa");
     else
       str = build_fallback_thumbstr(face);
   } else {
-    str = thumbstr_utf8;
+    str = g_strdup(text);
   }
 
-  surface =
-      cairo_image_surface_create(CAIRO_FORMAT_ARGB32, thumb_size, thumb_size);
+  /* cairo may hold on to the face past this call, it gets rid of it */
+  font = cairo_ft_font_face_create_for_ft_face(face, 0);
+  if (cairo_font_face_set_user_data(font, &face_key, face, done_face) !=
+      CAIRO_STATUS_SUCCESS) {
+    cairo_font_face_destroy(font);
+    done_face(face);
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "Could not create a font face for '%s'", input);
+    g_free(str);
+    return FALSE;
+  }
+
+  surface = get_surface(cached, thumb_size);
   cr = cairo_create(surface);
 
-  font = cairo_ft_font_face_create_for_ft_face(face, 0);
   cairo_set_font_face(cr, font);
   cairo_font_face_destroy(font);
 
@@ -287,18 +250,208 @@ int main(int argc, char **argv) {
   gdk_cairo_set_source_rgba(cr, &black);
   cairo_show_text(cr, str);
   cairo_destroy(cr);
+  g_free(str);
+
+  status = cairo_surface_write_to_png(surface, output);
+  if (status != CAIRO_STATUS_SUCCESS) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "Could not write '%s': %s", output,
+                cairo_status_to_string(status));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Batch mode: every line of input is a job of FONT-FILE, OUTPUT-FILE and an
+ * optional SIZE, separated by tabs.  Jobs are rendered in parallel, with one
+ * line written per job as it finishes: "ok<TAB>OUTPUT-FILE", or
+ * "failed<TAB>OUTPUT-FILE<TAB>MESSAGE". */
+
+typedef struct {
+  FT_Library library;
+  const gchar *text;
+  GMutex output_lock;
+  gint n_failed;
+} Batch;
+
+typedef struct {
+  gchar *input;
+  gchar *output;
+  gint size;
+} BatchJob;
+
+/* every worker thread renders to a surface of its own */
+static GPrivate batch_surface = G_PRIVATE_INIT(
+    (GDestroyNotify)cairo_surface_destroy);
+
+static void batch_worker(gpointer data, gpointer user_data) {
+  BatchJob *job = data;
+  Batch *batch = user_data;
+  cairo_surface_t *surface = g_private_get(&batch_surface);
+  GError *error = NULL;
+
+  render_thumbnail(batch->library, job->input, job->output, job->size,
+                   batch->text, &surface, &error);
+  g_private_set(&batch_surface, surface);
+
+  g_mutex_lock(&batch->output_lock);
+  if (error != NULL) {
+    g_print("failed\t%s\t%s\n", job->output, error->message);
+    batch->n_failed++;
+    g_error_free(error);
+  } else {
+    g_print("ok\t%s\n", job->output);
+  }
+  fflush(stdout);
+  g_mutex_unlock(&batch->output_lock);
+
+  g_free(job->input);
+  g_free(job->output);
+  g_slice_free(BatchJob, job);
+}
+
+static gboolean run_batch(FT_Library library, const gchar *batch_file,
+                          gint thumb_size, const gchar *text) {
+  Batch batch = {library, text};
+  GThreadPool *pool;
+  FILE *in;
+  gchar *line = NULL;
+  size_t length = 0;
+  guint line_number = 0;
+
+  if (g_strcmp0(batch_file, "-") == 0) {
+    in = stdin;
+  } else {
+    in = g_fopen(batch_file, "r");
+    if (in == NULL) {
+      g_printerr("Could not open '%s': %s\n", batch_file, g_strerror(errno));
+      return FALSE;
+    }
+  }
+
+  g_mutex_init(&batch.output_lock);
+  pool = g_thread_pool_new(batch_worker, &batch, g_get_num_processors(), TRUE,
+                           NULL);
+
+  /* jobs start as soon as their line is read, so this also serves a caller
+   * that keeps the pipe open and feeds more work as it goes */
+  while (getline(&line, &length, in) != -1) {
+    gchar **fields;
+    BatchJob *job;
+
+    line_number++;
+    g_strchomp(line);
+    if (line[0] == '\0') continue;
+
+    fields = g_strsplit(line, "\t", 3);
+    if (g_strv_length(fields) < 2) {
+      g_printerr("Ignoring line %u: expected FONT-FILE and OUTPUT-FILE\n",
+                 line_number);
+      g_strfreev(fields);
+      continue;
+    }
+
+    job = g_slice_new0(BatchJob);
+    job->input = g_strdup(fields[0]);
+    job->output = g_strdup(fields[1]);
+    job->size = fields[2] != NULL ? atoi(fields[2]) : thumb_size;
+    if (job->size <= 0) job->size = thumb_size;
+
+    g_thread_pool_push(pool, job, NULL);
+    g_strfreev(fields);
+  }
+
+  g_thread_pool_free(pool, FALSE, TRUE);
+  g_mutex_clear(&batch.output_lock);
+
+  free(line);
+  if (in != stdin) fclose(in);
+
+  return batch.n_failed == 0;
+}
+
+int main(int argc, char **argv) {
+  FT_Error error;
+  FT_Library library;
+  gint thumb_size = THUMB_SIZE;
+  gchar *thumbstr_utf8 = NULL, *help, *batch_file = NULL;
+  gchar **arguments = NULL;
+  GOptionContext *context;
+  GError *gerror = NULL;
+  gboolean retval;
+  gint rv = 1;
+  cairo_surface_t *surface = NULL;
+
+  const GOptionEntry options[] = {
+      {"text", 't', 0, G_OPTION_ARG_STRING, &thumbstr_utf8,
+       N_("Text to thumbnail (default: Aa)"), N_("TEXT")},
+      {"size", 's', 0, G_OPTION_ARG_INT, &thumb_size,
+       N_("Thumbnail size (default: 128)"), N_("SIZE")},
+      {"batch", 'b', 0, G_OPTION_ARG_FILENAME, &batch_file,
+       N_("Read tab-separated FONT-FILE, OUTPUT-FILE and SIZE lines from "
+          "FILE, or - for the standard input"),
+       N_("FILE")},
+      {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &arguments, NULL,
+       N_("FONT-FILE OUTPUT-FILE")},
+      {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
+
+#ifdef ENABLE_NLS
+  setlocale(LC_ALL, "");
+  bindtextdomain(GETTEXT_PACKAGE, MATELOCALEDIR);
+  bind_textdomain_codeset(GETTEXT_PACKAGE, "UTF-8");
+  textdomain(GETTEXT_PACKAGE);
+#endif /* ENABLE_NLS */
+
+  context = g_option_context_new(NULL);
+  g_option_context_add_main_entries(context, options, GETTEXT_PACKAGE);
+
+  retval = g_option_context_parse(context, &argc, &argv, &gerror);
+  if (!retval) {
+    g_printerr("Error parsing arguments: %s\n", gerror->message);
+
+    g_option_context_free(context);
+    g_error_free(gerror);
+    return 1;
+  }
+
+  if (batch_file != NULL ? arguments != NULL
+                         : !arguments || g_strv_length(arguments) != 2) {
+    help = g_option_context_get_help(context, TRUE, NULL);
+    g_printerr("%s", help);
 
-  cairo_surface_write_to_png(surface, arguments[1]);
-  cairo_surface_destroy(surface);
+    g_option_context_free(context);
+    goto out;
+  }
 
-  totem_resources_monitor_stop();
+  g_option_context_free(context);
 
-  error = FT_Done_Face(face);
+  error = FT_Init_FreeType(&library);
   if (error) {
-    g_printerr("Could not unload face: %s\n", get_ft_error(error));
+    g_printerr("Could not initialise freetype: %s\n", get_ft_error(error));
     goto out;
   }
 
+  if (batch_file != NULL) {
+    /* the time and CPU limits are meant for a single font */
+    retval = run_batch(library, batch_file, thumb_size, thumbstr_utf8);
+  } else {
+    totem_resources_monitor_start(arguments[0], 30 * G_USEC_PER_SEC);
+    retval = render_thumbnail(library, arguments[0], arguments[1], thumb_size,
+                              thumbstr_utf8, &surface, &gerror);
+    totem_resources_monitor_stop();
+
+    if (!retval) {
+      g_printerr("%s\n", gerror->message);
+      g_error_free(gerror);
+    }
+
+    if (surface != NULL) cairo_surface_destroy(surface);
+  }
+
+  /* let cairo drop the faces it still holds before the library goes */
+  cairo_debug_reset_static_data();
+
   error = FT_Done_FreeType(library);
   if (error) {
     g_printerr("Could not finalize freetype library: %s\n",
@@ -306,13 +459,13 @@ int main(int argc, char **argv) {
     goto out;
   }
 
-  rv = 0; /* success */
+  if (retval) rv = 0; /* success */
 
 out:
 
   g_strfreev(arguments);
-  g_free(str);
-  g_free(contents);
+  g_free(thumbstr_utf8);
+  g_free(batch_file);
 
   return rv;
 }
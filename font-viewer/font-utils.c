@@ -35,20 +35,25 @@ gchar *font_utils_get_font_name(FT_Face face) {
 }
 
 gchar *font_utils_get_font_name_for_file(FT_Library library, const gchar *path,
-                                         gint face_index) {
+                                         gint face_index, FT_Face *held_face) {
   GFile *file;
-  gchar *uri, *contents = NULL, *name = NULL;
+  gchar *uri, *name = NULL;
   GError *error = NULL;
   FT_Face face;
 
   file = g_file_new_for_path(path);
   uri = g_file_get_uri(file);
 
-  face =
-      sushi_new_ft_face_from_uri(library, uri, face_index, &contents, &error);
+  face = sushi_new_ft_face_from_uri(library, uri, face_index, &error);
   if (face != NULL) {
     name = font_utils_get_font_name(face);
-    FT_Done_Face(face);
+
+    if (held_face != NULL) {
+      if (*held_face != NULL) FT_Done_Face(*held_face);
+      *held_face = face;
+    } else {
+      FT_Done_Face(face);
+    }
   } else if (error != NULL) {
     g_warning("Can't get font name: %s\n", error->message);
     g_error_free(error);
@@ -56,7 +61,6 @@ gchar *font_utils_get_font_name_for_file(FT_Library library, const gchar *path,
 
   g_free(uri);
   g_object_unref(file);
-  g_free(contents);
 
   return name;
 }
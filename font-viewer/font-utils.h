@@ -27,7 +27,9 @@
 #include <glib.h>
 
 gchar *font_utils_get_font_name(FT_Face face);
+/* If @held_face is given, the face is left open there in place of the one it
+ * held, so that the next face of the same file doesn't load it again. */
 gchar *font_utils_get_font_name_for_file(FT_Library library, const gchar *path,
-                                         gint face_index);
+                                         gint face_index, FT_Face *held_face);
 
 #endif /* __FONT_UTILS_H__ */
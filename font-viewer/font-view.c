@@ -69,6 +69,7 @@ typedef struct {
 
   GtkTreeModel *model;
   GtkTreeModel *filter_model;
+  guint visible_thumbnails_id;
 
   GFile *font_file;
 } FontViewApplication;
@@ -101,6 +102,7 @@ static const gchar *app_menu =
 #define VIEW_ITEM_WRAP_WIDTH 128
 #define VIEW_COLUMN_SPACING 36
 #define VIEW_MARGIN 16
+#define VIEW_THUMBNAIL_PREFETCH 24
 
 #define WHITESPACE_CHARS "\f \t"
 
@@ -299,11 +301,67 @@ static void font_install_finished_cb(GObject *source_object, GAsyncResult *res,
   }
 }
 
+static void append_child_iter(FontViewApplication *self, GArray *iters,
+                              gint row) {
+  GtkTreeIter filter_iter, iter;
+
+  if (!gtk_tree_model_iter_nth_child(self->filter_model, &filter_iter, NULL,
+                                     row))
+    return;
+
+  gtk_tree_model_filter_convert_iter_to_child_iter(
+      GTK_TREE_MODEL_FILTER(self->filter_model), &iter, &filter_iter);
+  g_array_append_val(iters, iter);
+}
+
+static gboolean update_visible_thumbnails_idle(gpointer user_data) {
+  FontViewApplication *self = user_data;
+  GtkTreePath *start, *end;
+  GArray *iters;
+  gint first, last, n_rows, row;
+
+  self->visible_thumbnails_id = 0;
+
+  if (self->icon_view == NULL ||
+      !gtk_icon_view_get_visible_range(GTK_ICON_VIEW(self->icon_view), &start,
+                                       &end))
+    return FALSE;
+
+  first = gtk_tree_path_get_indices(start)[0];
+  last = gtk_tree_path_get_indices(end)[0];
+  n_rows = gtk_tree_model_iter_n_children(self->filter_model, NULL);
+  gtk_tree_path_free(start);
+  gtk_tree_path_free(end);
+
+  /* what is on screen, then what comes next when scrolling down, then up */
+  iters = g_array_new(FALSE, FALSE, sizeof(GtkTreeIter));
+  for (row = first; row <= last; row++) append_child_iter(self, iters, row);
+  for (row = last + 1; row < MIN(n_rows, last + 1 + VIEW_THUMBNAIL_PREFETCH);
+       row++)
+    append_child_iter(self, iters, row);
+  for (row = first - 1; row >= MAX(0, first - VIEW_THUMBNAIL_PREFETCH); row--)
+    append_child_iter(self, iters, row);
+
+  font_view_model_prioritize_thumbnails(FONT_VIEW_MODEL(self->model),
+                                        (GtkTreeIter *)iters->data, iters->len);
+  g_array_unref(iters);
+
+  return FALSE;
+}
+
+static void queue_visible_thumbnails_update(FontViewApplication *self) {
+  if (self->visible_thumbnails_id == 0)
+    self->visible_thumbnails_id = g_idle_add_full(
+        G_PRIORITY_LOW, update_visible_thumbnails_idle, self, NULL);
+}
+
 static void font_model_config_changed_cb(FontViewModel *model,
                                          gpointer user_data) {
   FontViewApplication *self = user_data;
 
   if (self->font_file != NULL) install_button_refresh_appearance(self, NULL);
+
+  queue_visible_thumbnails_update(self);
 }
 
 static void install_button_clicked_cb(GtkButton *button, gpointer user_data) {
@@ -612,6 +670,7 @@ static void font_view_application_do_overview(FontViewApplication *self) {
   if (self->icon_view == NULL) {
     GtkWidget *icon_view;
     GtkCellRenderer *cell;
+    GtkAdjustment *adjustment;
 
     self->icon_view = icon_view =
         gtk_icon_view_new_with_model(self->filter_model);
@@ -640,6 +699,14 @@ static void font_view_application_do_overview(FontViewApplication *self) {
 
     g_signal_connect(icon_view, "button-release-event",
                      G_CALLBACK(icon_view_release_cb), self);
+
+    /* thumbnail whatever scrolls into view first */
+    adjustment = gtk_scrolled_window_get_vadjustment(
+        GTK_SCROLLED_WINDOW(self->swin_view));
+    g_signal_connect_swapped(adjustment, "value-changed",
+                             G_CALLBACK(queue_visible_thumbnails_update), self);
+    g_signal_connect_swapped(adjustment, "changed",
+                             G_CALLBACK(queue_visible_thumbnails_update), self);
   }
 
   gtk_notebook_set_current_page(GTK_NOTEBOOK(self->notebook), 0);
@@ -698,6 +765,7 @@ static GActionEntry action_entries[] = {
 
 static void search_text_changed(GtkEntry *entry, FontViewApplication *self) {
   gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER(self->filter_model));
+  queue_visible_thumbnails_update(self);
 }
 
 static void font_view_application_startup(GApplication *application) {
@@ -794,6 +862,11 @@ static void font_view_application_quit_mainloop(GApplication *application) {
 static void font_view_application_dispose(GObject *obj) {
   FontViewApplication *self = FONT_VIEW_APPLICATION(obj);
 
+  if (self->visible_thumbnails_id != 0) {
+    g_source_remove(self->visible_thumbnails_id);
+    self->visible_thumbnails_id = 0;
+  }
+
   g_clear_object(&self->model);
   g_clear_object(&self->filter_model);
 
@@ -33,13 +33,295 @@
 
 #include <gio/gio.h>
 
+/* The contents of a font file, shared by every face opened from it in any
+ * thread.  Local files are mapped rather than read, so only the pages
+ * FreeType actually looks at are ever loaded. */
+typedef struct {
+  gint ref_count;
+  gchar *uri;
+  GMappedFile *mapped_file;
+  gchar *contents;
+  gsize length;
+
+  /* face index -> FontCoverage, built on first use */
+  GHashTable *coverages;
+} FontBlob;
+
+#define COVERAGE_N_PAGES ((0x10FFFF >> 8) + 1)
+#define COVERAGE_PAGE_WORDS (256 / 32)
+
+/* The characters a face has glyphs for: a bitmap split in pages of 256
+ * characters, only allocated for pages that have any, plus the list of them
+ * to pick from. */
+typedef struct {
+  /* index of each page in bits plus one, 0 for an empty page */
+  guint16 pages[COVERAGE_N_PAGES];
+  guint32 *bits;
+  gunichar *chars;
+  guint n_chars;
+} FontCoverage;
+
+static void font_coverage_free(FontCoverage *coverage) {
+  g_free(coverage->bits);
+  g_free(coverage->chars);
+  g_free(coverage);
+}
+
+static GMutex blobs_lock;
+static GHashTable *blobs = NULL;
+
+static void font_blob_free(FontBlob *blob) {
+  if (blob->coverages != NULL) g_hash_table_destroy(blob->coverages);
+
+  if (blob->mapped_file != NULL)
+    g_mapped_file_unref(blob->mapped_file);
+  else
+    g_free(blob->contents);
+
+  g_free(blob->uri);
+  g_slice_free(FontBlob, blob);
+}
+
+static FontBlob *font_blob_load(GFile *file, GError **error) {
+  FontBlob *blob = g_slice_new0(FontBlob);
+  gchar *path = g_file_get_path(file);
+  gboolean loaded;
+
+  blob->ref_count = 1;
+  blob->uri = g_file_get_uri(file);
+
+  if (path != NULL) {
+    blob->mapped_file = g_mapped_file_new(path, FALSE, error);
+    loaded = blob->mapped_file != NULL;
+    if (loaded) {
+      blob->contents = g_mapped_file_get_contents(blob->mapped_file);
+      blob->length = g_mapped_file_get_length(blob->mapped_file);
+    }
+  } else {
+    loaded = g_file_load_contents(file, NULL, &blob->contents, &blob->length,
+                                  NULL, error);
+  }
+
+  g_free(path);
+
+  if (!loaded) {
+    font_blob_free(blob);
+    return NULL;
+  }
+
+  return blob;
+}
+
+static FontBlob *font_blob_get(GFile *file, GError **error) {
+  FontBlob *blob, *loaded;
+  gchar *uri = g_file_get_uri(file);
+
+  g_mutex_lock(&blobs_lock);
+  if (blobs == NULL) blobs = g_hash_table_new(g_str_hash, g_str_equal);
+  blob = g_hash_table_lookup(blobs, uri);
+  if (blob != NULL) blob->ref_count++;
+  g_mutex_unlock(&blobs_lock);
+
+  g_free(uri);
+
+  if (blob != NULL) return blob;
+
+  /* load without holding the lock, other files can be opened meanwhile */
+  loaded = font_blob_load(file, error);
+  if (loaded == NULL) return NULL;
+
+  g_mutex_lock(&blobs_lock);
+  blob = g_hash_table_lookup(blobs, loaded->uri);
+  if (blob != NULL)
+    blob->ref_count++;
+  else
+    g_hash_table_insert(blobs, loaded->uri, loaded);
+  g_mutex_unlock(&blobs_lock);
+
+  /* another thread got there first */
+  if (blob != NULL) {
+    font_blob_free(loaded);
+    return blob;
+  }
+
+  return loaded;
+}
+
+static FontBlob *font_blob_ref(FontBlob *blob) {
+  g_mutex_lock(&blobs_lock);
+  blob->ref_count++;
+  g_mutex_unlock(&blobs_lock);
+
+  return blob;
+}
+
+static void font_blob_unref(FontBlob *blob) {
+  gboolean last;
+
+  g_mutex_lock(&blobs_lock);
+  last = --blob->ref_count == 0;
+  if (last) g_hash_table_remove(blobs, blob->uri);
+  g_mutex_unlock(&blobs_lock);
+
+  if (last) font_blob_free(blob);
+}
+
+/* FreeType calls this with the face being destroyed */
+static void font_blob_face_finalizer(void *object) {
+  FT_Face face = object;
+
+  font_blob_unref(face->generic.data);
+}
+
+static FontCoverage *font_coverage_new(FT_Face face) {
+  FontCoverage *coverage = g_new0(FontCoverage, 1);
+  FT_CharMap charmap = face->charmap;
+  GArray *bits = g_array_new(FALSE, TRUE, sizeof(guint32));
+  GArray *chars = g_array_new(FALSE, FALSE, sizeof(gunichar));
+  gulong c;
+  guint glyph;
+
+  /* prefer the Unicode map, the text asked about is Unicode */
+  FT_Select_Charmap(face, FT_ENCODING_UNICODE);
+
+  for (c = FT_Get_First_Char(face, &glyph); glyph != 0;
+       c = FT_Get_Next_Char(face, c, &glyph)) {
+    gunichar ch = (gunichar)c;
+    guint page;
+
+    if (c > 0x10FFFF) break;
+
+    page = ch >> 8;
+    if (coverage->pages[page] == 0) {
+      g_array_set_size(bits, bits->len + COVERAGE_PAGE_WORDS);
+      coverage->pages[page] = bits->len / COVERAGE_PAGE_WORDS;
+    }
+
+    g_array_index(bits, guint32,
+                  (coverage->pages[page] - 1) * COVERAGE_PAGE_WORDS +
+                      ((ch & 0xff) >> 5)) |= 1u << (ch & 31);
+    g_array_append_val(chars, ch);
+  }
+
+  if (charmap != NULL) FT_Set_Charmap(face, charmap);
+
+  coverage->n_chars = chars->len;
+  coverage->chars = (gunichar *)g_array_free(chars, FALSE);
+  coverage->bits = (guint32 *)g_array_free(bits, FALSE);
+
+  return coverage;
+}
+
+static gboolean font_coverage_contains(const FontCoverage *coverage,
+                                       gunichar c) {
+  guint16 page;
+
+  if (c > 0x10FFFF) return FALSE;
+
+  page = coverage->pages[c >> 8];
+  if (page == 0) return FALSE;
+
+  return (coverage->bits[(page - 1) * COVERAGE_PAGE_WORDS + ((c & 0xff) >> 5)] &
+          (1u << (c & 31))) != 0;
+}
+
+/* Looks the coverage of @face up with the contents it was loaded from, or
+ * builds it.  *owned is set if the caller has to free it. */
+static FontCoverage *get_face_coverage(FT_Face face, gboolean *owned) {
+  FontBlob *blob;
+  FontCoverage *coverage, *built;
+  gpointer key = GINT_TO_POINTER(face->face_index);
+
+  *owned = FALSE;
+
+  if (face->generic.finalizer != font_blob_face_finalizer) {
+    *owned = TRUE;
+    return font_coverage_new(face);
+  }
+
+  blob = face->generic.data;
+
+  g_mutex_lock(&blobs_lock);
+  coverage = blob->coverages ? g_hash_table_lookup(blob->coverages, key) : NULL;
+  g_mutex_unlock(&blobs_lock);
+
+  if (coverage != NULL) return coverage;
+
+  built = font_coverage_new(face);
+
+  g_mutex_lock(&blobs_lock);
+  if (blob->coverages == NULL)
+    blob->coverages = g_hash_table_new_full(
+        NULL, NULL, NULL, (GDestroyNotify)font_coverage_free);
+  coverage = g_hash_table_lookup(blob->coverages, key);
+  if (coverage == NULL) {
+    g_hash_table_insert(blob->coverages, key, built);
+    coverage = built;
+    built = NULL;
+  }
+  g_mutex_unlock(&blobs_lock);
+
+  /* another thread got there first */
+  if (built != NULL) font_coverage_free(built);
+
+  return coverage;
+}
+
+/**
+ * sushi_font_contains_text: (skip)
+ *
+ */
+gboolean sushi_font_contains_text(FT_Face face, const gchar *text) {
+  FontCoverage *coverage;
+  gboolean owned, retval = TRUE;
+  const gchar *p;
+
+  coverage = get_face_coverage(face, &owned);
+
+  for (p = text; *p != '\0'; p = g_utf8_next_char(p)) {
+    if (!font_coverage_contains(coverage, g_utf8_get_char(p))) {
+      retval = FALSE;
+      break;
+    }
+  }
+
+  if (owned) font_coverage_free(coverage);
+
+  return retval;
+}
+
+/**
+ * sushi_font_get_random_string: (skip)
+ *
+ */
+gchar *sushi_font_get_random_string(FT_Face face, gint n_chars) {
+  FontCoverage *coverage;
+  GString *retval = NULL;
+  gboolean owned;
+  gint idx;
+
+  coverage = get_face_coverage(face, &owned);
+
+  if (coverage->n_chars > 0) {
+    retval = g_string_new(NULL);
+
+    for (idx = 0; idx < n_chars; idx++)
+      g_string_append_unichar(
+          retval,
+          coverage->chars[g_random_int_range(0, (gint)coverage->n_chars)]);
+  }
+
+  if (owned) font_coverage_free(coverage);
+
+  return retval ? g_string_free(retval, FALSE) : NULL;
+}
+
 typedef struct {
   FT_Library library;
   FT_Long face_index;
   GFile *file;
 
-  gchar *face_contents;
-  gsize face_length;
+  FontBlob *blob;
 } FontLoadJob;
 
 static FontLoadJob *font_load_job_new(FT_Library library, const gchar *uri,
@@ -57,18 +339,18 @@ static FontLoadJob *font_load_job_new(FT_Library library, const gchar *uri,
 
 static void font_load_job_free(FontLoadJob *job) {
   g_clear_object(&job->file);
+  g_clear_pointer(&job->blob, font_blob_unref);
 
   g_slice_free(FontLoadJob, job);
 }
 
-static FT_Face create_face_from_contents(FontLoadJob *job, gchar **contents,
-                                         GError **error) {
+static FT_Face create_face_from_contents(FontLoadJob *job, GError **error) {
   FT_Error ft_error;
   FT_Face retval;
 
-  ft_error =
-      FT_New_Memory_Face(job->library, (const FT_Byte *)job->face_contents,
-                         (FT_Long)job->face_length, job->face_index, &retval);
+  ft_error = FT_New_Memory_Face(
+      job->library, (const FT_Byte *)job->blob->contents,
+      (FT_Long)job->blob->length, job->face_index, &retval);
 
   if (ft_error != 0) {
     gchar *uri;
@@ -76,25 +358,18 @@ static FT_Face create_face_from_contents(FontLoadJob *job, gchar **contents,
     g_set_error(error, G_IO_ERROR, 0, "Unable to read the font face file '%s'",
                 uri);
     retval = NULL;
-    g_free(job->face_contents);
     g_free(uri);
   } else {
-    *contents = job->face_contents;
+    /* the face keeps the contents alive until FT_Done_Face() */
+    retval->generic.data = font_blob_ref(job->blob);
+    retval->generic.finalizer = font_blob_face_finalizer;
   }
 
   return retval;
 }
 
 static void font_load_job_do_load(FontLoadJob *job, GError **error) {
-  gchar *contents;
-  gsize length;
-
-  g_file_load_contents(job->file, NULL, &contents, &length, NULL, error);
-
-  if ((error != NULL) && (*error == NULL)) {
-    job->face_contents = contents;
-    job->face_length = length;
-  }
+  job->blob = font_blob_get(job->file, error);
 }
 
 static void font_load_job(GTask *task, gpointer source_object,
@@ -115,20 +390,21 @@ static void font_load_job(GTask *task, gpointer source_object,
  *
  */
 FT_Face sushi_new_ft_face_from_uri(FT_Library library, const gchar *uri,
-                                   gint face_index, gchar **contents,
-                                   GError **error) {
+                                   gint face_index, GError **error) {
   FontLoadJob *job = NULL;
+  GError *load_error = NULL;
   FT_Face face;
 
   job = font_load_job_new(library, uri, face_index, NULL, NULL);
-  font_load_job_do_load(job, error);
+  font_load_job_do_load(job, &load_error);
 
-  if ((error != NULL) && (*error != NULL)) {
+  if (load_error != NULL) {
+    g_propagate_error(error, load_error);
     font_load_job_free(job);
     return NULL;
   }
 
-  face = create_face_from_contents(job, contents, error);
+  face = create_face_from_contents(job, error);
   font_load_job_free(job);
 
   return face;
@@ -157,12 +433,12 @@ void sushi_new_ft_face_from_uri_async(FT_Library library, const gchar *uri,
  *
  */
 FT_Face sushi_new_ft_face_from_uri_finish(GAsyncResult *result,
-                                          gchar **contents, GError **error) {
+                                          GError **error) {
   FontLoadJob *job;
 
   if (!g_task_propagate_boolean(G_TASK(result), error)) return NULL;
 
   job = g_task_get_task_data(G_TASK(result));
 
-  return create_face_from_contents(job, contents, error);
+  return create_face_from_contents(job, error);
 }
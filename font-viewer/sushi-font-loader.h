@@ -32,9 +32,10 @@
 #include FT_FREETYPE_H
 #include <gio/gio.h>
 
+/* The returned faces share the contents of their file, which stay around
+ * until the last of them is destroyed with FT_Done_Face(). */
 FT_Face sushi_new_ft_face_from_uri(FT_Library library, const gchar *uri,
-                                   gint face_index, gchar **contents,
-                                   GError **error);
+                                   gint face_index, GError **error);
 
 void sushi_new_ft_face_from_uri_async(FT_Library library, const gchar *uri,
                                       gint face_index,
@@ -42,6 +43,11 @@ void sushi_new_ft_face_from_uri_async(FT_Library library, const gchar *uri,
                                       gpointer user_data);
 
 FT_Face sushi_new_ft_face_from_uri_finish(GAsyncResult *result,
-                                          gchar **contents, GError **error);
+                                          GError **error);
+
+/* Answered from a map of the characters in the face, built once and kept
+ * with the face's contents. */
+gboolean sushi_font_contains_text(FT_Face face, const gchar *text);
+gchar *sushi_font_get_random_string(FT_Face face, gint n_chars);
 
 #endif /* __SUSHI_FONT_LOADER_H__ */
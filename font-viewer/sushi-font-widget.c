@@ -41,7 +41,11 @@ struct _SushiFontWidgetPrivate {
 
   FT_Library library;
   FT_Face face;
-  gchar *face_contents;
+  cairo_font_face_t *font;
+
+  /* "size:text" -> SushiFontLine, for the face and scale drawn last */
+  GHashTable *lines;
+  gint lines_scale;
 
   const gchar *lowercase_text;
   const gchar *uppercase_text;
@@ -70,117 +74,129 @@ static const gchar lowercase_text_stock[] = "abcdefghijklmnopqrstuvwxyz";
 static const gchar uppercase_text_stock[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
 static const gchar punctuation_text_stock[] = "0123456789.:,;(*!?')";
 
-/* adapted from gnome-utils:font-viewer/font-view.c
- *
- * Copyright (C) 2002-2003  James Henstridge <james@daa.com.au>
- * Copyright (C) 2010 Cosimo Cecchi <cosimoc@gnome.org>
- *
- * License: GPLv2+
- */
-static void draw_string(SushiFontWidget *self, cairo_t *cr, GtkBorder padding,
-                        const gchar *text, gint *pos_y) {
+/* A line of text at one size: its metrics, and once it has been drawn, its
+ * glyphs as an alpha mask, so redrawing it is a single blit in the current
+ * color. */
+typedef struct {
   cairo_font_extents_t font_extents;
   cairo_text_extents_t extents;
-  GtkTextDirection text_dir;
-  gint pos_x;
-
-  text_dir = gtk_widget_get_direction(GTK_WIDGET(self));
 
-  cairo_font_extents(cr, &font_extents);
-  cairo_text_extents(cr, text, &extents);
+  cairo_surface_t *mask;
+  /* offset of the mask from the start of the baseline */
+  gint mask_x;
+  gint mask_y;
+} SushiFontLine;
 
-  if (pos_y != NULL)
-    *pos_y += font_extents.ascent + font_extents.descent + extents.y_advance +
-              LINE_SPACING / 2;
-  if (text_dir == GTK_TEXT_DIR_LTR)
-    pos_x = padding.left;
-  else {
-    pos_x = gtk_widget_get_allocated_width(GTK_WIDGET(self)) -
-            extents.x_advance - padding.right;
-  }
-
-  cairo_move_to(cr, pos_x, *pos_y);
-  cairo_show_text(cr, text);
+static void sushi_font_line_free(SushiFontLine *line) {
+  if (line->mask != NULL) cairo_surface_destroy(line->mask);
 
-  *pos_y += LINE_SPACING / 2;
+  g_slice_free(SushiFontLine, line);
 }
 
-static gboolean check_font_contain_text(FT_Face face, const gchar *text) {
-  gunichar *string;
-  glong len, idx, map;
-  FT_CharMap charmap;
-  gboolean retval = FALSE;
-
-  string = g_utf8_to_ucs4_fast(text, -1, &len);
-
-  for (map = 0; map < face->num_charmaps; map++) {
-    charmap = face->charmaps[map];
-    FT_Set_Charmap(face, charmap);
-
-    retval = TRUE;
+static SushiFontLine *get_line(SushiFontWidget *self, gint size,
+                               const gchar *text) {
+  SushiFontLine *line;
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  gchar *key = g_strdup_printf("%d:%s", size, text);
 
-    for (idx = 0; idx < len; idx++) {
-      gunichar c = string[idx];
+  line = g_hash_table_lookup(self->priv->lines, key);
+  if (line != NULL) {
+    g_free(key);
+    return line;
+  }
 
-      if (!FT_Get_Char_Index(face, c)) {
-        retval = FALSE;
-        break;
-      }
-    }
+  line = g_slice_new0(SushiFontLine);
 
-    if (retval) break;
-  }
+  surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, SURFACE_SIZE,
+                                       SURFACE_SIZE);
+  cr = cairo_create(surface);
+  cairo_set_font_face(cr, self->priv->font);
+  cairo_set_font_size(cr, size);
+  cairo_font_extents(cr, &line->font_extents);
+  cairo_text_extents(cr, text, &line->extents);
+  cairo_destroy(cr);
+  cairo_surface_destroy(surface);
 
-  g_free(string);
+  g_hash_table_insert(self->priv->lines, key, line);
 
-  return retval;
+  return line;
 }
 
-static gchar *build_charlist_for_face(FT_Face face, gint *length) {
-  GString *string;
-  gulong c;
-  guint glyph;
-  gint total_chars = 0;
+static void render_line(SushiFontWidget *self, SushiFontLine *line, gint size,
+                        const gchar *text, gint scale) {
+  const cairo_font_options_t *options;
+  cairo_t *cr;
+  gint width, height;
 
-  string = g_string_new(NULL);
+  /* a pixel of room around the ink for antialiasing */
+  line->mask_x = (gint)floor(line->extents.x_bearing) - 1;
+  line->mask_y = (gint)floor(line->extents.y_bearing) - 1;
+  width = (gint)ceil(line->extents.x_bearing + line->extents.width) -
+          line->mask_x + 1;
+  height = (gint)ceil(line->extents.y_bearing + line->extents.height) -
+           line->mask_y + 1;
 
-  c = FT_Get_First_Char(face, &glyph);
+  line->mask = cairo_image_surface_create(CAIRO_FORMAT_A8, width * scale,
+                                          height * scale);
+  cairo_surface_set_device_scale(line->mask, scale, scale);
 
-  while (glyph != 0) {
-    g_string_append_unichar(string, (gunichar)c);
-    c = FT_Get_Next_Char(face, c, &glyph);
-    total_chars++;
-  }
+  cr = cairo_create(line->mask);
 
-  if (length) *length = total_chars;
+  options =
+      gdk_screen_get_font_options(gtk_widget_get_screen(GTK_WIDGET(self)));
+  if (options != NULL) cairo_set_font_options(cr, options);
 
-  return g_string_free(string, FALSE);
+  cairo_set_font_face(cr, self->priv->font);
+  cairo_set_font_size(cr, size);
+  cairo_move_to(cr, -line->mask_x, -line->mask_y);
+  cairo_show_text(cr, text);
+  cairo_destroy(cr);
 }
 
-static gchar *random_string_from_available_chars(FT_Face face, gint n_chars) {
-  gchar *chars;
-  gint idx, rand, total_chars;
-  GString *retval;
-  gchar *ptr, *end;
-
-  idx = 0;
-  chars = build_charlist_for_face(face, &total_chars);
+static void clear_lines(SushiFontWidget *self) {
+  g_hash_table_remove_all(self->priv->lines);
+}
 
-  if (total_chars == 0) return NULL;
+/* adapted from gnome-utils:font-viewer/font-view.c
+ *
+ * Copyright (C) 2002-2003  James Henstridge <james@daa.com.au>
+ * Copyright (C) 2010 Cosimo Cecchi <cosimoc@gnome.org>
+ *
+ * License: GPLv2+
+ */
+static void draw_string(SushiFontWidget *self, cairo_t *cr, GtkBorder padding,
+                        gint size, const gchar *text, gint *pos_y) {
+  SushiFontLine *line = get_line(self, size, text);
+  GtkTextDirection text_dir;
+  GdkRectangle clip;
+  gint pos_x;
 
-  retval = g_string_new(NULL);
+  text_dir = gtk_widget_get_direction(GTK_WIDGET(self));
 
-  while (idx < n_chars) {
-    rand = g_random_int_range(0, total_chars);
+  if (pos_y != NULL)
+    *pos_y += line->font_extents.ascent + line->font_extents.descent +
+              line->extents.y_advance + LINE_SPACING / 2;
+  if (text_dir == GTK_TEXT_DIR_LTR)
+    pos_x = padding.left;
+  else {
+    pos_x = gtk_widget_get_allocated_width(GTK_WIDGET(self)) -
+            line->extents.x_advance - padding.right;
+  }
 
-    ptr = g_utf8_offset_to_pointer(chars, rand);
-    end = g_utf8_find_next_char(ptr, NULL);
+  /* lines scrolled out of view are neither rendered nor blitted */
+  if (line->extents.width > 0 && line->extents.height > 0 &&
+      (!gdk_cairo_get_clip_rectangle(cr, &clip) ||
+       (*pos_y + line->extents.y_bearing + line->extents.height >= clip.y &&
+        *pos_y + line->extents.y_bearing <= clip.y + clip.height))) {
+    if (line->mask == NULL)
+      render_line(self, line, size, text, self->priv->lines_scale);
 
-    g_string_append_len(retval, ptr, end - ptr);
-    idx++;
+    cairo_mask_surface(cr, line->mask, pos_x + line->mask_x,
+                       *pos_y + line->mask_y);
   }
 
-  return g_string_free(retval, FALSE);
+  *pos_y += LINE_SPACING / 2;
 }
 
 static gboolean set_pango_sample_string(SushiFontWidget *self) {
@@ -189,12 +205,13 @@ static gboolean set_pango_sample_string(SushiFontWidget *self) {
 
   sample_string =
       pango_language_get_sample_string(pango_language_from_string(NULL));
-  if (check_font_contain_text(self->priv->face, sample_string)) retval = TRUE;
+  if (sushi_font_contains_text(self->priv->face, sample_string)) retval = TRUE;
 
   if (!retval) {
     sample_string =
         pango_language_get_sample_string(pango_language_from_string("C"));
-    if (check_font_contain_text(self->priv->face, sample_string)) retval = TRUE;
+    if (sushi_font_contains_text(self->priv->face, sample_string))
+      retval = TRUE;
   }
 
   if (retval) {
@@ -209,24 +226,24 @@ static void build_strings_for_face(SushiFontWidget *self) {
   /* if we don't have lowercase/uppercase/punctuation text in the face,
    * we omit it directly, and render a random text below.
    */
-  if (check_font_contain_text(self->priv->face, lowercase_text_stock))
+  if (sushi_font_contains_text(self->priv->face, lowercase_text_stock))
     self->priv->lowercase_text = lowercase_text_stock;
   else
     self->priv->lowercase_text = NULL;
 
-  if (check_font_contain_text(self->priv->face, uppercase_text_stock))
+  if (sushi_font_contains_text(self->priv->face, uppercase_text_stock))
     self->priv->uppercase_text = uppercase_text_stock;
   else
     self->priv->uppercase_text = NULL;
 
-  if (check_font_contain_text(self->priv->face, punctuation_text_stock))
+  if (sushi_font_contains_text(self->priv->face, punctuation_text_stock))
     self->priv->punctuation_text = punctuation_text_stock;
   else
     self->priv->punctuation_text = NULL;
 
   if (!set_pango_sample_string(self))
     self->priv->sample_string =
-        random_string_from_available_chars(self->priv->face, 36);
+        sushi_font_get_random_string(self->priv->face, 36);
 
   g_free(self->priv->font_name);
   self->priv->font_name = NULL;
@@ -235,7 +252,7 @@ static void build_strings_for_face(SushiFontWidget *self) {
     gchar *font_name = g_strconcat(self->priv->face->family_name, " ",
                                    self->priv->face->style_name, NULL);
 
-    if (check_font_contain_text(self->priv->face, font_name))
+    if (sushi_font_contains_text(self->priv->face, font_name))
       self->priv->font_name = font_name;
     else
       g_free(font_name);
@@ -299,16 +316,14 @@ static void sushi_font_widget_size_request(GtkWidget *drawing_area, gint *width,
   SushiFontWidget *self = SUSHI_FONT_WIDGET(drawing_area);
   SushiFontWidgetPrivate *priv = self->priv;
   gint i, pixmap_width, pixmap_height;
-  cairo_text_extents_t extents;
-  cairo_font_extents_t font_extents;
-  cairo_font_face_t *font;
+  SushiFontLine *line;
   gint *sizes = NULL, n_sizes, alpha_size, title_size;
-  cairo_t *cr;
-  cairo_surface_t *surface;
   FT_Face face = priv->face;
   GtkStyleContext *context;
   GtkStateFlags state;
   GtkBorder padding;
+  const gchar *alpha_texts[] = {priv->lowercase_text, priv->uppercase_text,
+                                priv->punctuation_text};
 
   if (face == NULL) {
     if (width != NULL) *width = 1;
@@ -320,9 +335,6 @@ static void sushi_font_widget_size_request(GtkWidget *drawing_area, gint *width,
 
   if (min_height != NULL) *min_height = -1;
 
-  surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, SURFACE_SIZE,
-                                       SURFACE_SIZE);
-  cr = cairo_create(surface);
   context = gtk_widget_get_style_context(drawing_area);
   state = gtk_style_context_get_state(context);
   gtk_style_context_get_padding(context, state, &padding);
@@ -333,59 +345,35 @@ static void sushi_font_widget_size_request(GtkWidget *drawing_area, gint *width,
   pixmap_width = padding.left + padding.right;
   pixmap_height = padding.top + padding.bottom;
 
-  font = cairo_ft_font_face_create_for_ft_face(face, 0);
-  cairo_set_font_face(cr, font);
-  cairo_font_face_destroy(font);
-
   if (self->priv->font_name != NULL) {
-    cairo_set_font_size(cr, title_size);
-    cairo_font_extents(cr, &font_extents);
-    cairo_text_extents(cr, self->priv->font_name, &extents);
-    pixmap_height += font_extents.ascent + font_extents.descent +
-                     extents.y_advance + LINE_SPACING;
+    line = get_line(self, title_size, self->priv->font_name);
+    pixmap_height += line->font_extents.ascent + line->font_extents.descent +
+                     line->extents.y_advance + LINE_SPACING;
     pixmap_width =
-        MAX(pixmap_width, extents.width + padding.left + padding.right);
+        MAX(pixmap_width, line->extents.width + padding.left + padding.right);
   }
 
   pixmap_height += SECTION_SPACING / 2;
-  cairo_set_font_size(cr, alpha_size);
-  cairo_font_extents(cr, &font_extents);
 
-  if (self->priv->lowercase_text != NULL) {
-    cairo_text_extents(cr, self->priv->lowercase_text, &extents);
-    pixmap_height += font_extents.ascent + font_extents.descent +
-                     extents.y_advance + LINE_SPACING;
-    pixmap_width =
-        MAX(pixmap_width, extents.width + padding.left + padding.right);
-  }
-
-  if (self->priv->uppercase_text != NULL) {
-    cairo_text_extents(cr, self->priv->uppercase_text, &extents);
-    pixmap_height += font_extents.ascent + font_extents.descent +
-                     extents.y_advance + LINE_SPACING;
-    pixmap_width =
-        MAX(pixmap_width, extents.width + padding.left + padding.right);
-  }
+  for (i = 0; i < (gint)G_N_ELEMENTS(alpha_texts); i++) {
+    if (alpha_texts[i] == NULL) continue;
 
-  if (self->priv->punctuation_text != NULL) {
-    cairo_text_extents(cr, self->priv->punctuation_text, &extents);
-    pixmap_height += font_extents.ascent + font_extents.descent +
-                     extents.y_advance + LINE_SPACING;
+    line = get_line(self, alpha_size, alpha_texts[i]);
+    pixmap_height += line->font_extents.ascent + line->font_extents.descent +
+                     line->extents.y_advance + LINE_SPACING;
     pixmap_width =
-        MAX(pixmap_width, extents.width + padding.left + padding.right);
+        MAX(pixmap_width, line->extents.width + padding.left + padding.right);
   }
 
   if (self->priv->sample_string != NULL) {
     pixmap_height += SECTION_SPACING;
 
     for (i = 0; i < n_sizes; i++) {
-      cairo_set_font_size(cr, sizes[i]);
-      cairo_font_extents(cr, &font_extents);
-      cairo_text_extents(cr, self->priv->sample_string, &extents);
-      pixmap_height += font_extents.ascent + font_extents.descent +
-                       extents.y_advance + LINE_SPACING;
-      pixmap_width =
-          MAX(pixmap_width, extents.width + padding.left + padding.right);
+      line = get_line(self, sizes[i], self->priv->sample_string);
+      pixmap_height += line->font_extents.ascent + line->font_extents.descent +
+                       line->extents.y_advance + LINE_SPACING;
+      pixmap_width = MAX(pixmap_width,
+                         line->extents.width + padding.left + padding.right);
 
       if ((i == 7) && (min_height != NULL)) *min_height = pixmap_height;
     }
@@ -399,8 +387,6 @@ static void sushi_font_widget_size_request(GtkWidget *drawing_area, gint *width,
 
   if (height != NULL) *height = pixmap_height;
 
-  cairo_destroy(cr);
-  cairo_surface_destroy(surface);
   g_free(sizes);
 }
 
@@ -428,8 +414,7 @@ static void sushi_font_widget_get_preferred_height(GtkWidget *drawing_area,
 static gboolean sushi_font_widget_draw(GtkWidget *drawing_area, cairo_t *cr) {
   SushiFontWidget *self = SUSHI_FONT_WIDGET(drawing_area);
   SushiFontWidgetPrivate *priv = self->priv;
-  gint *sizes = NULL, n_sizes, alpha_size, title_size, pos_y = 0, i;
-  cairo_font_face_t *font;
+  gint *sizes = NULL, n_sizes, alpha_size, title_size, pos_y = 0, i, scale;
   FT_Face face = priv->face;
   GtkStyleContext *context;
   GdkRGBA color;
@@ -454,39 +439,42 @@ static gboolean sushi_font_widget_draw(GtkWidget *drawing_area, cairo_t *cr) {
 
   sizes = build_sizes_table(face, &n_sizes, &alpha_size, &title_size);
 
-  font = cairo_ft_font_face_create_for_ft_face(face, 0);
-  cairo_set_font_face(cr, font);
-  cairo_font_face_destroy(font);
+  /* the masks are rendered for one scale factor */
+  scale = gtk_widget_get_scale_factor(drawing_area);
+  if (scale != priv->lines_scale) {
+    clear_lines(self);
+    priv->lines_scale = scale;
+  }
 
   /* draw text */
 
-  if (self->priv->font_name != NULL) {
-    cairo_set_font_size(cr, title_size);
-    draw_string(self, cr, padding, self->priv->font_name, &pos_y);
-  }
+  if (self->priv->font_name != NULL)
+    draw_string(self, cr, padding, title_size, self->priv->font_name, &pos_y);
 
   if (pos_y > allocated_height) goto end;
 
   pos_y += SECTION_SPACING / 2;
-  cairo_set_font_size(cr, alpha_size);
 
   if (self->priv->lowercase_text != NULL)
-    draw_string(self, cr, padding, self->priv->lowercase_text, &pos_y);
+    draw_string(self, cr, padding, alpha_size, self->priv->lowercase_text,
+                &pos_y);
   if (pos_y > allocated_height) goto end;
 
   if (self->priv->uppercase_text != NULL)
-    draw_string(self, cr, padding, self->priv->uppercase_text, &pos_y);
+    draw_string(self, cr, padding, alpha_size, self->priv->uppercase_text,
+                &pos_y);
   if (pos_y > allocated_height) goto end;
 
   if (self->priv->punctuation_text != NULL)
-    draw_string(self, cr, padding, self->priv->punctuation_text, &pos_y);
+    draw_string(self, cr, padding, alpha_size, self->priv->punctuation_text,
+                &pos_y);
   if (pos_y > allocated_height) goto end;
 
   pos_y += SECTION_SPACING;
 
   for (i = 0; i < n_sizes; i++) {
-    cairo_set_font_size(cr, sizes[i]);
-    draw_string(self, cr, padding, self->priv->sample_string, &pos_y);
+    draw_string(self, cr, padding, sizes[i], self->priv->sample_string,
+                &pos_y);
     if (pos_y > allocated_height) break;
   }
 
@@ -501,8 +489,7 @@ static void font_face_async_ready_cb(GObject *object, GAsyncResult *result,
   SushiFontWidget *self = user_data;
   GError *error = NULL;
 
-  self->priv->face = sushi_new_ft_face_from_uri_finish(
-      result, &self->priv->face_contents, &error);
+  self->priv->face = sushi_new_ft_face_from_uri_finish(result, &error);
 
   if (error != NULL) {
     g_signal_emit(self, signals[ERROR], 0, error->message);
@@ -512,6 +499,11 @@ static void font_face_async_ready_cb(GObject *object, GAsyncResult *result,
     return;
   }
 
+  /* everything cached was drawn with the previous face */
+  clear_lines(self);
+  if (self->priv->font != NULL) cairo_font_face_destroy(self->priv->font);
+  self->priv->font = cairo_ft_font_face_create_for_ft_face(self->priv->face, 0);
+
   build_strings_for_face(self);
 
   gtk_widget_queue_resize(GTK_WIDGET(self));
@@ -530,6 +522,11 @@ static void sushi_font_widget_init(SushiFontWidget *self) {
   self->priv = sushi_font_widget_get_instance_private(self);
 
   self->priv->face = NULL;
+  self->priv->lines =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                            (GDestroyNotify)sushi_font_line_free);
+  self->priv->lines_scale = 1;
+
   err = FT_Init_FreeType(&self->priv->library);
 
   if (err != FT_Err_Ok) g_error("Unable to initialize FreeType");
@@ -578,6 +575,13 @@ static void sushi_font_widget_finalize(GObject *object) {
 
   g_free(self->priv->uri);
 
+  /* the cached masks and the cairo face refer to the FreeType face */
+  g_hash_table_destroy(self->priv->lines);
+  if (self->priv->font != NULL) {
+    cairo_font_face_destroy(self->priv->font);
+    self->priv->font = NULL;
+  }
+
   if (self->priv->face != NULL) {
     FT_Done_Face(self->priv->face);
     self->priv->face = NULL;
@@ -585,7 +589,6 @@ static void sushi_font_widget_finalize(GObject *object) {
 
   g_free(self->priv->font_name);
   g_free(self->priv->sample_string);
-  g_free(self->priv->face_contents);
 
   if (self->priv->library != NULL) {
     FT_Done_FreeType(self->priv->library);
@@ -55,44 +55,72 @@ void remove_container_entries(GtkContainer *widget) {
   if (children) g_list_free(children);
 }
 
+/* the launchers to show in a table, in order */
+#define TABLE_ELEMENTS_KEY "App Resizer Table Elements"
+
 static void resize_table(AppResizer *widget, GtkGrid *table, gint columns) {
-  remove_container_entries(GTK_CONTAINER(table));
   widget->column = columns;
 }
 
+/* Moves the elements to their cells and hides the other children of the
+ * table.  Children are never removed, so filtering does not have to
+ * unparent and re-add every launcher. */
 static void relayout_table(AppResizer *widget, GtkGrid *table,
                            GList *element_list) {
+  GHashTable *placed;
+  GList *children, *l;
   gint row = 0, col = 0;
-  do {
-    GtkWidget *element = GTK_WIDGET(element_list->data);
-    gtk_grid_attach(table, element, col, row, 1, 1);
+
+  placed = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  for (l = element_list; l; l = g_list_next(l)) {
+    GtkWidget *element = GTK_WIDGET(l->data);
+
+    if (gtk_widget_get_parent(element) == GTK_WIDGET(table)) {
+      gtk_container_child_set(GTK_CONTAINER(table), element, "left-attach",
+                              col, "top-attach", row, NULL);
+      gtk_widget_show(element);
+    } else {
+      gtk_grid_attach(table, element, col, row, 1, 1);
+      gtk_widget_show_all(element);
+    }
+    g_hash_table_add(placed, element);
+
     col++;
     if (col == widget->column) {
       col = 0;
       row++;
     }
-  } while (NULL != (element_list = g_list_next(element_list)));
+  }
+
+  children = gtk_container_get_children(GTK_CONTAINER(table));
+  for (l = children; l; l = g_list_next(l)) {
+    if (!g_hash_table_contains(placed, l->data)) gtk_widget_hide(l->data);
+  }
+  g_list_free(children);
+  g_hash_table_destroy(placed);
 }
 
 void app_resizer_layout_table_default(AppResizer *widget, GtkGrid *table,
                                       GList *element_list) {
+  g_object_set_data_full(G_OBJECT(table), TABLE_ELEMENTS_KEY,
+                         g_list_copy(element_list),
+                         (GDestroyNotify)g_list_free);
+
   resize_table(widget, table, widget->cur_num_cols);
   relayout_table(widget, table, element_list);
 }
 
 static void relayout_tables(AppResizer *widget, gint num_cols) {
   GtkGrid *table;
-  GList *table_list, *launcher_list;
+  GList *table_list;
 
   for (table_list = widget->cached_tables_list; table_list != NULL;
        table_list = g_list_next(table_list)) {
     table = GTK_GRID(table_list->data);
-    launcher_list = gtk_container_get_children(GTK_CONTAINER(table));
-    launcher_list = g_list_reverse(
-        launcher_list); /* Fixme - ugly hack because table stores prepend */
     resize_table(widget, table, num_cols);
-    relayout_table(widget, table, launcher_list);
-    g_list_free(launcher_list);
+    relayout_table(widget, table,
+                   g_object_get_data(G_OBJECT(table), TABLE_ELEMENTS_KEY));
   }
 }
 
@@ -43,6 +43,7 @@
 #include "themed-icon.h"
 
 #define TILE_EXEC_NAME "Tile_desktop_exec_name"
+#define TILE_SEARCH_TEXT "Tile_search_text"
 #define CC_SCHEMA "org.mate.control-center"
 #define EXIT_SHELL_ON_ACTION_START "cc-exit-shell-on-action-start"
 #define EXIT_SHELL_ON_ACTION_HELP "cc-exit-shell-on-action-help"
@@ -98,6 +99,7 @@ static void handle_launcher_single_clicked(Tile *launcher, gpointer data);
 static void handle_menu_action_performed(Tile *launcher, TileEvent *event,
                                          TileAction *action, gpointer data);
 static gint application_launcher_compare(gconstpointer a, gconstpointer b);
+static gchar *get_search_key(const gchar *text);
 static void matemenu_tree_changed_callback(MateMenuTree *tree,
                                            gpointer user_data);
 gboolean regenerate_categories(AppShellData *app_data);
@@ -309,58 +311,6 @@ void layout_shell(AppShellData *app_data, const gchar *filter_title,
   shell_window_set_contents(SHELL_WINDOW(app_data->shell), left_vbox, sw);
 }
 
-static gboolean relayout_shell_partial(gpointer user_data) {
-  AppShellData *app_data = (AppShellData *)user_data;
-  GtkBox *vbox = APP_RESIZER(app_data->category_layout)->child;
-  CategoryData *data;
-
-  if (app_data->stop_incremental_relayout) return FALSE;
-
-  if (app_data->incremental_relayout_cat_list != NULL) {
-    /* There are still categories to layout */
-    data = (CategoryData *)app_data->incremental_relayout_cat_list->data;
-    if (data->filtered_launcher_list != NULL) {
-      populate_application_category_section(app_data, data->section,
-                                            data->filtered_launcher_list);
-      gtk_box_pack_start(vbox, GTK_WIDGET(data->section), TRUE, TRUE, 0);
-      app_data->filtered_out_everything = FALSE;
-    }
-
-    app_data->incremental_relayout_cat_list =
-        g_list_next(app_data->incremental_relayout_cat_list);
-    return TRUE;
-  }
-
-  /* We're done laying out the categories; finish up */
-  if (app_data->filtered_out_everything)
-    show_no_results_message(app_data, GTK_WIDGET(vbox));
-
-  app_resizer_set_table_cache(APP_RESIZER(app_data->category_layout),
-                              app_data->cached_tables_list);
-  populate_groups_section(app_data);
-
-  gtk_widget_show_all(app_data->category_layout);
-  gdk_window_set_cursor(gtk_widget_get_window(app_data->shell), NULL);
-
-  app_data->stop_incremental_relayout = TRUE;
-  return FALSE;
-}
-
-static void relayout_shell_incremental(AppShellData *app_data) {
-  GtkBox *vbox = APP_RESIZER(app_data->category_layout)->child;
-
-  app_data->stop_incremental_relayout = FALSE;
-  app_data->filtered_out_everything = TRUE;
-  app_data->incremental_relayout_cat_list = app_data->categories_list;
-
-  if (app_data->cached_tables_list) g_list_free(app_data->cached_tables_list);
-  app_data->cached_tables_list = NULL;
-
-  remove_container_entries(GTK_CONTAINER(vbox));
-
-  g_idle_add((GSourceFunc)relayout_shell_partial, app_data);
-}
-
 static void relayout_shell(AppShellData *app_data) {
   GtkWidget *shell = app_data->shell;
   GtkBox *vbox = APP_RESIZER(app_data->category_layout)->child;
@@ -440,17 +390,22 @@ static void populate_groups_section(AppShellData *app_data) {
   GList *cat_list;
 
   vbox = GTK_BOX(section->contents);
-  remove_container_entries(GTK_CONTAINER(vbox));
 
   cat_list = app_data->categories_list;
   do {
     CategoryData *data = (CategoryData *)cat_list->data;
-    if (NULL != data->filtered_launcher_list) {
-      gtk_widget_set_state_flags(GTK_WIDGET(data->group_launcher),
-                                 GTK_STATE_FLAG_NORMAL, FALSE);
-      gtk_box_pack_start(vbox, GTK_WIDGET(data->group_launcher), FALSE, FALSE,
-                         0);
+    GtkWidget *group_launcher = GTK_WIDGET(data->group_launcher);
+
+    /* every group stays packed, filtering only hides the empty ones */
+    if (!gtk_widget_get_parent(group_launcher)) {
+      gtk_widget_show_all(group_launcher);
+      gtk_widget_set_no_show_all(group_launcher, TRUE);
+      gtk_box_pack_start(vbox, group_launcher, FALSE, FALSE, 0);
     }
+
+    gtk_widget_set_state_flags(group_launcher, GTK_STATE_FLAG_NORMAL, FALSE);
+    gtk_widget_set_visible(group_launcher,
+                           NULL != data->filtered_launcher_list);
   } while (NULL != (cat_list = g_list_next(cat_list)));
 }
 
@@ -521,32 +476,23 @@ static GtkWidget *create_filter_section(AppShellData *app_data,
 
 static gboolean handle_filter_changed_delayed(gpointer user_data) {
   AppShellData *app_data = (AppShellData *)user_data;
+  GtkBox *vbox = APP_RESIZER(app_data->category_layout)->child;
 
   g_list_foreach(app_data->categories_list, generate_filtered_lists,
                  (gpointer)app_data->filter_string);
   app_data->last_clicked_launcher = NULL;
 
-  /*  showing the updates incremtally is very visually distracting. Much worse
-     than just blanking until the incremental work is done and then doing one
-     show. It would be nice to optimize this though somehow and not even show
-     any change but the cursor change until all the work is done. But since we
-     do the work incrementally in an idle loop I don't know how else besides
-     hiding to not show incremental updates
-   */
-  /* gdk_window_freeze_updates(app_data->category_layout->window); */
-  gtk_widget_hide(app_data->category_layout);
-  app_data->busy_cursor = gdk_cursor_new_for_display(
-      gtk_widget_get_display(app_data->shell), GDK_WATCH);
-  gdk_window_set_cursor(gtk_widget_get_window(app_data->shell),
-                        app_data->busy_cursor);
-  g_object_unref(app_data->busy_cursor);
-
+  /* Only the visibility and grid position of the tiles change, so this is
+     cheap enough to do at once rather than hiding the layout and rebuilding
+     it a category at a time. */
   set_state(app_data, NULL);
+  populate_application_category_sections(app_data, GTK_WIDGET(vbox));
+  app_resizer_set_table_cache(APP_RESIZER(app_data->category_layout),
+                              app_data->cached_tables_list);
+  populate_groups_section(app_data);
   app_resizer_set_vadjustment_value(app_data->category_layout, 0);
 
-  relayout_shell_incremental(app_data);
-
-  app_data->filter_changed_timeout = 0;
+  app_data->filter_changed_idle = 0;
   return FALSE;
 }
 
@@ -559,54 +505,60 @@ static gboolean handle_filter_changed(NldSearchBar *search_bar,
   if (app_data->filter_string) g_free(app_data->filter_string);
   app_data->filter_string = g_strdup(text);
 
-  if (app_data->filter_changed_timeout)
-    g_source_remove(app_data->filter_changed_timeout);
-
-  app_data->filter_changed_timeout =
-      g_timeout_add(75, handle_filter_changed_delayed, app_data);
-  app_data->stop_incremental_relayout = TRUE;
+  /* coalesce the changes made before the next frame */
+  if (!app_data->filter_changed_idle)
+    app_data->filter_changed_idle = g_idle_add_full(
+        G_PRIORITY_HIGH_IDLE, handle_filter_changed_delayed, app_data, NULL);
 
   return FALSE;
 }
 
-static void generate_filtered_lists(gpointer catdata, gpointer user_data) {
-  CategoryData *data = (CategoryData *)catdata;
+/* Launchers whose name starts with the filter come first, the rest keep the
+ * alphabetical order of the category. */
+static gint filtered_launcher_compare(gconstpointer a, gconstpointer b,
+                                      gpointer user_data) {
+  const gchar *search_key = user_data;
+  const gchar *text_a = g_object_get_data(G_OBJECT(a), TILE_SEARCH_TEXT);
+  const gchar *text_b = g_object_get_data(G_OBJECT(b), TILE_SEARCH_TEXT);
+  gboolean prefix_a, prefix_b;
 
-  /* Fixme - everywhere you use ascii you need to fix up for multibyte */
-  gchar *filter_string = g_ascii_strdown(user_data, -1);
-  gchar *temp1, *temp2;
-  GList *launcher_list = data->launcher_list;
+  prefix_a = g_str_has_prefix(text_a, search_key);
+  prefix_b = g_str_has_prefix(text_b, search_key);
+  if (prefix_a != prefix_b) return prefix_a ? -1 : 1;
 
-  g_list_free(data->filtered_launcher_list);
-  data->filtered_launcher_list = NULL;
+  return application_launcher_compare(a, b);
+}
 
-  do {
-    ApplicationTile *launcher = APPLICATION_TILE(launcher_list->data);
-    const gchar *filename;
+static void generate_filtered_lists(gpointer catdata, gpointer user_data) {
+  CategoryData *data = (CategoryData *)catdata;
+  gchar *search_key = get_search_key(user_data);
+  GList *launcher_list;
+  GList *filtered = NULL;
+
+  /* a filter containing the previous one can only narrow its results */
+  if (data->filter_key && strstr(search_key, data->filter_key))
+    launcher_list = data->filtered_launcher_list;
+  else
+    launcher_list = data->launcher_list;
 
-    temp1 = NULL;
-    temp2 = NULL;
+  for (; launcher_list; launcher_list = g_list_next(launcher_list)) {
+    GObject *launcher = launcher_list->data;
 
     /* Since the filter may remove this entry from the
        container it will not get a mouse out event */
     gtk_widget_set_state_flags(GTK_WIDGET(launcher), GTK_STATE_FLAG_NORMAL,
                                FALSE);
-    filename = g_object_get_data(G_OBJECT(launcher),
-                                 TILE_EXEC_NAME); /* do I need to free this */
-
-    temp1 = g_ascii_strdown(launcher->name, -1);
-    if (launcher->description)
-      temp2 = g_ascii_strdown(launcher->description, -1);
-    if (g_strrstr(temp1, filter_string) ||
-        (launcher->description && g_strrstr(temp2, filter_string)) ||
-        g_strrstr(filename, filter_string)) {
-      data->filtered_launcher_list =
-          g_list_append(data->filtered_launcher_list, launcher);
-    }
-    if (temp1) g_free(temp1);
-    if (temp2) g_free(temp2);
-  } while (NULL != (launcher_list = g_list_next(launcher_list)));
-  g_free(filter_string);
+
+    if (strstr(g_object_get_data(launcher, TILE_SEARCH_TEXT), search_key))
+      filtered = g_list_prepend(filtered, launcher);
+  }
+
+  g_list_free(data->filtered_launcher_list);
+  data->filtered_launcher_list =
+      g_list_sort_with_data(filtered, filtered_launcher_compare, search_key);
+
+  g_free(data->filter_key);
+  data->filter_key = search_key;
 }
 
 static void delete_old_data(AppShellData *app_data) {
@@ -633,6 +585,7 @@ static void delete_old_data(AppShellData *app_data) {
 
     g_list_free(data->launcher_list);
     g_list_free(data->filtered_launcher_list);
+    g_free(data->filter_key);
     g_free(data);
   } while (NULL != (cat_list = g_list_next(cat_list)));
 
@@ -726,8 +679,17 @@ static void show_no_results_message(AppShellData *app_data,
   gtk_label_set_text(app_data->filtered_out_everything_widget_label, markup);
   gtk_label_set_use_markup(app_data->filtered_out_everything_widget_label,
                            TRUE);
-  gtk_box_pack_start(GTK_BOX(containing_vbox),
-                     app_data->filtered_out_everything_widget, TRUE, TRUE, 0);
+  if (!gtk_widget_get_parent(app_data->filtered_out_everything_widget)) {
+    gtk_widget_show_all(app_data->filtered_out_everything_widget);
+    gtk_widget_set_no_show_all(app_data->filtered_out_everything_widget,
+                               TRUE);
+    gtk_box_pack_start(GTK_BOX(containing_vbox),
+                       app_data->filtered_out_everything_widget, TRUE, TRUE,
+                       0);
+  }
+  gtk_box_reorder_child(GTK_BOX(containing_vbox),
+                        app_data->filtered_out_everything_widget, -1);
+  gtk_widget_show(app_data->filtered_out_everything_widget);
   g_free(str1);
   g_free(str2);
   g_free(markup);
@@ -740,20 +702,29 @@ static void populate_application_category_sections(AppShellData *app_data,
   if (app_data->cached_tables_list) g_list_free(app_data->cached_tables_list);
   app_data->cached_tables_list = NULL;
 
-  remove_container_entries(GTK_CONTAINER(containing_vbox));
   do {
     CategoryData *data = (CategoryData *)cat_list->data;
+    GtkWidget *section = GTK_WIDGET(data->section);
+
+    /* every section stays packed, filtering only hides the empty ones */
+    if (!gtk_widget_get_parent(section)) {
+      gtk_widget_show_all(section);
+      gtk_widget_set_no_show_all(section, TRUE);
+      gtk_box_pack_start(GTK_BOX(containing_vbox), section, TRUE, TRUE, 0);
+    }
+
     if (NULL != data->filtered_launcher_list) {
       populate_application_category_section(app_data, data->section,
                                             data->filtered_launcher_list);
-      gtk_box_pack_start(GTK_BOX(containing_vbox), GTK_WIDGET(data->section),
-                         TRUE, TRUE, 0);
       filtered_out_everything = FALSE;
     }
+    gtk_widget_set_visible(section, NULL != data->filtered_launcher_list);
   } while (NULL != (cat_list = g_list_next(cat_list)));
 
   if (TRUE == filtered_out_everything)
     show_no_results_message(app_data, containing_vbox);
+  else if (app_data->filtered_out_everything_widget)
+    gtk_widget_hide(app_data->filtered_out_everything_widget);
 }
 
 static void populate_application_category_section(AppShellData *app_data,
@@ -819,7 +790,6 @@ AppShellData *appshelldata_new(const gchar *menu_name, GtkIconSize icon_size,
   app_data->settings = g_settings_new(CC_SCHEMA);
   app_data->menu_name = menu_name;
   app_data->icon_size = icon_size;
-  app_data->stop_incremental_relayout = TRUE;
   app_data->show_tile_generic_name = show_tile_generic_name;
   app_data->exit_on_close = exit_on_close;
   if (new_apps_max_items > 0) {
@@ -1196,6 +1166,9 @@ static void insert_launcher_into_category(CategoryData *cat_data,
 
   gchar *filepath;
   gchar *filename;
+  const gchar *description;
+  const gchar *keywords;
+  gchar *search_text;
   GtkWidget *tile_icon;
 
   if (!icon_group) icon_group = gtk_size_group_new(GTK_SIZE_GROUP_HORIZONTAL);
@@ -1215,6 +1188,18 @@ static void insert_launcher_into_category(CategoryData *cat_data,
   g_free(filepath);
   g_object_set_data(G_OBJECT(launcher), TILE_EXEC_NAME, filename);
 
+  /* what the filter is matched against, starting with the name so prefix
+     matches can be ranked first; fields are separated by newlines so a
+     filter never matches across them */
+  description = APPLICATION_TILE(launcher)->description;
+  keywords = mate_desktop_item_get_localestring(desktop_item, "Keywords");
+  search_text = g_strjoin("\n", APPLICATION_TILE(launcher)->name,
+                          description ? description : "", filename,
+                          keywords ? keywords : "", NULL);
+  g_object_set_data_full(G_OBJECT(launcher), TILE_SEARCH_TEXT,
+                         get_search_key(search_text), g_free);
+  g_free(search_text);
+
   tile_icon = NAMEPLATE_TILE(launcher)->image;
   gtk_size_group_add_widget(icon_group, tile_icon);
 
@@ -1246,6 +1231,21 @@ static void insert_launcher_into_category(CategoryData *cat_data,
                            application_launcher_compare);
 }
 
+/* Normalizes text so that filters match regardless of case and of how
+ * accented characters are composed. */
+static gchar *get_search_key(const gchar *text) {
+  gchar *normalized;
+  gchar *key;
+
+  normalized = g_utf8_normalize(text, -1, G_NORMALIZE_ALL);
+  if (!normalized) return g_strdup("");
+
+  key = g_utf8_casefold(normalized, -1);
+  g_free(normalized);
+
+  return key;
+}
+
 static gint application_launcher_compare(gconstpointer a, gconstpointer b) {
   ApplicationTile *launcher1 = APPLICATION_TILE(a);
   ApplicationTile *launcher2 = APPLICATION_TILE(b);
@@ -70,7 +70,6 @@ typedef struct _AppShellData {
 
   GtkWidget *filter_section;
   gchar *filter_string;
-  GdkCursor *busy_cursor;
 
   GtkWidget *category_layout;
   GList *categories_list;
@@ -84,10 +83,7 @@ typedef struct _AppShellData {
   MateMenuTree *tree;
   GHashTable *hash;
 
-  guint filter_changed_timeout;
-  gboolean stop_incremental_relayout;
-  GList *incremental_relayout_cat_list;
-  gboolean filtered_out_everything;
+  guint filter_changed_idle;
   GtkWidget *filtered_out_everything_widget;
   GtkLabel *filtered_out_everything_widget_label;
 
@@ -104,6 +100,8 @@ typedef struct {
   SlabSection *section;
   GList *launcher_list;
   GList *filtered_launcher_list;
+  /* search key filtered_launcher_list was built for, NULL if unfiltered */
+  gchar *filter_key;
 } CategoryData;
 
 typedef struct {